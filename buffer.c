@@ -0,0 +1,294 @@
+/*
+  buffer.c
+      Buffer protocol helpers of Matrix and Vector objects for pnumeric
+      Python module.
+
+      Matrix and Vector export their data with shape and strides, so
+      memoryview, array, sockets or files read them without boxing every
+      item into a float. Matrix.frombuffer() and Vector.frombuffer() go
+      the other way and wrap memory of another object without a copy.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include "Python.h"
+#include "m2/m2.h"
+#include "pnumeric.h"
+
+
+
+/*
+ * fill view of data, shape and strides are in items of dtype,
+ * shape and strides in bytes are stored to layout of 2*ndim items
+ * kept by the exporting object, memoryview copies the view fields
+ * return 0 - success, -1 - error
+ */
+int
+buffer_export(PyObject *self, Py_buffer *view, int flags, Float *data, int dtype,
+              int ndim, const int *shape, const int *strides, Py_ssize_t *layout)
+{
+    Py_ssize_t size = dtype_size(dtype), n;
+    int i, c_order = 1, f_order = 1;
+
+    // a dimension of length 1 may have any stride
+    for (i=ndim-1, n=1; i>=0; i--) {
+        if (shape[i] > 1 && strides[i] != n)
+            c_order = 0;
+        n *= shape[i];
+    }
+    for (i=0, n=1; i<ndim; i++) {
+        if (shape[i] > 1 && strides[i] != n)
+            f_order = 0;
+        n *= shape[i];
+    }
+    if ((!c_order && (flags & PyBUF_STRIDES) != PyBUF_STRIDES)
+            || (!c_order && (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS)
+            || (!f_order && (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS)
+            || (!c_order && !f_order && (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS)) {
+        PyErr_SetString(PyExc_BufferError, "data are not contiguous, make a copy with copy()");
+        return -1;
+    }
+
+    for (i=0; i<ndim; i++) {
+        layout[i] = shape[i];
+        layout[ndim + i] = strides[i]*size;
+    }
+
+    view->buf = data;
+    view->obj = self;
+    Py_INCREF(self);
+    view->len = n*size;
+    view->readonly = 0;
+    view->itemsize = size;
+    view->format = (flags & PyBUF_FORMAT)? ((dtype == PN_F4)? "f" : "d") : NULL;
+    view->ndim = ndim;
+    view->shape = ((flags & PyBUF_ND) == PyBUF_ND)? layout : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES)? layout + ndim : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+
+    return 0;
+}
+
+
+
+/*
+ * data of dtype at p may be shared, the m2 kernels need items aligned
+ * to their size
+ * return 0 - success, -1 and exception
+ */
+int
+buffer_aligned(const void *p, int dtype)
+{
+    if ((size_t)p % dtype_size(dtype)) {
+        PyErr_SetString(PyExc_ValueError, "buffer data are not aligned to the item size, make a copy");
+        return -1;
+    }
+    return 0;
+}
+
+
+
+/*
+ * single segment of the old buffer protocol
+ * return len, -1 and exception if the data are not contiguous
+ */
+Py_ssize_t
+buffer_segment(Float *data, Py_ssize_t len, int contiguous, Py_ssize_t seg, void **ptr)
+{
+    if (seg != 0) {
+        PyErr_SetString(PyExc_SystemError, "accessing non-existent segment");
+        return -1;
+    }
+    if (!contiguous) {
+        PyErr_SetString(PyExc_BufferError, "data are not contiguous, make a copy with copy()");
+        return -1;
+    }
+    *ptr = data;
+    return len;
+}
+
+
+
+/*
+ * buffer of obj, writable if the exporter allows it; the old protocol
+ * (array.array, mmap) pins nothing, its memory may move or go away
+ * under a wrapper, so it is always read only and the callers copy it
+ * return NULL and exception if obj has no buffer
+ */
+Py_buffer *
+buffer_acquire(PyObject *obj)
+{
+    Py_buffer *view;
+    const void *rp;
+    Py_ssize_t len;
+
+    view = (Py_buffer *)PyMem_Malloc(sizeof(Py_buffer));
+    if (view == NULL)
+        return (Py_buffer *)PyErr_NoMemory();
+
+    if (PyObject_CheckBuffer(obj)) {
+        if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS) == 0)
+            return view;
+        PyErr_Clear();
+        if (PyObject_GetBuffer(obj, view, PyBUF_RECORDS_RO) == 0)
+            return view;
+    } else if (PyObject_AsReadBuffer(obj, &rp, &len) == 0) {
+        PyBuffer_FillInfo(view, obj, (void *)rp, len, 1, PyBUF_SIMPLE);
+        return view;
+    }
+
+    PyMem_Free(view);
+    return NULL;
+}
+
+
+
+/*
+ * release and free the buffer from buffer_acquire()
+ */
+void
+buffer_free(Py_buffer *view)
+{
+    PyBuffer_Release(view);
+    PyMem_Free(view);
+}
+
+
+
+/*
+ * dtype of the buffer format, -2 for bytes, -1 and exception if unknown
+ */
+static int
+format_dtype(const char *f)
+{
+    const char *s = f;
+
+    if (f == NULL)
+        return -2;
+    if (*s == '@' || *s == '=' || *s == '<')
+        s++;
+    if (!strcmp(s, "d"))
+        return PN_F8;
+    if (!strcmp(s, "f"))
+        return PN_F4;
+    if (!strcmp(s, "B") || !strcmp(s, "b") || !strcmp(s, "c"))
+        return -2;
+
+    PyErr_Format(PyExc_TypeError, "buffer format '%s' is not 'd' or 'f'", f);
+    return -1;
+}
+
+
+
+/*
+ * first item of ndim dimensional data of dtype in view
+ *
+ * A buffer of doubles or floats with ndim dimensions keeps its shape and
+ * strides. Any other contiguous buffer is read as items of dtype from
+ * offset bytes, one unknown (-1) dimension is taken from the buffer size.
+ * offset must be a multiple of the item size.
+ * return NULL and exception if the buffer doesn't fit
+ */
+Float *
+buffer_layout(Py_buffer *view, int *dtype, Py_ssize_t offset, int ndim,
+              Py_ssize_t *shape, Py_ssize_t *strides)
+{
+    Py_ssize_t size, n, avail;
+    int i, t, unknown = -1;
+
+    if ((t = format_dtype(view->format)) == -1)
+        return NULL;
+    if (t >= 0 && *dtype >= 0 && t != *dtype) {
+        PyErr_Format(PyExc_TypeError, "buffer format '%s' differs from dtype '%s'",
+                     view->format, dtype_name(*dtype));
+        return NULL;
+    }
+    if (t >= 0)
+        *dtype = t;
+    else if (*dtype < 0)
+        *dtype = PN_F8;
+    size = dtype_size(*dtype);
+
+    if (t >= 0 && view->ndim == ndim && view->shape != NULL) {
+        if (offset != 0) {
+            PyErr_SetString(PyExc_ValueError, "offset can't be used with a shaped buffer");
+            return NULL;
+        }
+        for (i=ndim-1, n=1; i>=0; i--) {
+            if (shape[i] >= 0 && shape[i] != view->shape[i]) {
+                PyErr_SetString(PyExc_ValueError, "shape differs from the buffer shape");
+                return NULL;
+            }
+            shape[i] = view->shape[i];
+            if (view->strides == NULL) {
+                strides[i] = n;
+            } else if (view->strides[i] % size) {
+                PyErr_SetString(PyExc_ValueError, "buffer strides are not multiples of the item size");
+                return NULL;
+            } else {
+                strides[i] = view->strides[i]/size;
+            }
+            n *= shape[i];
+        }
+        return (Float *)view->buf;
+    }
+
+    if (view->strides != NULL && !PyBuffer_IsContiguous(view, 'C')) {
+        PyErr_SetString(PyExc_ValueError, "buffer is not contiguous");
+        return NULL;
+    }
+    if (offset < 0 || offset > view->len) {
+        PyErr_SetString(PyExc_ValueError, "offset is out of the buffer");
+        return NULL;
+    }
+    if (offset % size) {
+        PyErr_SetString(PyExc_ValueError, "offset must be a multiple of the item size");
+        return NULL;
+    }
+    avail = (view->len - offset)/size;
+
+    for (i=0, n=1; i<ndim; i++) {
+        if (shape[i] >= 0) {
+            n *= shape[i];
+        } else if (unknown < 0) {
+            unknown = i;
+        } else {
+            PyErr_SetString(PyExc_ValueError, "shape must be given");
+            return NULL;
+        }
+    }
+    if (unknown >= 0) {
+        if ((view->len - offset) % size || n == 0 || avail % n) {
+            PyErr_SetString(PyExc_ValueError, "buffer size is not a multiple of the item size and shape");
+            return NULL;
+        }
+        shape[unknown] = avail/n;
+        n = avail;
+    }
+    if (n > avail) {
+        PyErr_SetString(PyExc_ValueError, "buffer is too small for the shape");
+        return NULL;
+    }
+
+    for (i=ndim-1, n=1; i>=0; i--) {
+        strides[i] = n;
+        n *= shape[i];
+    }
+    return (Float *)((char *)view->buf + offset);
+}
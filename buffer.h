@@ -0,0 +1,50 @@
+/*
+  buffer.h
+      Buffer protocol helpers of Matrix and Vector objects for pnumeric
+      Python module.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifndef __BUFFER_H__
+#define __BUFFER_H__
+
+#include "Python.h"
+#include "m2/m2.h"
+
+// fill view of data, shape and strides are in items of dtype,
+// layout of 2*ndim items keeps them in bytes for the view
+int buffer_export(PyObject *self, Py_buffer *view, int flags, Float *data, int dtype,
+                  int ndim, const int *shape, const int *strides, Py_ssize_t *layout);
+// data of dtype at p are aligned to the item size, -1 and exception if not
+int buffer_aligned(const void *p, int dtype);
+// single segment of the old buffer protocol, -1 and exception if not contiguous
+Py_ssize_t buffer_segment(Float *data, Py_ssize_t len, int contiguous, Py_ssize_t seg, void **ptr);
+
+// buffer of any object supporting the new or the old buffer protocol,
+// writable if possible, release with buffer_free()
+Py_buffer *buffer_acquire(PyObject *obj);
+// release and free the buffer from buffer_acquire()
+void buffer_free(Py_buffer *view);
+// first item of ndim dimensional data of dtype in view, offset bytes
+// from the start; -1 in shape (and dtype) is taken from the buffer,
+// strides are in items; NULL and exception if the buffer doesn't fit
+Float *buffer_layout(Py_buffer *view, int *dtype, Py_ssize_t offset, int ndim,
+                     Py_ssize_t *shape, Py_ssize_t *strides);
+
+#endif /* buffer.h */
@@ -0,0 +1,752 @@
+/*
+  expr.c
+      Lazy elementwise expressions of Matrix and Vector objects for
+      pnumeric Python module.
+
+      lazy(a)*2 + b - c builds a tree of ExprObject nodes instead of
+      allocating a temporary for every operator. eval() runs the tree
+      once over blocks of EX_CHUNK elements, so the intermediate values
+      stay in L1 and every operand is read exactly once.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include "Python.h"
+#include "m2/m2.h"
+
+#include "pnumeric.h"
+#include "expr.h"
+
+// elements evaluated per block, one block per stack slot fits in L1
+#define EX_CHUNK 512
+
+
+
+/*
+ * new node, operands are stolen
+ */
+static ExprObject *
+expr_node(int op, ExprObject *left, ExprObject *right)
+{
+    ExprObject *e;
+
+    e = PyObject_New(ExprObject, &ExprType);
+    if (e == NULL) {
+        Py_XDECREF(left);
+        Py_XDECREF(right);
+        return NULL;
+    }
+    e->op = op;
+    e->leaf = NULL;
+    e->value = 0;
+    e->left = left;
+    e->right = right;
+    e->kind = EX_SCALAR;
+    e->rows = 0;
+    e->cols = 0;
+    e->dtype = PN_F8;
+    e->nodes = 1 + (left? left->nodes : 0) + (right? right->nodes : 0);
+
+    return e;
+}
+
+
+
+/*
+ * number constant node
+ */
+static ExprObject *
+expr_const(double value)
+{
+    ExprObject *e = expr_node(EX_CONST, NULL, NULL);
+
+    if (e != NULL)
+        e->value = value;
+    return e;
+}
+
+
+
+/*
+ * Matrix, Vector, number or Expr as a node
+ * return new reference, NULL without exception for other types
+ */
+static ExprObject *
+as_expr(PyObject *o)
+{
+    ExprObject *e;
+
+    if (Expr_Check(o)) {
+        Py_INCREF(o);
+        return (ExprObject *)o;
+    }
+
+    if (PyFloat_Check(o) || PyInt_Check(o) || PyLong_Check(o))
+        return expr_const(PyFloat_AsDouble(o));
+
+    if (!Matrix_Check(o) && !Vector_Check(o))
+        return NULL;
+
+    e = expr_node(EX_LEAF, NULL, NULL);
+    if (e == NULL)
+        return NULL;
+    Py_INCREF(o);
+    e->leaf = o;
+    if (Matrix_Check(o)) {
+        e->kind = EX_MATRIX;
+        e->rows = ((MatrixObject *)o)->rows;
+        e->cols = ((MatrixObject *)o)->cols;
+        e->dtype = ((MatrixObject *)o)->dtype;
+    } else {
+        e->kind = EX_VECTOR;
+        e->rows = 1;
+        e->cols = vector_length((VectorObject *)o);
+        e->dtype = ((VectorObject *)o)->dtype;
+    }
+
+    return e;
+}
+
+
+
+/*
+ * pnumeric.lazy(x), deferred expression of Matrix or Vector x
+ */
+PyAPI_FUNC(PyObject *)
+expr_lazy(PyObject *self, PyObject *x)
+{
+    if (!Matrix_Check(x) && !Vector_Check(x) && !Expr_Check(x)) {
+        PyErr_SetString(PyExc_TypeError, "argument must be Matrix, Vector or Expr");
+        return NULL;
+    }
+    return (PyObject *)as_expr(x);
+}
+
+
+
+static void
+expr_dealloc(ExprObject *e)
+{
+    Py_XDECREF(e->leaf);
+    Py_XDECREF(e->left);
+    Py_XDECREF(e->right);
+    PyObject_Del(e);
+}
+
+
+
+/*
+ * data owner of Matrix or Vector, to detect operands sharing memory
+ */
+static PyObject *
+data_owner(PyObject *o)
+{
+    if (Matrix_Check(o))
+        return ((MatrixObject *)o)->base? ((MatrixObject *)o)->base : o;
+    if (((VectorObject *)o)->length < 0 && ((VectorObject *)o)->object != NULL)
+        return data_owner(((VectorObject *)o)->object);
+    return o;
+}
+
+
+
+/*
+ * compile the tree into postfix order, return stack depth needed
+ */
+static int
+compile(ExprObject *e, ExprObject **prog, int *n, int depth)
+{
+    int l, r;
+
+    if (e->op == EX_LEAF || e->op == EX_CONST) {
+        prog[(*n)++] = e;
+        return depth + 1;
+    }
+
+    l = compile(e->left, prog, n, depth);
+    r = e->right? compile(e->right, prog, n, depth + 1) : l;
+    prog[(*n)++] = e;
+
+    return (l > r)? l : r;
+}
+
+
+
+/*
+ * len elements of operand from element e0 (row major order)
+ * return pointer to them, data itself if it can be read directly
+ */
+static const Float *
+load(PyObject *o, int e0, int len, Float *buf)
+{
+    MatrixObject *m;
+    VectorObject *v;
+    Float *data;
+    int i, r, c;
+
+    if (Matrix_Check(o)) {
+        m = (MatrixObject *)o;
+        if (m->dtype == PN_F8 && Matrix_IsContiguous(m))
+            return m->data + e0;
+        r = e0 / m->cols;
+        c = e0 % m->cols;
+        for (i=0; i<len; i++) {
+            buf[i] = PN_GET(m->data, m->dtype, r*m->rs + c*m->cs);
+            if (++c == m->cols) {
+                c = 0;
+                r++;
+            }
+        }
+        return buf;
+    }
+
+    v = (VectorObject *)o;
+    data = vector_dataptr(v);
+    if (v->dtype == PN_F8 && v->stride == 1)
+        return data + e0;
+    for (i=0; i<len; i++)
+        buf[i] = PN_GET(data, v->dtype, (e0 + i)*v->stride);
+    return buf;
+}
+
+
+
+/*
+ * run the program over all elements, result goes to row major array
+ * out of the expression dtype
+ */
+static int
+run(ExprObject *e, Float *out)
+{
+    ExprObject **prog, *p;
+    const Float **val;
+    Float *buf, *dst, *cst;
+    int n = 0, depth, size, e0, len, i, k, sp;
+    int a, b;
+
+    prog = (ExprObject **)PyMem_Malloc(e->nodes*sizeof(ExprObject *));
+    if (prog == NULL)
+        return 2;
+    depth = compile(e, prog, &n, 0);
+
+    // per slot: value pointer, block buffer and constant flag/value
+    val = (const Float **)PyMem_Malloc(depth*sizeof(Float *));
+    buf = m_new(depth, EX_CHUNK);
+    cst = m_new(depth, 2);
+    if (val == NULL || buf == NULL || cst == NULL) {
+        PyMem_Free(prog);
+        PyMem_Free(val);
+        m_free(buf);
+        m_free(cst);
+        return 2;
+    }
+
+    size = e->rows*e->cols;
+    for (e0=0; e0<size; e0+=EX_CHUNK) {
+        len = (size - e0 < EX_CHUNK)? size - e0 : EX_CHUNK;
+        sp = 0;
+        for (k=0; k<n; k++) {
+            p = prog[k];
+            switch (p->op) {
+            case EX_LEAF:
+                val[sp] = load(p->leaf, e0, len, buf + sp*EX_CHUNK);
+                cst[2*sp] = 0;
+                sp++;
+                break;
+            case EX_CONST:
+                val[sp] = NULL;
+                cst[2*sp] = 1;
+                cst[2*sp + 1] = p->value;
+                sp++;
+                break;
+            case EX_NEG:
+                a = sp - 1;
+                dst = buf + a*EX_CHUNK;
+                if (val[a] != dst)
+                    memcpy(dst, val[a], len*sizeof(Float));
+                m_simd.scale(-1, dst, len);
+                val[a] = dst;
+                break;
+            default:
+                a = sp - 2;
+                b = sp - 1;
+                dst = buf + a*EX_CHUNK;
+                if (cst[2*a]) {        // number op block
+                    if (p->op == EX_ADD) {
+                        m_simd.adds(cst[2*a + 1], val[b], dst, len);
+                    } else if (p->op == EX_SUB) {
+                        if (val[b] != dst)
+                            memcpy(dst, val[b], len*sizeof(Float));
+                        m_simd.scale(-1, dst, len);
+                        m_simd.adds(cst[2*a + 1], dst, dst, len);
+                    } else {
+                        if (val[b] != dst)
+                            memcpy(dst, val[b], len*sizeof(Float));
+                        m_simd.scale(cst[2*a + 1], dst, len);
+                    }
+                } else if (cst[2*b]) { // block op number
+                    if (p->op == EX_MUL) {
+                        if (val[a] != dst)
+                            memcpy(dst, val[a], len*sizeof(Float));
+                        m_simd.scale(cst[2*b + 1], dst, len);
+                    } else {
+                        m_simd.adds((p->op == EX_ADD)? cst[2*b + 1] : -cst[2*b + 1], val[a], dst, len);
+                    }
+                } else if (p->op == EX_ADD) {
+                    m_simd.add(val[a], val[b], dst, len);
+                } else if (p->op == EX_SUB) {
+                    m_simd.sub(val[a], val[b], dst, len);
+                } else {
+                    m_simd.mul(val[a], val[b], dst, len);
+                }
+                val[a] = dst;
+                cst[2*a] = 0;
+                sp--;
+            }
+        }
+
+        if (e->dtype == PN_F4)
+            for (i=0; i<len; i++)
+                FDATA(out)[e0 + i] = (float)val[0][i];
+        else if (val[0] != out + e0)
+            memcpy(out + e0, val[0], len*sizeof(Float));
+    }
+
+    PyMem_Free(prog);
+    PyMem_Free(val);
+    m_free(buf);
+    m_free(cst);
+
+    return 0;
+}
+
+
+
+/*
+ * 1 if evaluating in place into out could overwrite elements of a
+ * leaf before they are read
+ */
+static int
+overlaps(ExprObject *e, PyObject *out)
+{
+    PyObject *o = e->leaf;
+
+    if (e->op == EX_LEAF) {
+        if (data_owner(o) != data_owner(out))
+            return 0;
+        // the same contiguous array is read and written element by element
+        if (Matrix_Check(o))
+            return !(((MatrixObject *)o)->data == ((MatrixObject *)out)->data &&
+                     Matrix_IsContiguous((MatrixObject *)o));
+        return !(vector_dataptr((VectorObject *)o) == vector_dataptr((VectorObject *)out) &&
+                 ((VectorObject *)o)->stride == 1);
+    }
+
+    return (e->left && overlaps(e->left, out)) || (e->right && overlaps(e->right, out));
+}
+
+
+
+/*
+ * evaluate the expression, into out if not NULL
+ */
+static PyObject *
+evaluate(ExprObject *self, PyObject *out)
+{
+    PyObject *tmp;
+    Float *data;
+    int g;
+
+    if (self->kind == EX_SCALAR) {
+        PyErr_SetString(PyExc_TypeError, "expression has no Matrix or Vector operand");
+        return NULL;
+    }
+
+    if (out != NULL) {
+        if (self->kind == EX_MATRIX) {
+            if (!Matrix_Check(out) || ((MatrixObject *)out)->rows != self->rows ||
+                    ((MatrixObject *)out)->cols != self->cols) {
+                PyErr_SetString(PyExc_ValueError, "out must be a Matrix of the expression shape");
+                return NULL;
+            }
+            if (((MatrixObject *)out)->dtype != self->dtype) {
+                PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+                return NULL;
+            }
+        } else {
+            if (!Vector_Check(out) || vector_length((VectorObject *)out) != self->cols) {
+                PyErr_SetString(PyExc_ValueError, "out must be a Vector of the expression length");
+                return NULL;
+            }
+            if (((VectorObject *)out)->dtype != self->dtype) {
+                PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+                return NULL;
+            }
+        }
+        if ((self->kind == EX_MATRIX && !Matrix_IsContiguous((MatrixObject *)out)) ||
+                (self->kind == EX_VECTOR && ((VectorObject *)out)->stride != 1) ||
+                overlaps(self, out)) {
+            // evaluate aside, then copy in
+            tmp = evaluate(self, NULL);
+            if (tmp == NULL)
+                return NULL;
+            if (self->kind == EX_MATRIX) {
+                if (self->dtype == PN_F4)
+                    mf_copy_strided(FDATA(((MatrixObject *)out)->data), ((MatrixObject *)out)->rs,
+                                    ((MatrixObject *)out)->cs, FDATA(((MatrixObject *)tmp)->data),
+                                    self->cols, 1, self->rows, self->cols);
+                else
+                    m_copy_strided(((MatrixObject *)out)->data, ((MatrixObject *)out)->rs,
+                                   ((MatrixObject *)out)->cs, ((MatrixObject *)tmp)->data,
+                                   self->cols, 1, self->rows, self->cols);
+                matrix_modified((MatrixObject *)out);
+            } else {
+                for (g=0; g<self->cols; g++)
+                    PN_SET(vector_dataptr((VectorObject *)out), self->dtype,
+                           g*((VectorObject *)out)->stride, PN_GET(((VectorObject *)tmp)->data, self->dtype, g));
+                if (((VectorObject *)out)->object && Matrix_Check(((VectorObject *)out)->object))
+                    matrix_modified((MatrixObject *)((VectorObject *)out)->object);
+            }
+            Py_DECREF(tmp);
+            Py_INCREF(out);
+            return out;
+        }
+        Py_INCREF(out);
+    } else if (self->kind == EX_MATRIX) {
+        out = (PyObject *)matrix_new_dtype(self->rows, self->cols, self->dtype);
+    } else {
+        out = (PyObject *)vector_new_dtype(self->cols, self->dtype);
+    }
+    if (out == NULL)
+        return NULL;
+
+    if (Matrix_Check(out))
+        data = ((MatrixObject *)out)->data;
+    else
+        data = vector_dataptr((VectorObject *)out);
+
+    g = run(self, data);
+    if (g) {
+        Py_DECREF(out);
+        return PyErr_NoMemory();
+    }
+
+    if (Matrix_Check(out))
+        matrix_modified((MatrixObject *)out);
+    else if (((VectorObject *)out)->object && Matrix_Check(((VectorObject *)out)->object))
+        matrix_modified((MatrixObject *)((VectorObject *)out)->object);
+
+    return out;
+}
+
+
+
+/*
+ * evaluate the expression in one pass, into out if given
+ */
+PyAPI_FUNC(PyObject *)
+expr_eval(ExprObject *self, PyObject *args)
+{
+    PyObject *out = NULL;
+
+    if (!PyArg_ParseTuple(args, "|O", &out))
+        return NULL;
+
+    return evaluate(self, (out == Py_None)? NULL : out);
+}
+
+
+
+/*
+ * Matrix product of two matrix expressions, not elementwise, so it is
+ * evaluated now and becomes a leaf
+ */
+static PyObject *
+matrix_product(ExprObject *a, ExprObject *b)
+{
+    PyObject *ma, *mb, *res;
+    MatrixObject *out;
+
+    if (a->cols != b->rows) {
+        PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+        return NULL;
+    }
+
+    ma = evaluate(a, NULL);
+    mb = ma? evaluate(b, NULL) : NULL;
+    if (mb == NULL) {
+        Py_XDECREF(ma);
+        return NULL;
+    }
+
+    out = matrix_new_dtype(a->rows, b->cols, a->dtype);
+    if (out != NULL) {
+        if (a->dtype == PN_F4)
+            mf_mul(FDATA(((MatrixObject *)ma)->data), FDATA(((MatrixObject *)mb)->data),
+                   FDATA(out->data), a->rows, a->cols, b->cols);
+        else
+            m_mul(((MatrixObject *)ma)->data, ((MatrixObject *)mb)->data,
+                  out->data, a->rows, a->cols, b->cols);
+    }
+    Py_DECREF(ma);
+    Py_DECREF(mb);
+    if (out == NULL)
+        return NULL;
+
+    res = (PyObject *)as_expr((PyObject *)out);
+    Py_DECREF(out);
+    return res;
+}
+
+
+
+/*
+ * node for a op b, NotImplemented for unknown operand types
+ */
+static PyObject *
+binary(int op, PyObject *v, PyObject *w)
+{
+    ExprObject *a, *b, *e, *s;
+
+    a = as_expr(v);
+    if (a == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    b = as_expr(w);
+    if (b == NULL) {
+        Py_DECREF(a);
+        if (PyErr_Occurred())
+            return NULL;
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    if (a->op == EX_CONST && b->op == EX_CONST) {
+        e = expr_const((op == EX_ADD)? a->value + b->value :
+                       (op == EX_SUB)? a->value - b->value : a->value * b->value);
+        Py_DECREF(a);
+        Py_DECREF(b);
+        return (PyObject *)e;
+    }
+
+    if (a->kind != EX_SCALAR && b->kind != EX_SCALAR) {
+        if (a->kind != b->kind) {
+            PyErr_SetString(PyExc_TypeError, "can't mix Matrix and Vector operands");
+            goto fail;
+        }
+        if (a->dtype != b->dtype) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            goto fail;
+        }
+        if (op == EX_MUL && a->kind == EX_MATRIX) {
+            e = (ExprObject *)matrix_product(a, b);
+            Py_DECREF(a);
+            Py_DECREF(b);
+            return (PyObject *)e;
+        }
+        if (a->rows != b->rows || a->cols != b->cols) {
+            PyErr_SetString(PyExc_ValueError, "operands have different shapes");
+            goto fail;
+        }
+    }
+
+    s = (a->kind != EX_SCALAR)? a : b;
+    e = expr_node(op, a, b);
+    if (e == NULL)
+        return NULL;
+    e->kind = s->kind;
+    e->rows = s->rows;
+    e->cols = s->cols;
+    e->dtype = s->dtype;
+    return (PyObject *)e;
+
+fail:
+    Py_DECREF(a);
+    Py_DECREF(b);
+    return NULL;
+}
+
+
+
+static PyObject *
+expr_add(PyObject *v, PyObject *w)
+{
+    return binary(EX_ADD, v, w);
+}
+
+static PyObject *
+expr_sub(PyObject *v, PyObject *w)
+{
+    return binary(EX_SUB, v, w);
+}
+
+static PyObject *
+expr_mul(PyObject *v, PyObject *w)
+{
+    return binary(EX_MUL, v, w);
+}
+
+// division by a number only
+static PyObject *
+expr_div(PyObject *v, PyObject *w)
+{
+    PyObject *r, *inv;
+    double d;
+
+    if (!Expr_Check(v) || !(PyFloat_Check(w) || PyInt_Check(w) || PyLong_Check(w))) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    d = PyFloat_AsDouble(w);
+    if (d == -1.0 && PyErr_Occurred())
+        return NULL;
+    // as the eager Matrix and Vector division
+    if (d == 0.0) {
+        PyErr_SetString(PyExc_ZeroDivisionError, "Expr division by zero");
+        return NULL;
+    }
+    inv = PyFloat_FromDouble(1.0 / d);
+    if (inv == NULL)
+        return NULL;
+    r = binary(EX_MUL, v, inv);
+    Py_DECREF(inv);
+    return r;
+}
+
+static PyObject *
+expr_negative(ExprObject *v)
+{
+    ExprObject *e;
+
+    if (v->op == EX_CONST)
+        return (PyObject *)expr_const(-v->value);
+
+    Py_INCREF(v);
+    e = expr_node(EX_NEG, v, NULL);
+    if (e == NULL)
+        return NULL;
+    e->kind = v->kind;
+    e->rows = v->rows;
+    e->cols = v->cols;
+    e->dtype = v->dtype;
+    return (PyObject *)e;
+}
+
+
+
+static PyObject *
+expr_repr(ExprObject *e)
+{
+    return PyString_FromFormat("<lazy %s %dx%d %s, %d nodes>",
+            (e->kind == EX_VECTOR)? "Vector" : (e->kind == EX_MATRIX)? "Matrix" : "scalar",
+            e->rows, e->cols, dtype_name(e->dtype), e->nodes);
+}
+
+
+
+PyMethodDef ExprObject_methods[] = {
+    {"eval", (PyCFunction)expr_eval, METH_VARARGS, "evaluate in one pass, into out if given"},
+    {NULL}  /* Sentinel */
+};
+
+
+
+/*
+ * return attribute value
+ */
+static PyObject *
+expr_getattr(ExprObject *self, char *name)
+{
+    if (!strcmp(name, "shape"))
+        return Py_BuildValue("(ii)", self->rows, self->cols);
+    if (!strcmp(name, "dtype"))
+        return PyString_FromString(dtype_name(self->dtype));
+
+    return Py_FindMethod(ExprObject_methods, (PyObject *)self, name);
+}
+
+
+
+static PyNumberMethods expr_as_number = {
+    (binaryfunc)expr_add,        /*nb_add*/
+    (binaryfunc)expr_sub,        /*nb_subtract*/
+    (binaryfunc)expr_mul,        /*nb_multiply*/
+    (binaryfunc)expr_div,        /*nb_divide*/
+    0,                           /*nb_remainder*/
+    0,                           /*nb_divmod*/
+    0,                           /*nb_power*/
+    (unaryfunc)expr_negative,    /*nb_negative*/
+    0,                           /*nb_positive*/
+    0,                           /*nb_absolute*/
+    0,                           /*nb_nonzero*/
+    0,                           /*nb_invert*/
+    0,                           /*nb_lshift*/
+    0,                           /*nb_rshift*/
+    0,                           /*nb_and*/
+    0,                           /*nb_xor*/
+    0,                           /*nb_or*/
+    0,                           /*nb_coerce*/
+    0,                           /*nb_int*/
+    0,                           /*nb_long*/
+    0,                           /*nb_float*/
+    0,                           /*nb_oct*/
+    0,                           /*nb_hex*/
+    0,                           /*nb_inplace_add*/
+    0,                           /*nb_inplace_subtract*/
+    0,                           /*nb_inplace_multiply*/
+    0,                           /*nb_inplace_divide*/
+    0,                           /*nb_inplace_remainder*/
+    0,                           /*nb_inplace_power*/
+    0,                           /*nb_inplace_lshift*/
+    0,                           /*nb_inplace_rshift*/
+    0,                           /*nb_inplace_and*/
+    0,                           /*nb_inplace_xor*/
+    0,                           /*nb_inplace_or*/
+    0,                           /*nb_floor_divide*/
+    (binaryfunc)expr_div,        /*nb_true_divide*/
+};
+
+
+
+PyTypeObject ExprType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                          /*ob_size*/
+    "pnumeric.Expr",            /*tp_name*/
+    sizeof(ExprObject),         /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)expr_dealloc,   /*tp_dealloc*/
+    0,                          /*tp_print*/
+    (getattrfunc)expr_getattr,  /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    (reprfunc)expr_repr,        /*tp_repr*/
+    &expr_as_number,            /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_CHECKTYPES, /*tp_flags*/
+    "lazy elementwise expression, see pnumeric.lazy()", /* tp_doc */
+};
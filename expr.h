@@ -0,0 +1,65 @@
+/*
+  expr.h
+      Lazy elementwise expressions of Matrix and Vector objects for
+      pnumeric Python module.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifndef __EXPR_H__
+#define __EXPR_H__
+
+#include "Python.h"
+#include "m2/m2.h"
+
+// node types
+#define EX_LEAF  0 // Matrix or Vector operand
+#define EX_CONST 1 // number
+#define EX_ADD   2
+#define EX_SUB   3
+#define EX_MUL   4 // elementwise or by scalar
+#define EX_NEG   5
+
+// kind of the expression result
+#define EX_SCALAR -1
+#define EX_MATRIX  0
+#define EX_VECTOR  1
+
+typedef struct ExprObject {
+    PyObject_HEAD
+    int op;
+    PyObject *leaf;                   // EX_LEAF operand
+    double value;                     // EX_CONST value
+    struct ExprObject *left, *right;  // operands, right is NULL for EX_NEG
+
+    int kind;        // EX_SCALAR, EX_MATRIX or EX_VECTOR
+    int rows, cols;  // shape of the result, a Vector is 1 x length
+    int dtype;       // PN_F8 or PN_F4, all operands have the same
+    int nodes;       // number of nodes in the tree
+} ExprObject;
+
+PyAPI_DATA(PyTypeObject) ExprType;
+
+#define Expr_Check(op) PyObject_TypeCheck(op, &ExprType)
+
+// pnumeric.lazy(x), deferred expression of Matrix or Vector x
+PyAPI_FUNC(PyObject *) expr_lazy(PyObject *self, PyObject *x);
+// evaluate the expression in one pass, into out if given
+PyAPI_FUNC(PyObject *) expr_eval(ExprObject *self, PyObject *args);
+
+#endif /* expr.h */
@@ -0,0 +1,873 @@
+/*
+  kalman.c
+      Stateful Kalman filter objects for pnumeric Python module.
+
+      kf_process() filters a whole record at once. KalmanFilter keeps
+      the model, the state and the workspace of tick_ws() between calls,
+      so samples arriving one at a time are filtered by step() without
+      allocating anything but the returned estimate. KalmanBank keeps
+      many filters of one model and updates all of them per step() by
+      kf_bank_step(), or by kf_ud_bank_step() in the square root form,
+      which also runs in 'f4'.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include "Python.h"
+#include "m2/m2.h"
+#include "pnumeric.h"
+
+
+
+/*
+ * contiguous 'f8' copy of Matrix o of rows x cols, name is used in the
+ * error message
+ */
+static MatrixObject *
+own(PyObject *o, int rows, int cols, const char *name)
+{
+    MatrixObject *m = (MatrixObject *)o;
+
+    if (!Matrix_Check(o)) {
+        PyErr_Format(PyExc_TypeError, "%s must be a Matrix", name);
+        return NULL;
+    }
+    if ((rows >= 0 && m->rows != rows) || (cols >= 0 && m->cols != cols) || m->rows*m->cols == 0) {
+        PyErr_Format(PyExc_ValueError, "%s must be %dx%d matrix", name,
+                     (rows >= 0)? rows : m->rows, (cols >= 0)? cols : m->cols);
+        return NULL;
+    }
+    return (MatrixObject *)PyObject_CallMethod(o, "astype", "s", "f8");
+}
+
+
+
+static void
+kalman_dealloc(KalmanObject *self)
+{
+    Py_XDECREF(self->A);
+    Py_XDECREF(self->B);
+    Py_XDECREF(self->C);
+    Py_XDECREF(self->D);
+    Py_XDECREF(self->Q);
+    Py_XDECREF(self->R);
+    Py_XDECREF(self->x);
+    Py_XDECREF(self->P);
+    m_free(self->buf);
+    kf_workspace_free(self->ws);
+    PyObject_Del(self);
+}
+
+
+
+/*
+ * KalmanFilter(A, B, C, D, Q, R, x0=zeros, P0=eye)
+ * the matrixes are copied, D is pxq as in kf_process(), x0 and P0 are
+ * the initial state
+ */
+PyAPI_FUNC(PyObject *)
+kalman_new(PyTypeObject *type, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"A", "B", "C", "D", "Q", "R", "x0", "P0", NULL};
+    PyObject *A, *B, *C, *D, *Q, *R, *x0 = NULL, *P0 = NULL;
+    KalmanObject *self;
+    int n, p, q;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "OOOOOO|OO", kwlist, &A, &B, &C, &D, &Q, &R, &x0, &P0))
+        return NULL;
+
+    self = PyObject_New(KalmanObject, &KalmanType);
+    if (self == NULL)
+        return NULL;
+    self->A = self->B = self->C = self->D = self->Q = self->R = self->x = self->P = NULL;
+    self->buf = NULL;
+    self->ws = NULL;
+    self->steps = 0;
+
+    if ((self->A = own(A, -1, -1, "A")) == NULL)
+        goto fail;
+    n = self->A->rows;
+    if (self->A->cols != n) {
+        PyErr_SetString(PyExc_ValueError, "A must be a square matrix");
+        goto fail;
+    }
+    if ((self->B = own(B, n, -1, "B")) == NULL)
+        goto fail;
+    p = self->B->cols;
+    if ((self->C = own(C, -1, n, "C")) == NULL)
+        goto fail;
+    q = self->C->rows;
+    if ((self->D = own(D, p, q, "D")) == NULL
+            || (self->Q = own(Q, n, n, "Q")) == NULL
+            || (self->R = own(R, q, q, "R")) == NULL)
+        goto fail;
+
+    if (x0 != NULL && x0 != Py_None) {
+        if ((self->x = own(x0, n, 1, "x0")) == NULL)
+            goto fail;
+    } else if ((self->x = matrix_new(n, 1)) != NULL) {
+        m_set0(self->x->data, n, 1);
+    }
+    if (P0 != NULL && P0 != Py_None) {
+        if ((self->P = own(P0, n, n, "P0")) == NULL)
+            goto fail;
+    } else if ((self->P = matrix_new(n, n)) != NULL) {
+        m_eye(self->P->data, n, n);
+    }
+    if (self->x == NULL || self->P == NULL)
+        goto fail;
+
+    self->n = n;
+    self->p = p;
+    self->q = q;
+    self->ws = kf_workspace_new(n, p, q);
+    self->buf = m_new(1, 2*q + p + n + n*n);
+    if (self->ws == NULL || self->buf == NULL) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    self->y = self->buf;
+    self->yk = self->y + q;
+    self->uk = self->yk + q;
+    self->xs = self->uk + p;
+    self->Ps = self->xs + n;
+    m_set0(self->buf, 1, 2*q + p);
+
+    return (PyObject *)self;
+
+fail:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+
+/*
+ * len items of sample o (Vector, row or column Matrix, number if len
+ * is 1) to dst, None is zeros
+ * return 0 - success, -1 and exception if o doesn't fit
+ */
+static int
+sample(PyObject *o, int len, Float *dst, const char *name)
+{
+    MatrixObject *m;
+    VectorObject *v;
+    Float *data;
+    int i, inc;
+
+    if (o == NULL || o == Py_None) {
+        m_set0(dst, 1, len);
+        return 0;
+    }
+    if (Vector_Check(o)) {
+        v = (VectorObject *)o;
+        if (vector_length(v) == len) {
+            data = vector_dataptr(v);
+            for (i=0; i<len; i++)
+                dst[i] = PN_GET(data, v->dtype, i*v->stride);
+            return 0;
+        }
+    } else if (Matrix_Check(o)) {
+        m = (MatrixObject *)o;
+        if (m->rows*m->cols == len && (m->rows == 1 || m->cols == 1)) {
+            inc = (m->cols == 1)? m->rs : m->cs;
+            for (i=0; i<len; i++)
+                dst[i] = PN_GET(m->data, m->dtype, i*inc);
+            return 0;
+        }
+    } else if (len == 1 && PyNumber_Check(o)) {
+        dst[0] = PyFloat_AsDouble(o);
+        return (dst[0] == -1 && PyErr_Occurred())? -1 : 0;
+    }
+
+    PyErr_Format(PyExc_ValueError, "%s must be a Vector or Matrix of %d items", name, len);
+    return -1;
+}
+
+
+
+/*
+ * one cycle on the sample in yk and uk, the state is updated in place
+ * and left as it was when the cycle fails
+ * return 0 - success, -1 and exception
+ */
+static int
+advance(KalmanObject *self)
+{
+    int n = self->n;
+
+    // R may be changed in place between the steps
+    self->ws->sequential = kf_diagonal(self->R->data, self->q);
+    // tick_ws() updates x and P in place and may fail half way
+    m_copy(self->xs, self->x->data, n, 1);
+    m_copy(self->Ps, self->P->data, n, n);
+    if (tick_ws(self->ws, self->A->data, self->B->data, self->C->data, self->D->data,
+                self->yk, self->uk, self->x->data, self->P->data,
+                self->Q->data, self->R->data,
+                self->x->data, self->y, self->P->data)) {
+        m_copy(self->x->data, self->xs, n, 1);
+        m_copy(self->P->data, self->Ps, n, n);
+        PyErr_SetString(PyExc_ValueError, "innovation covariance is singular");
+        return -1;
+    }
+    self->steps++;
+    return 0;
+}
+
+
+
+/*
+ * step(y, u=None)
+ * filter one sample of outputs y and inputs u (zeros if None)
+ * return copy of the state estimate x (Nx1)
+ */
+PyAPI_FUNC(PyObject *)
+kalman_step(KalmanObject *self, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"y", "u", NULL};
+    PyObject *y, *u = NULL;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|O", kwlist, &y, &u))
+        return NULL;
+    if (sample(y, self->q, self->yk, "y") || sample(u, self->p, self->uk, "u"))
+        return NULL;
+
+    if (advance(self))
+        return NULL;
+    matrix_modified(self->x);
+    matrix_modified(self->P);
+
+    return matrix_copy(self->x);
+}
+
+
+
+/*
+ * step_many(Y, U=None)
+ * filter the samples in the columns of Y (qxlength) and U (pxlength),
+ * like kf_process() but continuing from the current state
+ * return state estimates as columns of a Matrix (Nxlength)
+ */
+PyAPI_FUNC(PyObject *)
+kalman_step_many(KalmanObject *self, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"Y", "U", NULL};
+    MatrixObject *Y, *U = NULL, *X;
+    PyObject *u = NULL;
+    int i, k, n = self->n, p = self->p, q = self->q, length, g = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O!|O", kwlist, &MatrixType, &Y, &u))
+        return NULL;
+    if (Y->rows != q) {
+        PyErr_SetString(PyExc_ValueError, "Y must be qxlength matrix");
+        return NULL;
+    }
+    length = Y->cols;
+    if (u != NULL && u != Py_None) {
+        if (!Matrix_Check(u) || ((MatrixObject *)u)->rows != p || ((MatrixObject *)u)->cols != length) {
+            PyErr_SetString(PyExc_ValueError, "U must be pxlength matrix");
+            return NULL;
+        }
+        U = (MatrixObject *)u;
+    }
+    if ((X = matrix_new(n, length)) == NULL)
+        return NULL;
+    m_set0(self->uk, 1, p);
+    matrix_stream(Y);
+
+    for (k=0; k<length && g == 0; k++) {
+        for (i=0; i<q; i++)
+            self->yk[i] = PN_GET(Y->data, Y->dtype, i*Y->rs + k*Y->cs);
+        if (U != NULL)
+            for (i=0; i<p; i++)
+                self->uk[i] = PN_GET(U->data, U->dtype, i*U->rs + k*U->cs);
+        if ((g = advance(self)) != 0)
+            break;
+        for (i=0; i<n; i++)
+            X->data[i*length + k] = self->x->data[i];
+    }
+    matrix_modified(self->x);
+    matrix_modified(self->P);
+
+    if (g) {
+        // the filter stays after the last good sample
+        Py_DECREF(X);
+        PyErr_Format(PyExc_ValueError, "innovation covariance is singular at sample %d", k);
+        return NULL;
+    }
+    return (PyObject *)X;
+}
+
+
+
+PyMethodDef KalmanObject_methods[] = {
+    {"step", (PyCFunction)kalman_step, METH_VARARGS | METH_KEYWORDS,
+        "filter one sample y (u), return the state estimate"},
+    {"step_many", (PyCFunction)kalman_step_many, METH_VARARGS | METH_KEYWORDS,
+        "filter the columns of Y (U), return the state estimates as columns"},
+    {NULL}  /* Sentinel */
+};
+
+
+
+/*
+ * return attribute value, the model and state matrixes are shared with
+ * the filter
+ */
+static PyObject *
+kalman_getattr(KalmanObject *self, char *name)
+{
+    MatrixObject *m = NULL, *y;
+
+    if (!strcmp(name, "A")) m = self->A;
+    else if (!strcmp(name, "B")) m = self->B;
+    else if (!strcmp(name, "C")) m = self->C;
+    else if (!strcmp(name, "D")) m = self->D;
+    else if (!strcmp(name, "Q")) m = self->Q;
+    else if (!strcmp(name, "R")) m = self->R;
+    else if (!strcmp(name, "x")) m = self->x;
+    else if (!strcmp(name, "P")) m = self->P;
+    if (m != NULL) {
+        Py_INCREF(m);
+        return (PyObject *)m;
+    }
+    if (!strcmp(name, "y")) {
+        if ((y = matrix_new(self->q, 1)) != NULL)
+            m_copy(y->data, self->y, self->q, 1);
+        return (PyObject *)y;
+    }
+    if (!strcmp(name, "steps"))
+        return PyLong_FromUnsignedLong(self->steps);
+    if (!strcmp(name, "shape"))
+        return Py_BuildValue("(iii)", self->n, self->p, self->q);
+
+    return Py_FindMethod(KalmanObject_methods, (PyObject *)self, name);
+}
+
+
+
+PyTypeObject KalmanType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                          /*ob_size*/
+    "pnumeric.KalmanFilter",    /*tp_name*/
+    sizeof(KalmanObject),       /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)kalman_dealloc, /*tp_dealloc*/
+    0,                          /*tp_print*/
+    (getattrfunc)kalman_getattr, /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "Kalman filter keeping its state between samples", /* tp_doc */
+};
+
+
+
+static void
+bank_dealloc(BankObject *self)
+{
+    Py_XDECREF(self->A);
+    Py_XDECREF(self->B);
+    Py_XDECREF(self->C);
+    Py_XDECREF(self->D);
+    Py_XDECREF(self->Q);
+    Py_XDECREF(self->R);
+    Py_XDECREF(self->x);
+    Py_XDECREF(self->P);
+    Py_XDECREF(self->U);
+    Py_XDECREF(self->d);
+    Py_XDECREF(self->y);
+    PyObject_Del(self);
+}
+
+
+
+/*
+ * item i of the data of a bank matrix of either dtype
+ */
+static double
+item(MatrixObject *m, int i)
+{
+    return (m->dtype == PN_F4)? ((float *)m->data)[i] : m->data[i];
+}
+
+static void
+set_item(MatrixObject *m, int i, double v)
+{
+    if (m->dtype == PN_F4)
+        ((float *)m->data)[i] = (float)v;
+    else
+        m->data[i] = v;
+}
+
+
+
+/*
+ * covariance of filter f to P (NxN), or its factors in the UD form
+ * return 0 - success, -1 and exception if P is not positive semidefinite
+ */
+static int
+bank_set_P(BankObject *self, int f, const Float *P)
+{
+    int i, n = self->bank.n, c = self->bank.count;
+    Float *U, *d;
+
+    if (self->form == BANK_P) {
+        for (i=0; i<n*n; i++)
+            self->P->data[i*c + f] = P[i];
+        return 0;
+    }
+    if ((U = m_new(1, n*n + n)) == NULL) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    d = U + n*n;
+    if (kf_ud_factor(P, n, U, d)) {
+        m_free(U);
+        PyErr_SetString(PyExc_ValueError, "P0 must be positive semidefinite");
+        return -1;
+    }
+    for (i=0; i<n*n; i++)
+        set_item(self->U, i*c + f, U[i]);
+    for (i=0; i<n; i++)
+        set_item(self->d, i*c + f, d[i]);
+    m_free(U);
+    return 0;
+}
+
+
+
+/*
+ * state of filter f to x0 (Nx1, None keeps x) and P0 (NxN, None keeps P)
+ * return 0 - success, -1 and exception
+ */
+static int
+bank_set(BankObject *self, int f, PyObject *x0, PyObject *P0)
+{
+    int i, n = self->bank.n, c = self->bank.count, g = 0;
+    MatrixObject *m;
+
+    if (x0 != NULL && x0 != Py_None) {
+        if ((m = own(x0, n, 1, "x0")) == NULL)
+            return -1;
+        for (i=0; i<n; i++)
+            set_item(self->x, i*c + f, m->data[i]);
+        Py_DECREF(m);
+    }
+    if (P0 != NULL && P0 != Py_None) {
+        if ((m = own(P0, n, n, "P0")) == NULL)
+            return -1;
+        g = bank_set_P(self, f, m->data);
+        Py_DECREF(m);
+    }
+    matrix_modified(self->x);
+    if (self->form == BANK_P) {
+        matrix_modified(self->P);
+    } else {
+        matrix_modified(self->U);
+        matrix_modified(self->d);
+    }
+    return g;
+}
+
+
+
+/*
+ * KalmanBank(count, A, B, C, D, Q, R, x0=zeros, P0=eye, dtype='f8', ud=None)
+ * count filters of one model, x0 is the initial state of all of them
+ * (Nx1) or one column per filter (Nxcount), P0 (NxN) is the initial
+ * covariance of all of them. With ud the covariances are kept as UD
+ * factors, which is the only form of an 'f4' bank (ud=None).
+ */
+PyAPI_FUNC(PyObject *)
+bank_new(PyTypeObject *type, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"count", "A", "B", "C", "D", "Q", "R", "x0", "P0", "dtype", "ud", NULL};
+    PyObject *A, *B, *C, *D, *Q, *R, *x0 = NULL, *P0 = NULL, *dtype_o = NULL, *ud_o = NULL;
+    MatrixObject *m = NULL;
+    BankObject *self;
+    int i, f, n, p, q, count, wide = 0, dtype, ud;
+    Float *P;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "iOOOOOO|OOOO", kwlist,
+                                     &count, &A, &B, &C, &D, &Q, &R, &x0, &P0, &dtype_o, &ud_o))
+        return NULL;
+    if (count < 1) {
+        PyErr_SetString(PyExc_ValueError, "count must be positive");
+        return NULL;
+    }
+    if ((dtype = dtype_parse(dtype_o)) < 0)
+        return NULL;
+    ud = (dtype == PN_F4);
+    if (ud_o != NULL && ud_o != Py_None && (ud = PyObject_IsTrue(ud_o)) < 0)
+        return NULL;
+    if (dtype == PN_F4 && !ud) {
+        // P_hat - K*C*P_hat loses definiteness in single precision
+        PyErr_SetString(PyExc_ValueError, "'f4' bank needs the UD form");
+        return NULL;
+    }
+
+    self = PyObject_New(BankObject, &BankType);
+    if (self == NULL)
+        return NULL;
+    self->A = self->B = self->C = self->D = self->Q = self->R = NULL;
+    self->x = self->P = self->U = self->d = self->y = NULL;
+    self->form = !ud? BANK_P : (dtype == PN_F4)? BANK_UDF : BANK_UD;
+
+    if ((self->A = own(A, -1, -1, "A")) == NULL)
+        goto fail;
+    n = self->A->rows;
+    if (self->A->cols != n) {
+        PyErr_SetString(PyExc_ValueError, "A must be a square matrix");
+        goto fail;
+    }
+    if ((self->B = own(B, n, -1, "B")) == NULL)
+        goto fail;
+    p = self->B->cols;
+    if ((self->C = own(C, -1, n, "C")) == NULL)
+        goto fail;
+    q = self->C->rows;
+    if ((self->D = own(D, p, q, "D")) == NULL
+            || (self->Q = own(Q, n, n, "Q")) == NULL
+            || (self->R = own(R, q, q, "R")) == NULL
+            || (self->x = matrix_new_dtype(n, count, dtype)) == NULL
+            || (self->y = matrix_new_dtype(q, count, dtype)) == NULL)
+        goto fail;
+    if (!ud && (self->P = matrix_new(n*n, count)) == NULL)
+        goto fail;
+    if (ud && ((self->U = matrix_new_dtype(n*n, count, dtype)) == NULL
+            || (self->d = matrix_new_dtype(n, count, dtype)) == NULL))
+        goto fail;
+
+    self->bank.n = n;
+    self->bank.p = p;
+    self->bank.q = q;
+    self->bank.count = count;
+    self->bank.A = self->A->data;
+    self->bank.B = self->B->data;
+    self->bank.C = self->C->data;
+    self->bank.D = self->D->data;
+    self->bank.Q = self->Q->data;
+    self->bank.R = self->R->data;
+    self->bank.x = self->x->data;
+    self->bank.P = self->P? self->P->data : NULL;
+    self->bank.y_est = self->y->data;
+    self->ud.n = self->udf.n = n;
+    self->ud.p = self->udf.p = p;
+    self->ud.q = self->udf.q = q;
+    self->ud.count = self->udf.count = count;
+    self->ud.A = self->udf.A = self->A->data;
+    self->ud.B = self->udf.B = self->B->data;
+    self->ud.C = self->udf.C = self->C->data;
+    self->ud.D = self->udf.D = self->D->data;
+    self->ud.Q = self->udf.Q = self->Q->data;
+    self->ud.R = self->udf.R = self->R->data;
+    if (self->form == BANK_UD) {
+        self->ud.x = self->x->data;
+        self->ud.U = self->U->data;
+        self->ud.d = self->d->data;
+        self->ud.y_est = self->y->data;
+    } else if (self->form == BANK_UDF) {
+        self->udf.x = (float *)self->x->data;
+        self->udf.U = (float *)self->U->data;
+        self->udf.d = (float *)self->d->data;
+        self->udf.y_est = (float *)self->y->data;
+    }
+
+    for (i=0; i<q*count; i++)
+        set_item(self->y, i, 0);
+
+    // one column per filter or the same for all
+    if (x0 != NULL && x0 != Py_None) {
+        wide = Matrix_Check(x0) && ((MatrixObject *)x0)->cols == count;
+        if ((m = own(x0, n, wide? count : 1, "x0")) == NULL)
+            goto fail;
+    }
+    for (i=0; i<n; i++)
+        for (f=0; f<count; f++)
+            set_item(self->x, i*count + f, (m == NULL)? 0 : m->data[wide? i*count + f : i]);
+    Py_XDECREF(m);
+    m = NULL;
+
+    if (P0 != NULL && P0 != Py_None) {
+        if ((m = own(P0, n, n, "P0")) == NULL)
+            goto fail;
+        P = m->data;
+    } else if ((P = m_new(n, n)) != NULL) {
+        m_eye(P, n, n);
+    } else {
+        PyErr_NoMemory();
+        goto fail;
+    }
+    for (f=0; f<count && bank_set_P(self, f, P) == 0; f++)
+        ;
+    if (m == NULL)
+        m_free(P);
+    Py_XDECREF(m);
+    if (f < count)
+        goto fail;
+
+    return (PyObject *)self;
+
+fail:
+    Py_DECREF(self);
+    return NULL;
+}
+
+
+
+/*
+ * data of Matrix o of rows x count in dtype of the bank with row stride
+ * *stride, or with row stride count if stride is NULL; a converted copy
+ * to *tmp if needed
+ */
+static Float *
+bank_data(PyObject *o, int dtype, int rows, int count, int *stride, MatrixObject **tmp, const char *name)
+{
+    MatrixObject *m = (MatrixObject *)o;
+
+    if (!Matrix_Check(o) || m->rows != rows || m->cols != count) {
+        PyErr_Format(PyExc_ValueError, "%s must be %dxcount matrix", name, rows);
+        return NULL;
+    }
+    if (m->dtype == dtype && m->cs == 1 && (stride != NULL || m->rs == count || rows == 1)) {
+        if (stride != NULL)
+            *stride = m->rs;
+        return m->data;
+    }
+    if ((*tmp = (MatrixObject *)PyObject_CallMethod(o, "astype", "s", dtype_name(dtype))) == NULL)
+        return NULL;
+    if (stride != NULL)
+        *stride = count;
+    return (*tmp)->data;
+}
+
+
+
+/*
+ * step(Y, U=None)
+ * filter one sample of every filter, column f of Y (qxcount) and U
+ * (pxcount, zeros if None) belongs to filter f
+ * return number of filters which got the time update only, because
+ * their innovation covariance is not positive definite; always 0 in
+ * the UD form, R must be positive definite there
+ */
+PyAPI_FUNC(PyObject *)
+bank_step(BankObject *self, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"Y", "U", NULL};
+    PyObject *y, *u = NULL;
+    MatrixObject *ty = NULL, *tu = NULL;
+    const Float *yd, *ud = NULL;
+    int ys, skipped;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|O", kwlist, &y, &u))
+        return NULL;
+    if ((yd = bank_data(y, self->x->dtype, self->bank.q, self->bank.count, &ys, &ty, "Y")) == NULL)
+        return NULL;
+    if (u != NULL && u != Py_None
+            && (ud = bank_data(u, self->x->dtype, self->bank.p, self->bank.count, NULL, &tu, "U")) == NULL) {
+        Py_XDECREF(ty);
+        return NULL;
+    }
+
+    if (self->form == BANK_P) {
+        self->bank.y = yd;
+        self->bank.ys = ys;
+        self->bank.u = ud;
+        skipped = kf_bank_step(&self->bank);
+        matrix_modified(self->P);
+    } else {
+        if (self->form == BANK_UD) {
+            self->ud.y = yd;
+            self->ud.ys = ys;
+            self->ud.u = ud;
+            skipped = kf_ud_bank_step(&self->ud);
+        } else {
+            self->udf.y = (const float *)yd;
+            self->udf.ys = ys;
+            self->udf.u = (const float *)ud;
+            skipped = kff_ud_bank_step(&self->udf);
+        }
+        matrix_modified(self->U);
+        matrix_modified(self->d);
+    }
+    Py_XDECREF(ty);
+    Py_XDECREF(tu);
+    matrix_modified(self->x);
+    matrix_modified(self->y);
+    if (skipped == -2) {
+        PyErr_SetString(PyExc_ValueError, "Q must be positive semidefinite and R positive definite");
+        return NULL;
+    }
+    if (skipped < 0)
+        return PyErr_NoMemory();
+
+    return PyInt_FromLong(skipped);
+}
+
+
+
+/*
+ * reset(f, x0=None, P0=None)
+ * state of filter f, a new object tracked by the bank
+ */
+static PyObject *
+bank_reset(BankObject *self, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"f", "x0", "P0", NULL};
+    PyObject *x0 = NULL, *P0 = NULL;
+    int f;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "i|OO", kwlist, &f, &x0, &P0))
+        return NULL;
+    if (f < 0 || f >= self->bank.count) {
+        PyErr_SetString(PyExc_IndexError, "filter index out of range");
+        return NULL;
+    }
+    if (bank_set(self, f, x0, P0))
+        return NULL;
+    Py_RETURN_NONE;
+}
+
+
+
+/*
+ * covariance(f)
+ * return copy of the covariance of filter f (NxN), U*diag(d)*U' in the
+ * UD form
+ */
+static PyObject *
+bank_covariance(BankObject *self, PyObject *args)
+{
+    MatrixObject *P;
+    int f, i, j, k, n = self->bank.n, c = self->bank.count;
+    double a, uik, ujk;
+
+    if (!PyArg_ParseTuple(args, "i", &f))
+        return NULL;
+    if (f < 0 || f >= self->bank.count) {
+        PyErr_SetString(PyExc_IndexError, "filter index out of range");
+        return NULL;
+    }
+    if ((P = matrix_new(n, n)) == NULL)
+        return NULL;
+    if (self->form == BANK_P) {
+        for (i=0; i<n*n; i++)
+            P->data[i] = self->P->data[i*c + f];
+        return (PyObject *)P;
+    }
+    // U is unit upper triangular, items k >= max(i, j) of the sum
+    for (i=0; i<n; i++)
+        for (j=i; j<n; j++) {
+            for (k=j, a=0; k<n; k++) {
+                uik = (k == i)? 1 : item(self->U, (i*n + k)*c + f);
+                ujk = (k == j)? 1 : item(self->U, (j*n + k)*c + f);
+                a += uik*item(self->d, k*c + f)*ujk;
+            }
+            P->data[i*n + j] = P->data[j*n + i] = a;
+        }
+    return (PyObject *)P;
+}
+
+
+
+PyMethodDef BankObject_methods[] = {
+    {"step", (PyCFunction)bank_step, METH_VARARGS | METH_KEYWORDS,
+        "filter one sample of every filter, columns of Y (U)"},
+    {"reset", (PyCFunction)bank_reset, METH_VARARGS | METH_KEYWORDS,
+        "state of filter f to x0 and P0"},
+    {"covariance", (PyCFunction)bank_covariance, METH_VARARGS,
+        "copy of the covariance of filter f"},
+    {NULL}  /* Sentinel */
+};
+
+
+
+/*
+ * return attribute value, the model and state matrixes are shared with
+ * the bank
+ */
+static PyObject *
+bank_getattr(BankObject *self, char *name)
+{
+    MatrixObject *m = NULL;
+
+    if (!strcmp(name, "A")) m = self->A;
+    else if (!strcmp(name, "B")) m = self->B;
+    else if (!strcmp(name, "C")) m = self->C;
+    else if (!strcmp(name, "D")) m = self->D;
+    else if (!strcmp(name, "Q")) m = self->Q;
+    else if (!strcmp(name, "R")) m = self->R;
+    else if (!strcmp(name, "x")) m = self->x;
+    else if (!strcmp(name, "P")) m = self->P;
+    else if (!strcmp(name, "U")) m = self->U;
+    else if (!strcmp(name, "d")) m = self->d;
+    else if (!strcmp(name, "y")) m = self->y;
+    if (m != NULL) {
+        Py_INCREF(m);
+        return (PyObject *)m;
+    }
+    if (!strcmp(name, "count"))
+        return PyInt_FromLong(self->bank.count);
+    if (!strcmp(name, "dtype"))
+        return PyString_FromString(dtype_name(self->x->dtype));
+    if (!strcmp(name, "ud"))
+        return PyBool_FromLong(self->form != BANK_P);
+    if (!strcmp(name, "shape"))
+        return Py_BuildValue("(iii)", self->bank.n, self->bank.p, self->bank.q);
+
+    return Py_FindMethod(BankObject_methods, (PyObject *)self, name);
+}
+
+
+
+PyTypeObject BankType = {
+    PyObject_HEAD_INIT(NULL)
+    0,                          /*ob_size*/
+    "pnumeric.KalmanBank",      /*tp_name*/
+    sizeof(BankObject),         /*tp_basicsize*/
+    0,                          /*tp_itemsize*/
+    (destructor)bank_dealloc,   /*tp_dealloc*/
+    0,                          /*tp_print*/
+    (getattrfunc)bank_getattr,  /*tp_getattr*/
+    0,                          /*tp_setattr*/
+    0,                          /*tp_compare*/
+    0,                          /*tp_repr*/
+    0,                          /*tp_as_number*/
+    0,                          /*tp_as_sequence*/
+    0,                          /*tp_as_mapping*/
+    0,                          /*tp_hash */
+    0,                          /*tp_call*/
+    0,                          /*tp_str*/
+    0,                          /*tp_getattro*/
+    0,                          /*tp_setattro*/
+    0,                          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    "many Kalman filters of one model updated together", /* tp_doc */
+};
@@ -0,0 +1,80 @@
+/*
+  kalman.h
+      Stateful Kalman filter objects for pnumeric Python module.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifndef __KALMAN_H__
+#define __KALMAN_H__
+
+#include "Python.h"
+#include "m2/m2.h"
+#include "kf.h"
+
+typedef struct {
+    PyObject_HEAD
+    int n, p, q;           // states, inputs, outputs
+    // model, contiguous 'f8' copies owned by the filter, may be changed
+    // in place between steps
+    MatrixObject *A, *B, *C, *D, *Q, *R;
+    MatrixObject *x, *P;   // state estimate (Nx1) and its covariance (NxN)
+    Float *y;              // output estimate of the last step (q)
+    Float *yk, *uk;        // sample being filtered, in the order of tick_ws()
+    Float *xs, *Ps;        // x and P before the step, restored when it fails
+    Float *buf;            // y, yk, uk, xs and Ps in one block
+    kf_workspace *ws;
+    unsigned long steps;   // samples filtered so far
+} KalmanObject;
+
+typedef struct {
+    PyObject_HEAD
+    kf_bank bank;          // points to the data of the matrixes below
+    kf_ud_bank ud;         // the same for the UD form in 'f8'
+    kff_ud_bank udf;       // and in 'f4'
+    int form;              // BANK_P, BANK_UD or BANK_UDF
+    MatrixObject *A, *B, *C, *D, *Q, *R;  // shared model
+    MatrixObject *x;       // states, one column per filter (Nxcount)
+    MatrixObject *P;       // covariances, row i*N + j is P[i][j] (NxN x count)
+    MatrixObject *U, *d;   // or their factors P = U*diag(d)*U', UD form only
+    MatrixObject *y;       // output estimates of the last step (qxcount)
+} BankObject;
+
+// covariance of the bank filters
+#define BANK_P   0         // P, 'f8'
+#define BANK_UD  1         // U and d, 'f8'
+#define BANK_UDF 2         // U and d, 'f4'
+
+PyAPI_DATA(PyTypeObject) KalmanType;
+PyAPI_DATA(PyTypeObject) BankType;
+
+#define Kalman_Check(op) PyObject_TypeCheck(op, &KalmanType)
+#define Bank_Check(op) PyObject_TypeCheck(op, &BankType)
+
+// KalmanFilter(A, B, C, D, Q, R, x0, P0)
+PyAPI_FUNC(PyObject *) kalman_new(PyTypeObject *type, PyObject *args, PyObject *kws);
+// filter one sample y (u), return the state estimate
+PyAPI_FUNC(PyObject *) kalman_step(KalmanObject *self, PyObject *args, PyObject *kws);
+// filter the columns of Y (U), return the state estimates as columns
+PyAPI_FUNC(PyObject *) kalman_step_many(KalmanObject *self, PyObject *args, PyObject *kws);
+// KalmanBank(count, A, B, C, D, Q, R, x0, P0, dtype, ud)
+PyAPI_FUNC(PyObject *) bank_new(PyTypeObject *type, PyObject *args, PyObject *kws);
+// filter one sample of every filter, columns of Y (U)
+PyAPI_FUNC(PyObject *) bank_step(BankObject *self, PyObject *args, PyObject *kws);
+
+#endif /* kalman.h */
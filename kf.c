@@ -25,7 +25,10 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "m2/m2.h"
+#include "kf.h"
 
 // for stanalone console app
 #include <sys/types.h>
@@ -78,11 +81,149 @@ Example:
 */
 
 /*
- * KF filter algorithm core - one cycle (tick)
+ * Workspace for tick_ws(), all temporaries of one cycle in a single block
  */
+kf_workspace *
+kf_workspace_new(int n, int p, int q)
+{
+    kf_workspace *w;
+    Float *m;
+    int d, pack;
+
+    // panels for the largest product of a cycle, all of them are
+    // within d x d x d
+    d = (n > q)? n : q;
+    d = (d > p)? d : p;
+    pack = m_gemm_pack_size(d, d, d);
+
+    w = (kf_workspace *)malloc(sizeof(kf_workspace));
+    if (w == NULL)
+        return NULL;
+    w->n = n;
+    w->p = p;
+    w->q = q;
+    w->sequential = 0;
+    // x_hat, e | AP | CPest, KT | K2, K2inv | pack
+    m = m_new(1, n + q + n*n + 2*n*q + 2*q*q + pack);
+    if (m == NULL) {
+        free(w);
+        return NULL;
+    }
+    w->buf   = m;
+    w->x_hat = m; m += n;
+    w->e     = m; m += q;
+    w->AP    = m; m += n*n;
+    w->CPest = m; m += q*n;
+    w->KT    = m; m += q*n;
+    w->K2    = m; m += q*q;
+    w->K2inv = m; m += q*q;
+    w->pack  = m;
+
+    return w;
+}
+
+
 void
-tick(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
-        int n, int p, int q,
+kf_workspace_free(kf_workspace *w)
+{
+    if (w == NULL)
+        return;
+    m_free(w->buf);
+    free(w);
+}
+
+
+/*
+ * y = beta*y + alpha*M*v, M is rows x cols, for the small matrix vector
+ * products of the sequential update and process_steady(), where a
+ * m_gemm() call costs more than the arithmetic
+ */
+static void
+gemv(int rows, int cols, Float alpha, const Float *M, const Float *v, Float beta, Float *y)
+{
+    int i, j;
+    Float a;
+
+    for (i=0; i<rows; i++, M+=cols) {
+        for (j=0, a=0; j<cols; j++)
+            a += M[j]*v[j];
+        y[i] = (beta == 0)? alpha*a : beta*y[i] + alpha*a;
+    }
+}
+
+
+/*
+ * R has no nonzero item off the diagonal, the outputs can be absorbed
+ * one at a time
+ */
+int
+kf_diagonal(const Float *R, int q)
+{
+    int i, j;
+
+    for (i=0; i<q; i++)
+        for (j=0; j<q; j++)
+            if (i != j && R[i*q + j] != 0)
+                return 0;
+    return 1;
+}
+
+
+/*
+ * measurement update of tick_ws() for diagonal R, output by output:
+ * ph = P_hat*c', s = c*ph + r, x += ph*e/s, P_hat -= ph*ph'/s for every
+ * row c of C. Only scalar divisions and rank-1 updates, no q x q
+ * factorization. P_est holds P_hat on entry.
+ */
+static int
+update_sequential(kf_workspace *w, Float *C, Float *D, Float *yv_k, Float *u_k,
+                  Float *R, Float *x_est, Float *P_est)
+{
+    int n = w->n, p = w->p, q = w->q, i, j, k;
+    Float *c, *ph = w->KT, s, e;
+
+    m_copy(x_est, w->x_hat, n, 1);
+    for (j=0; j<q; j++) {
+        c = C + j*n;
+        // ph = P_hat*c', rows of P_hat for the nonzero items of c
+        m_set0(ph, 1, n);
+        for (k=0; k<n; k++)
+            if (c[k] != 0)
+                for (i=0; i<n; i++)
+                    ph[i] += c[k]*P_est[k*n + i];
+        for (k=0, s=R[j*q + j]; k<n; k++)
+            s += c[k]*ph[k];
+        if (!(s > 0))
+            return 1;
+        // innovation of output j against the state updated so far
+        gemv(1, p, -1, D + j*p, u_k, 0, &e);
+        gemv(1, n, -1, c, x_est, 1, &e);
+        e += yv_k[j];
+        for (i=0; i<n; i++)
+            x_est[i] += ph[i]*e/s;
+        for (i=0; i<n; i++)
+            for (k=0; k<n; k++)
+                P_est[i*n + k] -= ph[i]*ph[k]/s;
+    }
+    return 0;
+}
+
+
+/*
+ * KF filter algorithm core - one cycle (tick) on a workspace from
+ * kf_workspace_new(n, p, q). The products pack into the panels of the
+ * workspace, a cycle does not allocate unless the innovation
+ * covariance is not positive definite, except when a product is split
+ * over threads (N >= 128 with m_set_num_threads() > 1) or q > 64 (the
+ * blocked Cholesky of K2). x_est and P_est may be the
+ * same arrays as x and P. With w->sequential set R must be diagonal,
+ * the outputs are then absorbed one at a time.
+ * Return: 0 - OK
+ *         1 - innovation covariance is singular
+ */
+int
+tick_ws(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         Float *yv_k/*qx1*/, Float *u_k/*px1*/,
         Float *x   /*Nx1*/, Float *P  /*NxN*/,
         Float *Q  /*NxN*/, Float *R   /*qxq*/,
@@ -90,98 +231,95 @@ tick(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         Float *x_est/*Nx1*/, Float *y_est/*qxN*/, Float *P_est/*NxN*/
         )
 {
-    Float *Ax, *Cx, *Bu, *x_hat, *P_hat, *AT, *AP, *APAT, *CT, *PestCT;
-    Float *CPest, *K, *K1, *K2, *K2inv, *Cxest, *Du, *X1, *X2, *KX2, *se, *KC, *P1;
-    
+    int n = w->n, p = w->p, q = w->q;
+
     // ESTIMATE (TIME UPDATE)
-    // a priori estimate of x
-    Ax = m_new(n, 1);
-    m_mul(A, x, Ax, n, n, 1);
-    Bu = m_new(n, 1);
-    m_mul(B, u_k, Bu, n, p, 1);
-    x_hat = m_new(n, 1);
-    m_add(Ax, Bu, x_hat, n, 1);
-    m_free(Ax);
-    m_free(Bu);
-    // a priori estimate of P
-    AT = m_new(n, n); // transpose(A)
-    m_transpose(A, AT, n, n);
-    AP = m_new(n, n); // A*P
-    m_mul(A, P, AP, n, n, n);
-    APAT = m_new(n, n); // A*P*transpose(A)
-    m_mul(AP, AT, APAT, n, n, n);
-    P_hat = m_new(n, n);
-    m_add(APAT, Q, P_hat, n, n); // P_hat = A*P*transpose(A) + Q
-    m_free(AT);
-    m_free(AP);
-    m_free(APAT);
-    
+    // a priori estimate of x: x_hat = A*x + B*u_k
+    m_gemm_ws(0, 0, n, 1, n, 1, A, x, 0, w->x_hat, w->pack);
+    m_gemm_ws(0, 0, n, 1, p, 1, B, u_k, 1, w->x_hat, w->pack);
+    // a priori estimate of P: P_hat = A*P*transpose(A) + Q, kept in P_est
+    // the symmetric sandwich computes one triangle of the result, P is
+    // read into AP before P_est is written, so they may be the same
+    m_sandwich_ws(n, n, A, P, 0, P_est, w->AP, w->pack);
+    m_add(P_est, Q, P_est, n, n);
+
     // CORRECTION (MEASUREMENT UPDATE)
-    // K1
-    CT = m_new(n, q); // transpose C(q,N)
-    m_transpose(C, CT, q, n);
-    PestCT = m_new(n, q); // P_hat*transpose(C) (Nxq)
-    m_mul(P_hat, CT, PestCT, n, n, q);
-    
-    K1 = m_new(q, q); //  C*P_hat*CT
-    CPest = m_new(q, n); // C*P_hat
-    m_mul(C, P_hat, CPest, q, n, n); // C*P_hat
-    m_mul(CPest, CT, K1, q, n, q);   // K1 = C*P_hat*CT
-    K2 = m_new(q, q);
-    m_add(K1, R, K2, q, q);
-    K2inv = m_new(q, q);
-    m_inversion(K2, K2inv, q);        //          PestCT
-    K = m_new(n, q);                  // Nxq! NxN      Nxq         qxq    qxN qxN    Nxq         qxq
-    m_mul(PestCT, K2inv, K, n, q, q); // K = P_hat*transpose(C) * inverse( C*P_hat*transpose(C) + R )
-    m_free(CT);
-    m_free(PestCT);
-    m_free(CPest);
-    m_free(K1);
-    m_free(K2);
-    m_free(K2inv);
-    
-    Cxest = m_new(q, 1); // C*x_hat
-    m_mul(C, x_hat, Cxest, q, n, 1);
-    Du = m_new(q, 1); // D*u_k
-    m_mul(D, u_k, Du, q, p, 1);
-    
-    X1 = m_new(q, 1); // yv_k - C*x_hat
-    m_sub(yv_k, Cxest, X1, q, 1);
-    X2 = m_new(q, 1); // yv_k - C*x_hat - D*u_k
-    m_sub(X1, Du, X2, q, 1);
-    m_free(X1);
-    m_free(Cxest);
-    
-    KX2 = m_new(n, 1);          //              KX2
-    m_mul(K, X2, KX2, n, 1, 1); // x = x_hat + K*( transpose(yv_k) - C*x_hat - D*u_k )
-    m_free(X2);
-    // set new x
-    m_add(x_hat, KX2, x_est, n, 1);
-    m_free(KX2);
-    
-    // P = (eye(states) - K*C) * P_hat
-    se = m_new(n, n);
-    m_eye(se, n, n);
-    KC = m_new(n, n);
-    P1 = m_new(n, n);
-    m_mul(K, C, KC, n, q, n);
-    m_sub(se, KC, P1, n, n);
-    m_mul(P1, P_hat, P_est, n, n, n);
-    m_free(se);
-    m_free(P1);
-    m_free(x_hat);
-    m_free(P_hat);
-    
+    if (w->sequential) {
+        if (update_sequential(w, C, D, yv_k, u_k, R, x_est, P_est))
+            return 1;
+        gemv(q, p, 1, D, u_k, 0, y_est);
+        gemv(q, n, 1, C, x_est, 1, y_est);
+        return 0;
+    }
+    // K2 = C*P_hat*transpose(C) + R, CPest = C*P_hat
+    m_copy(w->K2, R, q, q);
+    m_sandwich_ws(q, n, C, P_est, 1, w->K2, w->CPest, w->pack);
+    // K = P_hat*transpose(C) * inverse(K2)
+    // P_hat and K2 are symmetric, so transpose(K) = inverse(K2) * C*P_hat
+    // and K2 is positive definite, solve it by Cholesky. Only KT is
+    // kept, K is read from it in transposed order.
+    m_copy(w->KT, w->CPest, q, n);
+    if (m_chol(w->K2, q) == 0) {
+        m_chol_solve(w->K2, q, w->KT, n);
+    } else { // rounding broke positive definiteness, use the general inversion
+        m_copy(w->K2, R, q, q);
+        m_gemm_ws(0, 1, q, q, n, 1, w->CPest, C, 1, w->K2, w->pack);
+        if (m_inversion(w->K2, w->K2inv, q) != 0)
+            return 1;
+        // KT = transpose(inverse(K2)) * C*P_hat
+        m_gemm_ws(1, 0, q, n, q, 1, w->K2inv, w->CPest, 0, w->KT, w->pack);
+    }
+
+    // innovation e = yv_k - C*x_hat - D*u_k
+    m_copy(w->e, yv_k, q, 1);
+    m_gemm_ws(0, 0, q, 1, p, -1, D, u_k, 1, w->e, w->pack);
+    m_gemm_ws(0, 0, q, 1, n, -1, C, w->x_hat, 1, w->e, w->pack);
+
+    // x = x_hat + K*e
+    m_copy(x_est, w->x_hat, n, 1);
+    m_gemm_ws(1, 0, n, 1, q, 1, w->KT, w->e, 1, x_est, w->pack);
+
+    // P = (eye(states) - K*C) * P_hat = P_hat - K*(C*P_hat)
+    m_gemm_ws(1, 0, n, n, q, -1, w->KT, w->CPest, 1, P_est, w->pack);
+
     // y_est = C*x + D*u_k
-    Cx = m_new(q, 1);
-    m_mul(C, x_est, Cx, q, n, 1);
-    m_add(Cx, Du, y_est, q, 1);
-    m_free(Cx);
-    m_free(Du);
+    m_gemm_ws(0, 0, q, 1, p, 1, D, u_k, 0, y_est, w->pack);
+    m_gemm_ws(0, 0, q, 1, n, 1, C, x_est, 1, y_est, w->pack);
+
+    return 0;
 }
 
 
+/*
+ * KF filter algorithm core - one cycle (tick)
+ */
 void
+tick(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        int n, int p, int q,
+        Float *yv_k/*qx1*/, Float *u_k/*px1*/,
+        Float *x   /*Nx1*/, Float *P  /*NxN*/,
+        Float *Q  /*NxN*/, Float *R   /*qxq*/,
+        // outputs
+        Float *x_est/*Nx1*/, Float *y_est/*qxN*/, Float *P_est/*NxN*/
+        )
+{
+    kf_workspace *w;
+
+    w = kf_workspace_new(n, p, q);
+    if (w == NULL)
+        return;
+    w->sequential = kf_diagonal(R, q);
+    tick_ws(w, A, B, C, D, yv_k, u_k, x, P, Q, R, x_est, y_est, P_est);
+    kf_workspace_free(w);
+}
+
+
+/*
+ * Return: 0 - OK
+ *         1 - innovation covariance is singular
+ *         2 - Alloc error
+ */
+int
 process(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         int n,         // number of states N
         int p,         // number of inputs p
@@ -199,19 +337,486 @@ process(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         Float *P_est   // length * (NxN)
         )
 {
-    int i;
+    int g;
+    kf_workspace *w;
+
+    w = kf_workspace_new(n, p, q);
+    if (w == NULL)
+        return 2;
+    w->sequential = kf_diagonal(R, q);
+
+    g = process_ws(w, A, B, C, D, yv, u, x0, P0, Q, R, length, x_est, y_est, P_est, NULL);
+
+    kf_workspace_free(w);
+    return g;
+}
+
+
+/*
+ * process() on a workspace of the caller, the measurement update is
+ * sequential if w->sequential is set. It stops at the first sample
+ * that fails, *done (unless NULL) is the number of samples filtered
+ * before it; the estimates from that sample on are not written.
+ */
+int
+process_ws(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        Float *yv, Float *u, Float *x0, Float *P0, Float *Q, Float *R,
+        int length,
+        Float *x_est, Float *y_est, Float *P_est,
+        int *done)
+{
+    int i, n = w->n, p = w->p, q = w->q, g = 0;
     Float *P, *x;
-    
-    x = m_new(n, 1);
-    P = m_new(n, n);
-    m_copy(x, x0, n, 1);
-    m_copy(P, P0, n, n);
-    
+
+    // every step starts from the estimate of the previous one
+    x = x0;
+    P = P0;
     for (i=0; i<length; i++) {
-        tick(A, B, C, D, n, p, q, yv+i*q, u+i*p, x, P, Q, R, x_est+i*n, y_est+i*q, P_est+i*n*n);
-        m_copy(x, x_est+i*n, n, 1);
-        m_copy(P, P_est+i*n*n, n, n);
+        g = tick_ws(w, A, B, C, D, yv+i*q, u+i*p, x, P, Q, R, x_est+i*n, y_est+i*q, P_est+i*n*n);
+        if (g)
+            break;
+        x = x_est+i*n;
+        P = P_est+i*n*n;
     }
+    if (done)
+        *done = i;
+    return g;
+}
+
+
+/*
+ * Steady state of the filter of time invariant A, C, Q and R: the gain
+ * K (Nxq) and the a posteriori covariance P (NxN) every filter of the
+ * model converges to, from the Riccati equation solved by m_dare().
+ * Return: 0 - OK
+ *         1 - R or the innovation covariance not positive definite
+ *         2 - Alloc error
+ *         3 - Riccati iteration did not converge
+ */
+int
+kf_steady(Float *A /*NxN*/, Float *C/*qxN*/, Float *Q  /*NxN*/, Float *R   /*qxq*/,
+          int n, int q,
+          // outputs
+          Float *K /*Nxq*/, Float *P /*NxN*/
+          )
+{
+    Float *w, *S, *CP, *KT;
+    int g;
+
+    w = m_new(1, q*q + 2*q*n);
+    if (w == NULL)
+        return 2;
+    S = w;
+    CP = S + q*q;
+    KT = CP + q*n;
+
+    // a priori P_hat, then as in tick_ws(): KT = inverse(C*P_hat*C' + R) * C*P_hat
+    g = m_dare(A, C, Q, R, n, q, P);
+    if (g == 0) {
+        m_copy(S, R, q, q);
+        m_sandwich(q, n, C, P, 1, S, CP);
+        m_copy(KT, CP, q, n);
+        if (m_chol(S, q) != 0)
+            g = 1;
+        else if (m_chol_solve(S, q, KT, n) != 0)
+            g = 2;
+    }
+    if (g == 0) {
+        m_transpose(KT, K, q, n);
+        // P = P_hat - K*C*P_hat
+        m_gemm(1, 0, n, n, q, -1, KT, CP, 1, P);
+    }
+
+    m_free(w);
+    return g;
+}
+
+
+/*
+ * process() with the constant gain K (Nxq) of kf_steady(), only the
+ * state is updated, O(N^2) per sample. P (NxN) is written to P_est for
+ * every sample, P_est may be NULL.
+ * Return: 0 - OK
+ *         2 - Alloc error
+ */
+int
+process_steady(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        int n, int p, int q,
+        Float *yv,     // output values (qxlength)
+        Float *u,      // input values  (pxlength)
+        Float *x0,     // initial state (Nx1)
+        Float *K,      // gain (Nxq)
+        Float *P,      // covariance (NxN)
+        int length,
+        // outputs
+        Float *x_est,  // length * (Nx1)
+        Float *y_est,  // length * (qx1)
+        Float *P_est   // length * (NxN), may be NULL
+        )
+{
+    Float *x_hat, *e, *x = x0;
+    int i;
+
+    x_hat = m_new(1, n + q);
+    if (x_hat == NULL)
+        return 2;
+    e = x_hat + n;
+
+    for (i=0; i<length; i++, x=x_est, x_est+=n, y_est+=q, yv+=q, u+=p) {
+        // x_hat = A*x + B*u, e = y - C*x_hat - D*u, x = x_hat + K*e
+        gemv(n, n, 1, A, x, 0, x_hat);
+        gemv(n, p, 1, B, u, 1, x_hat);
+        m_copy(e, yv, q, 1);
+        gemv(q, p, -1, D, u, 1, e);
+        gemv(q, n, -1, C, x_hat, 1, e);
+        m_copy(x_est, x_hat, n, 1);
+        gemv(n, q, 1, K, e, 1, x_est);
+        // y_est = C*x + D*u
+        gemv(q, p, 1, D, u, 0, y_est);
+        gemv(q, n, 1, C, x_est, 1, y_est);
+        if (P_est != NULL)
+            m_copy(P_est + i*n*n, P, n, n);
+    }
+
+    m_free(x_hat);
+    return 0;
+}
+
+
+/*
+ * process() until the covariance stops changing, then the gain of the
+ * last cycle is kept in K (Nxq), *steady is set and the rest of the
+ * samples go through process_steady() with P_est of that cycle. With
+ * *steady set on entry K and P0 are used from the first sample. The
+ * covariance is tracked on the workspace of the caller, sequentially
+ * if w->sequential is set; *done is set as by process_ws().
+ * Return: as process()
+ */
+int
+process_auto(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        Float *yv, Float *u, Float *x0, Float *P0, Float *Q, Float *R,
+        int length,
+        Float *x_est, Float *y_est, Float *P_est,
+        Float *K,      // steady state gain (Nxq)
+        int *steady,   // K is valid
+        int *done
+        )
+{
+    int i, j, g = 0, n = w->n, p = w->p, q = w->q, gain = 1;
+    Float *P = P0, *x = x0, d, h;
+    Float *xi, *yi, *Pi;
+
+    if (done)
+        *done = length;
+    if (*steady)
+        return process_steady(A, B, C, D, n, p, q, yv, u, x0, K, P0, length, x_est, y_est, P_est);
+
+    for (i=0; i<length; i++) {
+        xi = x_est+i*n;
+        yi = y_est+i*q;
+        Pi = P_est+i*n*n;
+        g = tick_ws(w, A, B, C, D, yv+i*q, u+i*p, x, P, Q, R, xi, yi, Pi);
+        if (g) {
+            if (done)
+                *done = i;
+            break;
+        }
+        // converged when the largest change is at the rounding level
+        for (j=0, d=h=0; j<n*n; j++) {
+            if (Fabs(Pi[j] - P[j]) > d)
+                d = Fabs(Pi[j] - P[j]);
+            if (Fabs(Pi[j]) > h)
+                h = Fabs(Pi[j]);
+        }
+        // the sequential update leaves no gain in KT, the converged
+        // cycle is repeated with the joint one for it
+        if (d <= KF_CONVERGED*h && gain && w->sequential) {
+            w->sequential = 0;
+            if (tick_ws(w, A, B, C, D, yv+i*q, u+i*p, x, P, Q, R, xi, yi, Pi)) {
+                // no joint gain (zeros on the diagonal of R), keep tracking
+                gain = 0;
+                w->sequential = 1;
+                tick_ws(w, A, B, C, D, yv+i*q, u+i*p, x, P, Q, R, xi, yi, Pi);
+            }
+            w->sequential = 1;
+        }
+        x = xi;
+        P = Pi;
+        if (d <= KF_CONVERGED*h && gain) {
+            m_transpose(w->KT, K, q, n);
+            *steady = 1;
+            i++;
+            break;
+        }
+    }
+
+    if (g == 0 && *steady && i < length)
+        g = process_steady(A, B, C, D, n, p, q, yv+i*q, u+i*p, x, K, P, length-i,
+                           x_est+i*n, y_est+i*q, P_est+i*n*n);
+    return g;
+}
+
+
+/*
+ * Bank of filters sharing one model, structure of arrays: item k of a
+ * per filter quantity of filter f is at [k*count + f], so the loops of
+ * the kernel run across the filters and vectorize for any n. Blocks of
+ * KB_BLOCK filters are updated at once, bands of whole blocks go to
+ * the m_parallel() threads.
+ */
+#define KB_BLOCK 64
+
+/* scratch items of one block per filter */
+#define KB_SCRATCH(n, q) ((n) + 2*(n)*(n) + 2*(q)*(n) + (q)*(q) + (q) + 1)
+
+typedef struct {
+    kf_bank *b;
+    Float *scratch;      // KB_SCRATCH*KB_BLOCK items per task
+    int band;            // filters per task, whole blocks
+    int skipped[M2_MAX_THREADS];
+} bank_job;
+
+
+/*
+ * one cycle of filters f0 .. f0+w-1, w <= KB_BLOCK
+ * return number of filters with innovation covariance not positive
+ * definite, these get the time update only
+ */
+static int
+bank_block(kf_bank *b, Float *s, int f0, int w)
+{
+    int n = b->n, p = b->p, q = b->q, c = b->count;
+    int i, j, k, l, skipped = 0;
+    const Float *x = b->x + f0, *u = b->u? b->u + f0 : NULL, *y = b->y + f0;
+    Float *P = b->P + f0;
+    // scratch of the block, item k of filter l at [k*KB_BLOCK + l]
+    Float *xh = s, *AP = xh + n*KB_BLOCK, *Ph = AP + n*n*KB_BLOCK;
+    Float *CP = Ph + n*n*KB_BLOCK, *KT = CP + q*n*KB_BLOCK;
+    Float *S = KT + q*n*KB_BLOCK, *e = S + q*q*KB_BLOCK, *bad = e + q*KB_BLOCK;
+    Float a, *t;
+
+#define ITEM(m, k) ((m) + (k)*KB_BLOCK)
+    // x_hat = A*x + B*u
+    for (i=0; i<n; i++) {
+        t = ITEM(xh, i);
+        for (l=0; l<w; l++)
+            t[l] = 0;
+        for (j=0; j<n; j++)
+            if ((a = b->A[i*n + j]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*x[j*c + l];
+        for (k=0; k<p && u; k++)
+            if ((a = b->B[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*u[k*c + l];
+    }
+    // AP = A*P
+    for (i=0; i<n; i++)
+        for (j=0; j<n; j++) {
+            t = ITEM(AP, i*n + j);
+            for (l=0; l<w; l++)
+                t[l] = 0;
+            for (k=0; k<n; k++)
+                if ((a = b->A[i*n + k]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += a*P[(k*n + j)*c + l];
+        }
+    // P_hat = AP*transpose(A) + Q, symmetric
+    for (i=0; i<n; i++)
+        for (j=i; j<n; j++) {
+            t = ITEM(Ph, i*n + j);
+            for (l=0; l<w; l++)
+                t[l] = b->Q[i*n + j];
+            for (k=0; k<n; k++)
+                if ((a = b->A[j*n + k]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += ITEM(AP, i*n + k)[l]*a;
+            if (j != i)
+                memcpy(ITEM(Ph, j*n + i), t, w*sizeof(Float));
+        }
+    // CP = C*P_hat
+    for (i=0; i<q; i++)
+        for (j=0; j<n; j++) {
+            t = ITEM(CP, i*n + j);
+            for (l=0; l<w; l++)
+                t[l] = 0;
+            for (k=0; k<n; k++)
+                if ((a = b->C[i*n + k]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += a*ITEM(Ph, k*n + j)[l];
+        }
+    // S = CP*transpose(C) + R, lower triangle
+    for (i=0; i<q; i++)
+        for (j=0; j<=i; j++) {
+            t = ITEM(S, i*q + j);
+            for (l=0; l<w; l++)
+                t[l] = b->R[i*q + j];
+            for (k=0; k<n; k++)
+                if ((a = b->C[j*n + k]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += ITEM(CP, i*n + k)[l]*a;
+        }
+    // Cholesky factor L of S in place, a filter with S not positive
+    // definite goes on with 1 on the diagonal and is marked bad
+    for (l=0; l<w; l++)
+        bad[l] = 0;
+    for (j=0; j<q; j++) {
+        t = ITEM(S, j*q + j);
+        for (k=0; k<j; k++)
+            for (l=0; l<w; l++)
+                t[l] -= ITEM(S, j*q + k)[l]*ITEM(S, j*q + k)[l];
+        for (l=0; l<w; l++) {
+            if (!(t[l] > 0)) {
+                bad[l] = 1;
+                t[l] = 1;
+            }
+            t[l] = sqrt(t[l]);
+        }
+        for (i=j+1; i<q; i++) {
+            for (k=0; k<j; k++)
+                for (l=0; l<w; l++)
+                    ITEM(S, i*q + j)[l] -= ITEM(S, i*q + k)[l]*ITEM(S, j*q + k)[l];
+            for (l=0; l<w; l++)
+                ITEM(S, i*q + j)[l] /= t[l];
+        }
+    }
+    // KT = inverse(S)*CP, L*Z = CP forward, transpose(L)*KT = Z backward
+    memcpy(KT, CP, q*n*KB_BLOCK*sizeof(Float));
+    for (j=0; j<n; j++) {
+        for (i=0; i<q; i++) {
+            t = ITEM(KT, i*n + j);
+            for (k=0; k<i; k++)
+                for (l=0; l<w; l++)
+                    t[l] -= ITEM(S, i*q + k)[l]*ITEM(KT, k*n + j)[l];
+            for (l=0; l<w; l++)
+                t[l] /= ITEM(S, i*q + i)[l];
+        }
+        for (i=q-1; i>=0; i--) {
+            t = ITEM(KT, i*n + j);
+            for (k=i+1; k<q; k++)
+                for (l=0; l<w; l++)
+                    t[l] -= ITEM(S, k*q + i)[l]*ITEM(KT, k*n + j)[l];
+            for (l=0; l<w; l++)
+                t[l] /= ITEM(S, i*q + i)[l];
+        }
+    }
+    for (l=0; l<w; l++)
+        if (bad[l]) {
+            skipped++;
+            for (k=0; k<q*n; k++)
+                ITEM(KT, k)[l] = 0;
+        }
+
+    // innovation e = y - C*x_hat - D*u
+    for (i=0; i<q; i++) {
+        t = ITEM(e, i);
+        for (l=0; l<w; l++)
+            t[l] = y[i*b->ys + l];
+        for (k=0; k<n; k++)
+            if ((a = b->C[i*n + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] -= a*ITEM(xh, k)[l];
+        for (k=0; k<p && u; k++)
+            if ((a = b->D[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] -= a*u[k*c + l];
+    }
+    // x = x_hat + K*e
+    for (i=0; i<n; i++) {
+        t = b->x + f0 + i*c;
+        for (l=0; l<w; l++)
+            t[l] = ITEM(xh, i)[l];
+        for (k=0; k<q; k++)
+            for (l=0; l<w; l++)
+                t[l] += ITEM(KT, k*n + i)[l]*ITEM(e, k)[l];
+    }
+    // P = P_hat - K*CP, symmetric
+    for (i=0; i<n; i++)
+        for (j=i; j<n; j++) {
+            t = P + (i*n + j)*c;
+            for (l=0; l<w; l++)
+                t[l] = ITEM(Ph, i*n + j)[l];
+            for (k=0; k<q; k++)
+                for (l=0; l<w; l++)
+                    t[l] -= ITEM(KT, k*n + i)[l]*ITEM(CP, k*n + j)[l];
+            if (j != i)
+                memcpy(P + (j*n + i)*c, t, w*sizeof(Float));
+        }
+    // y_est = C*x + D*u
+    for (i=0; i<q && b->y_est; i++) {
+        t = b->y_est + f0 + i*c;
+        for (l=0; l<w; l++)
+            t[l] = 0;
+        for (k=0; k<n; k++)
+            if ((a = b->C[i*n + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*x[k*c + l];
+        for (k=0; k<p && u; k++)
+            if ((a = b->D[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*u[k*c + l];
+    }
+#undef ITEM
+
+    return skipped;
+}
+
+
+static void
+bank_task(void *arg, int id)
+{
+    bank_job *job = (bank_job *)arg;
+    kf_bank *b = job->b;
+    Float *s = job->scratch + (size_t)id*KB_SCRATCH(b->n, b->q)*KB_BLOCK;
+    int f, end = (id + 1)*job->band;
+
+    if (end > b->count)
+        end = b->count;
+    job->skipped[id] = 0;
+    for (f=id*job->band; f<end; f+=KB_BLOCK)
+        job->skipped[id] += bank_block(b, s, f, (end - f < KB_BLOCK)? end - f : KB_BLOCK);
+}
+
+
+/*
+ * KF filter algorithm core - one cycle of all filters of the bank, the
+ * state in b->x and b->P is updated in place. Large banks are split
+ * over m_get_num_threads() threads.
+ * Return: number of filters which got the time update only, because
+ *         their innovation covariance is not positive definite
+ *         -1 - Alloc error
+ */
+int
+kf_bank_step(kf_bank *b)
+{
+    bank_job job;
+    int i, nt, blocks, skipped = 0;
+
+    blocks = (b->count + KB_BLOCK - 1)/KB_BLOCK;
+    nt = m_get_num_threads();
+    // a few blocks are not worth waking the workers
+    if (nt > blocks/4)
+        nt = blocks/4;
+    if (nt < 1)
+        nt = 1;
+    job.b = b;
+    job.band = (blocks + nt - 1)/nt*KB_BLOCK;
+    nt = (b->count + job.band - 1)/job.band;
+    job.scratch = m_new(nt, KB_SCRATCH(b->n, b->q)*KB_BLOCK);
+    if (job.scratch == NULL)
+        return -1;
+
+    if (nt > 1)
+        m_parallel(bank_task, &job, nt);
+    else
+        bank_task(&job, 0);
+
+    m_free(job.scratch);
+    for (i=0; i<nt; i++)
+        skipped += job.skipped[i];
+    return skipped;
 }
 
 /* testing */
@@ -315,6 +920,7 @@ main(int argc, char **argv)
     char buf[BUFLEN];
     int idx=0;
     Float u_k=0., x_est, y_est, P_est;
+    kf_workspace *w;
     
     /* getopt_long stores the option index here. */
     int option_index = 0;
@@ -355,6 +961,12 @@ main(int argc, char **argv)
     DEBUG("Q: %g, R: %g\n", Q, R);
     DEBUG("x: %g, P: %g\n", x, P);
     
+    w = kf_workspace_new(1 /*n*/, 1 /*p*/, 1 /*q*/);
+    if (w == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
     file_in = fdopen(STDIN_FILENO, "rt");
     fread (&c, 1, 1, file_in);
     while (1) {
@@ -366,8 +978,7 @@ main(int argc, char **argv)
             buf[idx] = "\0";
             decoded = atof(buf);
         
-            tick(&A /*NxN*/, &B  /*Nxp*/, &C/*qxN*/, &D/*pxq*/,
-                 1 /*n*/, 1 /*p*/, 1 /*q*/,
+            tick_ws(w, &A /*NxN*/, &B  /*Nxp*/, &C/*qxN*/, &D/*pxq*/,
                  &decoded /*yv_k qx1*/, &u_k /*px1*/,
                  &x   /*Nx1*/, &P  /*NxN*/,
                  &Q  /*NxN*/, &R   /*qxq*/,
@@ -391,6 +1002,7 @@ main(int argc, char **argv)
     }
     
     fclose(file_in);
+    kf_workspace_free(w);
     
     exit(0);
 }
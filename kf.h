@@ -27,6 +27,29 @@
 #ifndef __KF_H__
 #define __KF_H__
 
+/* temporaries of one filter cycle, see kf_workspace_new() */
+typedef struct {
+    int n, p, q;
+    int sequential;            // R is diagonal, update output by output
+    Float *x_hat, *e, *AP, *CPest, *KT, *K2, *K2inv;
+    Float *pack;               // gemm packing panels, see m_gemm_ws()
+    Float *buf;
+} kf_workspace;
+
+kf_workspace *kf_workspace_new(int n, int p, int q);
+void kf_workspace_free(kf_workspace *w);
+// R (qxq) is diagonal, w->sequential may be set
+int kf_diagonal(const Float *R, int q);
+
+int
+tick_ws(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        Float *yv_k/*qx1*/, Float *u_k/*px1*/,
+        Float *x   /*Nx1*/, Float *P  /*NxN*/,
+        Float *Q  /*NxN*/, Float *R   /*qxq*/,
+        // outputs
+        Float *x_est/*Nx1*/, Float *y_est/*qxN*/, Float *P_est/*NxN*/
+);
 
 void
 tick(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
@@ -40,7 +63,7 @@ tick(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
 
 
 
-void
+int
 process(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         int n,         // number of states N
         int p,         // number of inputs p
@@ -58,5 +81,115 @@ process(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
         Float *P_est   // length * (NxN)
 );
 
+int
+process_ws(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        Float *yv, Float *u, Float *x0, Float *P0, Float *Q, Float *R,
+        int length,
+        Float *x_est, Float *y_est, Float *P_est,
+        int *done      // samples filtered, the failing one on error, may be NULL
+);
+
+// relative change of P below which process_auto() keeps the gain
+#define KF_CONVERGED 1e-12
+
+// covariance of kf_process(): propagated every sample, steady state of
+// kf_steady() from the first sample, or process_auto()
+#define KF_TRACK  0
+#define KF_STEADY 1
+#define KF_AUTO   2
+
+int
+kf_steady(Float *A /*NxN*/, Float *C/*qxN*/, Float *Q  /*NxN*/, Float *R   /*qxq*/,
+          int n, int q,
+          // outputs
+          Float *K /*Nxq*/, Float *P /*NxN*/
+);
+
+int
+process_steady(Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        int n, int p, int q,
+        Float *yv, Float *u, Float *x0,
+        Float *K /*Nxq*/, Float *P /*NxN*/,
+        int length,
+        // outputs
+        Float *x_est, Float *y_est, Float *P_est
+);
+
+int
+process_auto(kf_workspace *w,
+        Float *A /*NxN*/, Float *B  /*Nxp*/, Float *C/*qxN*/, Float *D/*pxq*/,
+        Float *yv, Float *u, Float *x0, Float *P0, Float *Q, Float *R,
+        int length,
+        // outputs
+        Float *x_est, Float *y_est, Float *P_est,
+        Float *K /*Nxq*/, int *steady,
+        int *done
+);
+
+
+
+/* filters sharing one model, per filter items in structure of arrays
+   layout, item k of filter f at [k*count + f], see kf_bank_step() */
+typedef struct {
+    int n, p, q;
+    int count;                 // number of filters
+    const Float *A, *B, *C, *D, *Q, *R;  // shared model, as for tick_ws()
+    Float *x;                  // states, N x count
+    Float *P;                  // covariances, NxN x count
+    const Float *y;            // samples, q x count with row stride ys
+    int ys;
+    const Float *u;            // inputs, p x count, NULL for zeros
+    Float *y_est;              // output estimates, q x count, may be NULL
+} kf_bank;
+
+int kf_bank_step(kf_bank *b);
+
+
+/* bank in square root form, P = U*D*U' with U unit upper triangular
+   (item i*N + j, i < j, of the NxN x count U) and D diagonal (N x
+   count d), same layout as kf_bank otherwise. The model is double in
+   both precisions; kfudf.c builds kff_ud_bank_step() for float data,
+   see kf_ud_bank_step() */
+#ifdef M2_SINGLE
+#define kf_ud_bank      kff_ud_bank
+#define kf_ud_bank_step kff_ud_bank_step
+#endif
+
+typedef struct {
+    int n, p, q;
+    int count;
+    const double *A, *B, *C, *D, *Q, *R;
+    Float *x;                  // states, N x count
+    Float *U;                  // unit upper triangular factors, NxN x count
+    Float *d;                  // diagonal factors, N x count
+    const Float *y;            // samples, q x count with row stride ys
+    int ys;
+    const Float *u;            // inputs, p x count, NULL for zeros
+    Float *y_est;              // output estimates, q x count, may be NULL
+} kf_ud_bank;
+
+int kf_ud_bank_step(kf_ud_bank *b);
+
+#ifndef M2_SINGLE
+typedef struct {
+    int n, p, q;
+    int count;
+    const double *A, *B, *C, *D, *Q, *R;
+    float *x;
+    float *U;
+    float *d;
+    const float *y;
+    int ys;
+    const float *u;
+    float *y_est;
+} kff_ud_bank;
+
+int kff_ud_bank_step(kff_ud_bank *b);
+#endif
+
+// symmetric positive semidefinite P (NxN) = U*D*U', 1 if P is not
+int kf_ud_factor(const double *P, int n, double *U, double *d);
+
 
 #endif
@@ -0,0 +1,455 @@
+/*
+  kfud.c
+     Square root (UD) form of the Kalman filter bank. Created as part
+     of pnumeric Python module.
+
+     The covariance of every filter is kept as P = U*D*U', U unit upper
+     triangular and D diagonal. The time update is Thornton's modified
+     weighted Gram-Schmidt orthogonalization of [A*U, Uq] and the
+     measurement update Bierman's, one scalar output at a time. D stays
+     nonnegative and P symmetric by construction, which keeps the filter
+     accurate in single precision where P_hat - K*C*P_hat is not. kfudf.c
+     builds this file again for float data.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "m2/m2.h"
+#include "kf.h"
+
+
+#ifndef M2_SINGLE
+/*
+ * UD factorization of symmetric positive semidefinite P (NxN), the
+ * upper triangle of P is read. A zero item of d has a zero column of U
+ * above the diagonal.
+ * Return: 0 - OK
+ *         1 - P is not positive semidefinite
+ */
+int
+kf_ud_factor(const double *P, int n, double *U, double *d)
+{
+    int i, j, k;
+    double a, h = 0;
+
+    for (i=0; i<n; i++)
+        if (fabs(P[i*n + i]) > h)
+            h = fabs(P[i*n + i]);
+    for (i=0; i<n*n; i++)
+        U[i] = (i % (n + 1) == 0);
+
+    for (j=n-1; j>=0; j--) {
+        a = P[j*n + j];
+        for (k=j+1; k<n; k++)
+            a -= d[k]*U[j*n + k]*U[j*n + k];
+        // negative beyond the rounding of a semidefinite P
+        if (a < -1e-12*h)
+            return 1;
+        d[j] = (a > 0)? a : 0;
+        for (i=0; i<j; i++) {
+            a = P[i*n + j];
+            for (k=j+1; k<n; k++)
+                a -= d[k]*U[i*n + k]*U[j*n + k];
+            U[i*n + j] = (d[j] > 0)? a/d[j] : 0;
+        }
+    }
+    return 0;
+}
+#endif
+
+
+/*
+ * Filters of the bank are updated in blocks of KU_BLOCK, item k of a
+ * block quantity of filter l at [k*KU_BLOCK + l], the loops across the
+ * filters vectorize like in kf_bank_step().
+ */
+#define KU_BLOCK 64
+
+/* scratch items of one block per filter */
+#define KU_SCRATCH(n, q) (2*(n)*(n) + 5*(n) + (q) + 3)
+
+/* model of one step in the precision of the filter */
+typedef struct {
+    Float *A, *B, *C, *D;
+    Float *Cw;           // C whitened by R = L*L' (qxN)
+    Float *L;            // Cholesky factor of R, NULL if R is diagonal
+    Float *r;            // variances of the whitened outputs (q)
+    Float *Uq, *dq;      // Q = Uq*Dq*Uq'
+    Float *buf;
+} ud_model;
+
+typedef struct {
+    kf_ud_bank *b;
+    ud_model *m;
+    Float *scratch;      // KU_SCRATCH*KU_BLOCK items per task
+    int band;            // filters per task, whole blocks
+} ud_job;
+
+
+/*
+ * model of the bank converted for the filters, R factored for scalar
+ * updates and Q = Uq*Dq*Uq'; the factors are computed in double
+ * Return: 0 - OK
+ *        -1 - Alloc error
+ *        -2 - Q is not positive semidefinite or R positive definite
+ */
+static int
+ud_model_new(kf_ud_bank *b, ud_model *m)
+{
+    int n = b->n, p = b->p, q = b->q, i, j, k, diag = 1, g = 0;
+    double *L, *Uq, *dq, *Cw, a;
+
+    m->buf = m_new(1, 2*n*n + n*p + 2*q*n + q*p + q*q + q + n);
+    L = (double *)malloc((q*q + n*n + n + q*n)*sizeof(double));
+    if (m->buf == NULL || L == NULL) {
+        m_free(m->buf);
+        free(L);
+        return -1;
+    }
+    Uq = L + q*q;
+    dq = Uq + n*n;
+    Cw = dq + n;
+    m->A = m->buf;
+    m->B = m->A + n*n;
+    m->C = m->B + n*p;
+    m->D = m->C + q*n;
+    m->Cw = m->D + q*p;
+    m->L = m->Cw + q*n;
+    m->r = m->L + q*q;
+    m->Uq = m->r + q;
+    m->dq = m->Uq + n*n;
+
+    memset(L, 0, q*q*sizeof(double));
+    for (i=0; i<q; i++)
+        for (j=0; j<q; j++)
+            if (i != j && b->R[i*q + j] != 0)
+                diag = 0;
+    if (diag) {
+        // independent outputs are used as they are
+        for (i=0; i<q; i++) {
+            if (!(b->R[i*q + i] > 0))
+                g = -2;
+            m->r[i] = b->R[i*q + i];
+        }
+        memcpy(Cw, b->C, q*n*sizeof(double));
+    } else {
+        // R = L*L', lower triangle of R
+        for (j=0; j<q && g==0; j++) {
+            a = b->R[j*q + j];
+            for (k=0; k<j; k++)
+                a -= L[j*q + k]*L[j*q + k];
+            if (!(a > 0)) {
+                g = -2;
+                break;
+            }
+            L[j*q + j] = sqrt(a);
+            for (i=j+1; i<q; i++) {
+                a = b->R[i*q + j];
+                for (k=0; k<j; k++)
+                    a -= L[i*q + k]*L[j*q + k];
+                L[i*q + j] = a/L[j*q + j];
+            }
+        }
+        // Cw = inverse(L)*C, the whitened outputs have unit variance
+        for (j=0; j<n && g==0; j++)
+            for (i=0; i<q; i++) {
+                a = b->C[i*n + j];
+                for (k=0; k<i; k++)
+                    a -= L[i*q + k]*Cw[k*n + j];
+                Cw[i*n + j] = a/L[i*q + i];
+            }
+        for (i=0; i<q; i++)
+            m->r[i] = 1;
+    }
+    if (g == 0 && kf_ud_factor(b->Q, n, Uq, dq))
+        g = -2;
+
+    for (i=0; i<n*n; i++) {
+        m->A[i] = b->A[i];
+        m->Uq[i] = Uq[i];
+    }
+    for (i=0; i<n*p; i++)
+        m->B[i] = b->B[i];
+    for (i=0; i<q*n; i++) {
+        m->C[i] = b->C[i];
+        m->Cw[i] = Cw[i];
+    }
+    for (i=0; i<q*p; i++)
+        m->D[i] = b->D[i];
+    for (i=0; i<q*q; i++)
+        m->L[i] = L[i];
+    for (i=0; i<n; i++)
+        m->dq[i] = dq[i];
+    if (diag)
+        m->L = NULL;
+
+    free(L);
+    if (g != 0)
+        m_free(m->buf);
+    return g;
+}
+
+
+/*
+ * one cycle of filters f0 .. f0+w-1, w <= KU_BLOCK
+ */
+static void
+ud_block(kf_ud_bank *b, ud_model *m, Float *s, int f0, int w)
+{
+    int n = b->n, p = b->p, q = b->q, c = b->count, n2 = 2*b->n;
+    int i, j, k, l;
+    const Float *u = b->u? b->u + f0 : NULL, *y = b->y + f0;
+    Float *x = b->x + f0, *U = b->U + f0, *d = b->d + f0;
+    // scratch of the block, item k of filter l at [k*KU_BLOCK + l]
+    Float *xh = s, *W = xh + n*KU_BLOCK, *dn = W + n*n2*KU_BLOCK;
+    Float *f = dn + n*KU_BLOCK, *v = f + n*KU_BLOCK, *g = v + n*KU_BLOCK;
+    Float *z = g + n*KU_BLOCK, *al = z + q*KU_BLOCK, *ao = al + KU_BLOCK, *e = ao + KU_BLOCK;
+    Float a, h, *t, *wi, *wj;
+
+#define ITEM(mm, k) ((mm) + (k)*KU_BLOCK)
+    // x_hat = A*x + B*u
+    for (i=0; i<n; i++) {
+        t = ITEM(xh, i);
+        for (l=0; l<w; l++)
+            t[l] = 0;
+        for (j=0; j<n; j++)
+            if ((a = m->A[i*n + j]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*x[j*c + l];
+        for (k=0; k<p && u; k++)
+            if ((a = m->B[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*u[k*c + l];
+    }
+
+    // TIME UPDATE, P_hat = W*diag(d, dq)*W' for W = [A*U, Uq]
+    for (i=0; i<n; i++)
+        for (j=0; j<n; j++) {
+            t = ITEM(W, i*n2 + j);
+            a = m->A[i*n + j];
+            for (l=0; l<w; l++)
+                t[l] = a;
+            for (k=0; k<j; k++)
+                if ((a = m->A[i*n + k]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += a*U[(k*n + j)*c + l];
+            t = ITEM(W, i*n2 + n + j);
+            a = m->Uq[i*n + j];
+            for (l=0; l<w; l++)
+                t[l] = a;
+        }
+    // rows of W from the last, d orthogonal to the rows below them,
+    // the new U and D are the projection coefficients and norms
+    for (j=n-1; j>=0; j--) {
+        t = ITEM(dn, j);
+        for (l=0; l<w; l++)
+            t[l] = 0;
+        for (k=0; k<n; k++) {
+            wj = ITEM(W, j*n2 + k);
+            for (l=0; l<w; l++)
+                t[l] += wj[l]*wj[l]*d[k*c + l];
+        }
+        for (k=0; k<n; k++)
+            if ((a = m->dq[k]) != 0) {
+                wj = ITEM(W, j*n2 + n + k);
+                for (l=0; l<w; l++)
+                    t[l] += a*wj[l]*wj[l];
+            }
+        for (i=0; i<j; i++) {
+            Float *uij = U + (i*n + j)*c;
+            for (l=0; l<w; l++)
+                uij[l] = 0;
+            for (k=0; k<n; k++) {
+                wi = ITEM(W, i*n2 + k);
+                wj = ITEM(W, j*n2 + k);
+                for (l=0; l<w; l++)
+                    uij[l] += wi[l]*d[k*c + l]*wj[l];
+            }
+            for (k=0; k<n; k++)
+                if ((a = m->dq[k]) != 0) {
+                    wi = ITEM(W, i*n2 + n + k);
+                    wj = ITEM(W, j*n2 + n + k);
+                    for (l=0; l<w; l++)
+                        uij[l] += a*wi[l]*wj[l];
+                }
+            for (l=0; l<w; l++)
+                uij[l] = (t[l] > 0)? uij[l]/t[l] : 0;
+            for (k=0; k<n2; k++) {
+                wi = ITEM(W, i*n2 + k);
+                wj = ITEM(W, j*n2 + k);
+                for (l=0; l<w; l++)
+                    wi[l] -= uij[l]*wj[l];
+            }
+        }
+    }
+    for (k=0; k<n; k++)
+        memcpy(d + k*c, ITEM(dn, k), w*sizeof(Float));
+
+    // MEASUREMENT UPDATE, x_hat refined by one output at a time
+    for (i=0; i<n; i++)
+        memcpy(x + i*c, ITEM(xh, i), w*sizeof(Float));
+    // z = inverse(L)*(y - D*u)
+    for (i=0; i<q; i++) {
+        t = ITEM(z, i);
+        for (l=0; l<w; l++)
+            t[l] = y[i*b->ys + l];
+        for (k=0; k<p && u; k++)
+            if ((a = m->D[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] -= a*u[k*c + l];
+        for (k=0; k<i && m->L; k++)
+            if ((a = m->L[i*q + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] -= a*ITEM(z, k)[l];
+        if (m->L != NULL)
+            for (l=0, a=m->L[i*q + i]; l<w; l++)
+                t[l] /= a;
+    }
+    for (j=0; j<q; j++) {
+        const Float *cj = m->Cw + j*n;
+        // innovation e = z_j - c*x
+        for (l=0; l<w; l++)
+            e[l] = ITEM(z, j)[l];
+        for (k=0; k<n; k++)
+            if ((a = cj[k]) != 0)
+                for (l=0; l<w; l++)
+                    e[l] -= a*x[k*c + l];
+        // f = U'*c, v = D*f
+        for (k=0; k<n; k++) {
+            t = ITEM(f, k);
+            for (l=0, a=cj[k]; l<w; l++)
+                t[l] = a;
+            for (i=0; i<k; i++)
+                if ((a = cj[i]) != 0)
+                    for (l=0; l<w; l++)
+                        t[l] += a*U[(i*n + k)*c + l];
+            for (l=0; l<w; l++)
+                ITEM(v, k)[l] = d[k*c + l]*t[l];
+        }
+        // Bierman: alpha accumulates c*P_hat*c' + r, U and D of
+        // P_hat - g*g'/alpha column by column, g = P_hat*c'
+        for (l=0, a=m->r[j]; l<w; l++)
+            al[l] = a;
+        for (k=0; k<n; k++) {
+            Float *fk = ITEM(f, k), *vk = ITEM(v, k), *dk = d + k*c;
+            for (l=0; l<w; l++) {
+                ao[l] = al[l];
+                al[l] += fk[l]*vk[l];
+                dk[l] *= ao[l]/al[l];
+                ITEM(g, k)[l] = vk[l];
+                fk[l] = -fk[l]/ao[l];
+            }
+            for (i=0; i<k; i++) {
+                Float *uik = U + (i*n + k)*c, *gi = ITEM(g, i);
+                for (l=0; l<w; l++) {
+                    h = uik[l];
+                    uik[l] = h + gi[l]*fk[l];
+                    gi[l] += h*vk[l];
+                }
+            }
+        }
+        // x += g*e/alpha
+        for (l=0; l<w; l++)
+            e[l] /= al[l];
+        for (i=0; i<n; i++) {
+            t = x + i*c;
+            for (l=0; l<w; l++)
+                t[l] += ITEM(g, i)[l]*e[l];
+        }
+    }
+
+    // y_est = C*x + D*u
+    for (i=0; i<q && b->y_est; i++) {
+        t = b->y_est + f0 + i*c;
+        for (l=0; l<w; l++)
+            t[l] = 0;
+        for (k=0; k<n; k++)
+            if ((a = m->C[i*n + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*x[k*c + l];
+        for (k=0; k<p && u; k++)
+            if ((a = m->D[i*p + k]) != 0)
+                for (l=0; l<w; l++)
+                    t[l] += a*u[k*c + l];
+    }
+#undef ITEM
+}
+
+
+static void
+ud_task(void *arg, int id)
+{
+    ud_job *job = (ud_job *)arg;
+    kf_ud_bank *b = job->b;
+    Float *s = job->scratch + (size_t)id*KU_SCRATCH(b->n, b->q)*KU_BLOCK;
+    int f, end = (id + 1)*job->band;
+
+    if (end > b->count)
+        end = b->count;
+    for (f=id*job->band; f<end; f+=KU_BLOCK)
+        ud_block(b, job->m, s, f, (end - f < KU_BLOCK)? end - f : KU_BLOCK);
+}
+
+
+/*
+ * KF filter algorithm core in UD form - one cycle of all filters of the
+ * bank, b->x, b->U and b->d are updated in place. Large banks are split
+ * over m_get_num_threads() threads like in kf_bank_step().
+ * Return: 0 - OK
+ *        -1 - Alloc error
+ *        -2 - Q is not positive semidefinite or R positive definite
+ */
+int
+kf_ud_bank_step(kf_ud_bank *b)
+{
+    ud_model m;
+    ud_job job;
+    int nt, blocks, g;
+
+    if ((g = ud_model_new(b, &m)) != 0)
+        return g;
+
+    blocks = (b->count + KU_BLOCK - 1)/KU_BLOCK;
+    nt = m_get_num_threads();
+    // a few blocks are not worth waking the workers
+    if (nt > blocks/4)
+        nt = blocks/4;
+    if (nt < 1)
+        nt = 1;
+    job.b = b;
+    job.m = &m;
+    job.band = (blocks + nt - 1)/nt*KU_BLOCK;
+    nt = (b->count + job.band - 1)/job.band;
+    job.scratch = m_new(nt, KU_SCRATCH(b->n, b->q)*KU_BLOCK);
+    if (job.scratch == NULL) {
+        m_free(m.buf);
+        return -1;
+    }
+
+    if (nt > 1)
+        m_parallel(ud_task, &job, nt);
+    else
+        ud_task(&job, 0);
+
+    m_free(job.scratch);
+    m_free(m.buf);
+    return 0;
+}
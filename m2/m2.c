@@ -48,16 +48,19 @@
 
 */
 
-/* global error indicator */
+/* global error indicator, shared with the single precision build */
+#ifndef M2_SINGLE
 int m_err=0;
+#endif
 
 /*
- allocates a new matrix
+ allocates a new matrix, data are M2_ALIGN bytes aligned
  */
 Float*
 m_new(int rows, int cols)
 {
-  return (Float*)m_Malloc(sizeof(Float)*rows*cols);
+  if(rows<0 || cols<0) return NULL;
+  return (Float*)m_alloc(sizeof(Float)*(size_t)rows*(size_t)cols);
 }
 
 
@@ -66,6 +69,7 @@ m_dup(Float* A, int nrow, int ncol)
 {
   Float *B = m_new(nrow, ncol);
 
+  if(B==NULL) return NULL;
   memcpy(B,A,nrow*ncol*sizeof(Float));
 
   return B;
@@ -81,10 +85,44 @@ m_copy(Float *B, Float *A, int nrow, int ncol)
 }
 
 
+/*
+ copy nrow x ncol elements of A into B, element [i][j] of a matrix
+ with row stride rs and column stride cs is at [i*rs + j*cs].
+ Transposed layouts are copied in square tiles to keep both sides
+ in cache.
+ */
+#define COPY_TILE 32
+
+Float*
+m_copy_strided(Float *B, int rsb, int csb, const Float *A, int rsa, int csa,
+               int nrow, int ncol)
+{
+  int i,j,ii,jj,ie,je;
+
+  if(csa==1 && csb==1){
+    for(i=0; i<nrow; i++)
+      memcpy(B+i*rsb, A+i*rsa, ncol*sizeof(Float));
+    return B;
+  }
+
+  for(ii=0; ii<nrow; ii+=COPY_TILE){
+    ie = (nrow-ii < COPY_TILE)? nrow : ii+COPY_TILE;
+    for(jj=0; jj<ncol; jj+=COPY_TILE){
+      je = (ncol-jj < COPY_TILE)? ncol : jj+COPY_TILE;
+      for(i=ii; i<ie; i++)
+        for(j=jj; j<je; j++)
+          B[i*rsb + j*csb] = A[i*rsa + j*csa];
+    }
+  }
+
+  return B;
+}
+
+
 void
 m_free(Float* m)
 {
-  m_Free(m);
+  m_release(m);
 }
 
 
@@ -105,20 +143,14 @@ m_print(Float *a, int nrow, int ncol, char *s)
 void
 m_set0(Float *m, int rows, int cols)
 {
-  int i;
-
-  for(i=rows*cols; i>0; i--)
-   *m++=0;
+  m_simd.fill(0, m, rows*cols);
 }
 
 
 void
 m_set1(Float *m, int rows, int cols)
 {
-  int i;
-
-  for(i=rows*cols; i>0; i--)
-   *m++=1;
+  m_simd.fill(1, m, rows*cols);
 }
 
 
@@ -196,74 +228,118 @@ m_descramble_rows(Float *A, Float *B, int nrow, int ncol, int *pr)
 
 /*
   LU decomposition
+
+  Blocked right-looking LU with scaled partial pivoting. Columns are
+  factored in panels of LU_NB, the row interchanges of a panel are
+  recorded in a pivot vector and then applied to the columns left and
+  right of it in one pass. The trailing matrix is updated by the GEMM
+  engine.
+
+  On return A holds L (unit diagonal, not stored) and U of the row
+  permuted matrix, pr[i] is the original index of row i and per is the
+  sign of the permutation.
+  Return:  0 - OK
+           1 - Singular (zero pivot replaced by NONZERO)
+           2 - Alloc error
+          -1 - Singular (zero row)
  */
+#define LU_NB 64
+
+static void
+swap_rows(Float *a, Float *b, int n)
+{
+  Float t;
+
+  for(; n>0; n--,a++,b++){ t=*a; *a=*b; *b=t; }
+}
+
+
 int
 m_LU(Float *A, int nrow, int *pr, int *per)
 {
-  Float *p,*q,*sf,*ex;
-  Float *Ar,*Ai,*Ak=NULL;
+  Float *p,*q,*sf,*Ar,*Ac;
   Float a,b;
-  int r,s,i,k=0;
-  int rowsz = nrow*sizeof(Float);
+  int ipiv[LU_NB];
+  int r,c,j,jb,k,s,e,n=nrow;
   int g=0; /* singularity indicator */
 
   *per=1;
 
-  sf=m_new(2,nrow);
+  sf=m_new(1,nrow);
   if(sf==NULL) return 2;
-  ex=sf+nrow;
 
   /* scale factors for implicit pivoting */
-  p=A; q=sf;
+  p=A;
   for(r=0; r<nrow; r++){
     if(pr) pr[r]=r;
     a=0;
-    for(i=0; i<nrow; i++){
+    for(c=0; c<nrow; c++){
       b=Fabs(*p++);
       if(b>a) a=b;
     }
-    if(a==0) return -1; /* hard singularity */
-    *q++=1.0/a;
+    if(a==0){ m_free(sf); return -1; } /* hard singularity */
+    sf[r]=1.0/a;
   }
 
-  /* LU */
-  for(i=0; i<nrow; i++){                       /* columns */
+  for(j=0; j<n; j+=LU_NB){
+    jb=(n-j < LU_NB)? n-j : LU_NB;
+    e=j+jb;
 
-    Ar=A;                                     /* U elements */
-    for(r=0; r<i; r++,Ar+=nrow){
-      a=0; p=Ar; q=A+i;
-      for(s=0; s<r; s++,q+=nrow) a+=*p++**q;
-      *q-=a;
-    }
+    /* factor the panel A[j:n, j:e] */
+    for(c=j; c<e; c++){
+      b=-1; k=c;
+      for(r=c,p=A+c*n+c; r<n; r++,p+=n){
+        a=Fabs(*p)*sf[r];
+        if(a>b){ b=a; k=r; }
+      }
 
+      ipiv[c-j]=k;
+      Ac=A+c*n;
+      if(k!=c){
+        *per=-*per;
+        swap_rows(Ac+j, A+k*n+j, jb);
+        a=sf[k]; sf[k]=sf[c]; sf[c]=a;
+        if(pr){ s=pr[c]; pr[c]=pr[k]; pr[k]=s; }
+      }
 
-    b=0; Ai=Ar;                           /* L elements without 1/Uii */
-    for(/*r=i*/; r<nrow; r++,Ar+=nrow){   /*     + partial pivoting   */
-      a=0; p=Ar; q=A+i;
-      for(s=0; s<i; s++,q+=nrow) a+=*p++**q;
-      *p-=a; a=Fabs(*p)*sf[r];
-      if(a>b){ b=a; k=r; Ak=Ar; }
-    }
+      /* Avoid division by zero to give result even in singular cases */
+      if(Ac[c]==0.0){ Ac[c]=NONZERO; g=1; }
+      a=1.0/Ac[c];
 
-    if(i+1 == nrow) break; /* last col, no more row xchgs and 1/Uii */
+      for(r=c+1,Ar=Ac+n; r<n; r++,Ar+=n){
+        b=(Ar[c]*=a);
+        if(b!=0)
+          for(s=c+1; s<e; s++) Ar[s]-=b*Ac[s];
+      }
+    }
 
-    if(i!=k){ /* interchange the pivoting row */
-      *per=-*per;
-      sf[k]=sf[i];
-      memcpy(ex,Ai,rowsz); memcpy(Ai,Ak,rowsz); memcpy(Ak,ex,rowsz);
-      if(pr){ s=pr[i]; pr[i]=pr[k]; pr[k]=s; }
+    /* apply the panel interchanges outside of it */
+    for(c=j; c<e; c++){
+      k=ipiv[c-j];
+      if(k==c) continue;
+      swap_rows(A+c*n, A+k*n, j);
+      swap_rows(A+c*n+e, A+k*n+e, n-e);
     }
 
-    p=Ai+i;
-    /* Avoid division by zero to give result even in singular cases */
-    if(*p==0.0) { *p=NONZERO; g=1; }
-    a=1.0 / *p;
+    if(e==n) break;
 
-    p+=nrow;
-    for(r=i+1; r<nrow; r++,p+=nrow) *p*=a;
+    /* U12 = inv(L11) * A12 */
+    for(r=j+1,Ar=A+r*n; r<e; r++,Ar+=n)
+      for(s=j,q=A+j*n; s<r; s++,q+=n){
+        b=Ar[s];
+        if(b!=0)
+          for(c=e; c<n; c++) Ar[c]-=b*q[c];
+      }
+
+    /* A22 = A22 - L21 * U12 */
+    if(m_gemm_blocked(n-e, n-e, jb, -1, A+e*n+j, n, A+j*n+e, n,
+                      1, A+e*n+e, n)){
+      m_free(sf);
+      return 2;
+    }
   }
 
-  m_Free(sf);
+  m_free(sf);
 
   return g;
 }
@@ -339,7 +415,109 @@ m_inversion(Float *A, Float *B, int nrow)
   m_descramble_cols(C,B,nrow,nrow,pr); /* Descramble C->B */
 
 error:
-  m_Free(C);
+  m_free(C);
+  m_Free(pr);
+
+  return g;
+}
+
+
+
+/*
+  Solve A X = B for nrhs right hand sides using the factorization
+  from m_LU (LU and pr). B is nrow x nrhs and is overwritten by X.
+
+  Both triangular solves are blocked: a block of TRS_NB rows is solved
+  directly and the rest of B is updated by the GEMM engine.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+#define TRS_NB 64
+
+int
+m_lu_solve(Float *LU, int nrow, int *pr, Float *B, int nrhs)
+{
+  Float *P,*Br,*Bs,*Lr;
+  Float a;
+  int i,ib,r,s,c,n=nrow;
+
+  /* B = P * B */
+  P = m_new(nrow,nrhs);
+  if(P==NULL) return 2;
+  for(r=0; r<n; r++)
+    memcpy(P+r*nrhs, B+pr[r]*nrhs, nrhs*sizeof(Float));
+  m_copy(B,P,nrow,nrhs);
+  m_free(P);
+
+  /* L Y = B, L unit lower */
+  for(i=0; i<n; i+=TRS_NB){
+    ib=(n-i < TRS_NB)? n-i : TRS_NB;
+    for(r=i+1; r<i+ib; r++){
+      Lr=LU+r*n; Br=B+r*nrhs;
+      for(s=i,Bs=B+i*nrhs; s<r; s++,Bs+=nrhs){
+        a=Lr[s];
+        if(a!=0)
+          for(c=0; c<nrhs; c++) Br[c]-=a*Bs[c];
+      }
+    }
+    if(i+ib<n &&
+       m_gemm_blocked(n-i-ib, nrhs, ib, -1, LU+(i+ib)*n+i, n,
+                      B+i*nrhs, nrhs, 1, B+(i+ib)*nrhs, nrhs))
+      return 2;
+  }
+
+  /* U X = Y, U upper, blocks from the bottom */
+  for(i=((n-1)/TRS_NB)*TRS_NB; i>=0; i-=TRS_NB){
+    ib=(n-i < TRS_NB)? n-i : TRS_NB;
+    for(r=i+ib-1; r>=i; r--){
+      Lr=LU+r*n; Br=B+r*nrhs;
+      for(s=r+1,Bs=B+s*nrhs; s<i+ib; s++,Bs+=nrhs){
+        a=Lr[s];
+        if(a!=0)
+          for(c=0; c<nrhs; c++) Br[c]-=a*Bs[c];
+      }
+      a=1.0/Lr[r];
+      for(c=0; c<nrhs; c++) Br[c]*=a;
+    }
+    if(i>0 &&
+       m_gemm_blocked(i, nrhs, ib, -1, LU+i, n,
+                      B+i*nrhs, nrhs, 1, B, nrhs))
+      return 2;
+  }
+
+  return 0;
+}
+
+
+
+/*
+  Solve A X = B, A is nrow x nrow, B and X are nrow x nrhs.
+  X may be the same array as B.
+  Return: 0 - OK
+          1 - Singular
+          2 - Alloc error
+ */
+int
+m_solve(Float *A, Float *B, Float *X, int nrow, int nrhs)
+{
+  int per,*pr;
+  Float *C;
+  int g;
+
+  pr=(int*)malloc(sizeof(int)*nrow);
+  if( pr==NULL ) return 2;
+
+  C = m_dup(A,nrow,nrow);
+  if( C==NULL) { m_Free(pr); return 2;}
+
+  g = m_LU(C, nrow, pr, &per);
+  if(g==0){
+    if(X!=B) m_copy(X,B,nrow,nrhs);
+    g = m_lu_solve(C, nrow, pr, X, nrhs);
+  } else if(g<0)
+    g = 1;
+
+  m_free(C);
   m_Free(pr);
 
   return g;
@@ -347,6 +525,173 @@ error:
 
 
 
+/*
+  Cholesky decomposition A = L * transpose(L)
+
+  A is symmetric positive definite, only its lower triangle is read.
+  On return A holds L and its strict upper triangle is zeroed.
+  Blocked right-looking: a diagonal block of CHOL_NB columns is
+  factored directly, the panel below it is solved row by row and the
+  lower triangle of the trailing matrix is updated by the GEMM engine.
+  Return: 0 - OK
+          1 - Not positive definite
+          2 - Alloc error
+ */
+#define CHOL_NB 64
+
+int
+m_chol(Float *A, int nrow)
+{
+  Float *T,*Ar,*Ac;
+  Float a;
+  int j,jb,e,r,c,s,r0,rb,n=nrow;
+
+  /* only the trailing update needs a buffer */
+  T = NULL;
+  if(n>CHOL_NB){
+    T = m_new(CHOL_NB,nrow);
+    if(T==NULL) return 2;
+  }
+
+  for(j=0; j<n; j+=CHOL_NB){
+    jb=(n-j < CHOL_NB)? n-j : CHOL_NB;
+    e=j+jb;
+
+    /* diagonal block and the panel below it, row by row */
+    for(r=j,Ar=A+j*n; r<n; r++,Ar+=n){
+      for(c=j,Ac=A+j*n; c<e && c<=r; c++,Ac+=n){
+        a=Ar[c];
+        for(s=j; s<c; s++) a-=Ar[s]*Ac[s];
+        if(c<r)
+          Ar[c]=a/Ac[c];
+        else{
+          if(!(a>0)){ m_free(T); return 1; }
+          Ar[c]=sqrt(a);
+        }
+      }
+    }
+
+    if(e==n) break;
+
+    /* A22 = A22 - L21 * transpose(L21), lower triangle by row blocks */
+    for(r=e; r<n; r++)
+      for(c=j; c<e; c++)
+        T[(c-j)*(n-e)+(r-e)]=A[r*n+c];
+    for(r0=e; r0<n; r0+=CHOL_NB){
+      rb=(n-r0 < CHOL_NB)? n-r0 : CHOL_NB;
+      if(m_gemm_blocked(rb, r0+rb-e, jb, -1, A+r0*n+j, n, T, n-e,
+                        1, A+r0*n+e, n)){
+        m_free(T);
+        return 2;
+      }
+    }
+  }
+
+  for(r=0,Ar=A; r<n; r++,Ar+=n)
+    for(c=r+1; c<n; c++) Ar[c]=0;
+
+  m_free(T);
+  return 0;
+}
+
+
+
+/*
+  Solve A X = B using the factor L from m_chol. B is nrow x nrhs and
+  is overwritten by X.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_chol_solve(Float *L, int nrow, Float *B, int nrhs)
+{
+  Float *T,*Br,*Bs,*Lr;
+  Float a;
+  int i,ib,r,s,c,n=nrow;
+
+  /* L Y = B */
+  for(i=0; i<n; i+=TRS_NB){
+    ib=(n-i < TRS_NB)? n-i : TRS_NB;
+    for(r=i; r<i+ib; r++){
+      Lr=L+r*n; Br=B+r*nrhs;
+      for(s=i,Bs=B+i*nrhs; s<r; s++,Bs+=nrhs){
+        a=Lr[s];
+        if(a!=0)
+          for(c=0; c<nrhs; c++) Br[c]-=a*Bs[c];
+      }
+      a=1.0/Lr[r];
+      for(c=0; c<nrhs; c++) Br[c]*=a;
+    }
+    if(i+ib<n &&
+       m_gemm_blocked(n-i-ib, nrhs, ib, -1, L+(i+ib)*n+i, n,
+                      B+i*nrhs, nrhs, 1, B+(i+ib)*nrhs, nrhs))
+      return 2;
+  }
+
+  /* transpose(L) X = Y, blocks from the bottom */
+  T = NULL;
+  if(n>TRS_NB){
+    T = m_new(TRS_NB,nrow);
+    if(T==NULL) return 2;
+  }
+  for(i=((n-1)/TRS_NB)*TRS_NB; i>=0; i-=TRS_NB){
+    ib=(n-i < TRS_NB)? n-i : TRS_NB;
+    for(r=i+ib-1; r>=i; r--){
+      Br=B+r*nrhs;
+      for(s=r+1,Bs=B+s*nrhs; s<i+ib; s++,Bs+=nrhs){
+        a=L[s*n+r];
+        if(a!=0)
+          for(c=0; c<nrhs; c++) Br[c]-=a*Bs[c];
+      }
+      a=1.0/L[r*n+r];
+      for(c=0; c<nrhs; c++) Br[c]*=a;
+    }
+    if(i>0){
+      /* B[0:i] -= transpose(L[i:i+ib, 0:i]) * B[i:i+ib] */
+      for(r=0; r<i; r++)
+        for(c=0; c<ib; c++)
+          T[r*ib+c]=L[(i+c)*n+r];
+      if(m_gemm_blocked(i, nrhs, ib, -1, T, ib,
+                        B+i*nrhs, nrhs, 1, B, nrhs)){
+        m_free(T);
+        return 2;
+      }
+    }
+  }
+
+  m_free(T);
+  return 0;
+}
+
+
+
+/*
+  Inversion of symmetric positive definite matrix, B = inv(A)
+  Return: 0 - OK
+          1 - Not positive definite
+          2 - Alloc error
+ */
+int
+m_chol_inv(Float *A, Float *B, int nrow)
+{
+  Float *L;
+  int g;
+
+  L = m_dup(A,nrow,nrow);
+  if(L==NULL) return 2;
+
+  g = m_chol(L, nrow);
+  if(g==0){
+    m_eye(B, nrow, nrow);
+    g = m_chol_solve(L, nrow, B, nrow);
+  }
+
+  m_free(L);
+  return g;
+}
+
+
+
 /*
   Transpose matrix A into B
  */
@@ -413,6 +758,7 @@ m_det(Float *A, int nrow)
   Float *B, a;
 
   B = m_dup(A,nrow,nrow);
+  if(B==NULL) return 0;
 
   s=m_LU(B, nrow, NULL, &per);
 
@@ -422,7 +768,7 @@ m_det(Float *A, int nrow)
     a=m_prod(B,nrow);
     a=(per==1)? a:-a;
   }
-  m_Free(B);
+  m_free(B);
 
   return a;
  }
@@ -434,11 +780,7 @@ m_det(Float *A, int nrow)
 void
 m_add(Float *A, Float *B, Float *C, int nrow, int ncol)
 {
-  int i;
-
-  for(i=nrow*ncol; i>0; i--)
-    *C++=*A+++*B++;
-
+  m_simd.add(A, B, C, nrow*ncol);
 }
 
 /*
@@ -447,11 +789,7 @@ m_add(Float *A, Float *B, Float *C, int nrow, int ncol)
 void
 m_add_scalar(Float a, Float *A, Float *B, int nrow, int ncol)
 {
-  int i;
-
-  for(i=nrow*ncol; i>0; i--)
-    *B++=a+*A++;
-
+  m_simd.adds(a, A, B, nrow*ncol);
 }
 
 /*
@@ -460,11 +798,17 @@ m_add_scalar(Float a, Float *A, Float *B, int nrow, int ncol)
 void
 m_sub(Float *A, Float *B, Float *C, int nrow, int ncol)
 {
-  int i;
+  m_simd.sub(A, B, C, nrow*ncol);
+}
 
-  for(i=nrow*ncol; i>0; i--)
-    *C++=*A++-*B++;
 
+/*
+ C = A .* B  (elementwise)
+ */
+void
+m_emul(Float *A, Float *B, Float *C, int nrow, int ncol)
+{
+  m_simd.mul(A, B, C, nrow*ncol);
 }
 
 
@@ -474,11 +818,7 @@ m_sub(Float *A, Float *B, Float *C, int nrow, int ncol)
 void
 m_scale(Float a, Float *A, int nrow, int ncol)
 {
-  int i;
-
-  for(i=nrow*ncol; i>0; i--)
-    *A++*=a;
-
+  m_simd.scale(a, A, nrow*ncol);
 }
 
 
@@ -490,6 +830,8 @@ m_scale(Float a, Float *A, int nrow, int ncol)
  ncolC = ncolB
  nrowB = ncolA
 
+ Uses the cache blocked engine (m2_gemm.c), the plain loop below
+ is the fallback when the packing buffers can't be allocated.
  */
 void
 m_mul(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB)
@@ -498,6 +840,9 @@ m_mul(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB)
   Float a;
   int i,j,k;
 
+  if(m_gemm_blocked(nrowA, ncolB, ncolA, 1, A, ncolA, B, ncolB, 0, C, ncolB)==0)
+    return;
+
   p = C; s = A;
   for(i=nrowA; i>0; i--){
     t = B;
@@ -514,3 +859,136 @@ m_mul(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB)
   }
 
 }
+
+
+/*
+ C = transpose(A) * B, A is nrowA x ncolA, B is nrowA x ncolB,
+ C is ncolA x ncolB. A is read in transposed order, no copy is made.
+ */
+void
+m_mul_tn(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB)
+{
+  Float *p,*q,*r;
+  Float a;
+  int i,j,k;
+
+  if(m_gemm_strided(ncolA, ncolB, nrowA, 1, A, 1, ncolA, B, ncolB, 1, 0, C, ncolB)==0)
+    return;
+
+  p = C;
+  for(i=0; i<ncolA; i++)
+    for(j=0; j<ncolB; j++){
+      q = A+i; r = B+j; a = 0;
+      for(k=nrowA; k>0; k--,q+=ncolA,r+=ncolB)
+        a+=*q**r;
+      *p++=a;
+    }
+}
+
+
+/*
+ C = A * transpose(B), A is nrowA x ncolA, B is nrowB x ncolA,
+ C is nrowA x nrowB. B is read in transposed order, no copy is made.
+ */
+void
+m_mul_nt(Float *A, Float *B, Float *C, int nrowA, int ncolA, int nrowB)
+{
+  Float *p,*q,*r;
+  Float a;
+  int i,j,k;
+
+  if(m_gemm_strided(nrowA, nrowB, ncolA, 1, A, ncolA, 1, B, 1, ncolA, 0, C, nrowB)==0)
+    return;
+
+  p = C;
+  for(i=0; i<nrowA; i++)
+    for(j=0; j<nrowB; j++){
+      q = A+i*ncolA; r = B+j*ncolA; a = 0;
+      for(k=ncolA; k>0; k--)
+        a+=*q++**r++;
+      *p++=a;
+    }
+}
+
+
+/*
+  Stabilizing solution X (nrow x nrow) of the discrete algebraic Riccati
+  equation of the Kalman filter
+
+    X = A X A' - A X C' (C X C' + R)^-1 C X A' + Q
+
+  A is nrow x nrow, C is q x nrow, Q and R are symmetric, R is positive
+  definite. X is the a priori covariance the filter converges to.
+
+  Structured doubling: with A0 = A', G0 = C' R^-1 C, H0 = Q and
+  W = I + Gk Hk
+
+    A(k+1) = Ak W^-1 Ak
+    G(k+1) = Gk + Ak W^-1 Gk Ak'
+    H(k+1) = Hk + Ak' Hk W^-1 Ak
+
+  Hk converges quadratically to X, each step doubles the number of
+  filter cycles it stands for.
+  Return: 0 - OK
+          1 - R not positive definite or I + G H singular
+          2 - Alloc error
+          3 - no convergence, (A, C) not detectable
+ */
+#define DARE_ITER 64
+
+int
+m_dare(Float *A, Float *C, Float *Q, Float *R, int nrow, int q, Float *X)
+{
+  int n=nrow, nn=nrow*nrow, i, j, it, per, g=3, *pr;
+  Float *w, *Ak, *G, *W, *Y1, *Y2, *T, *dH, *RC, *t;
+  Float d, h;
+
+  w = m_new(1, 7*nn + q*q + q*n);
+  pr = (int*)malloc(sizeof(int)*n);
+  if(w==NULL || pr==NULL){ m_free(w); m_Free(pr); return 2; }
+  Ak=w; G=Ak+nn; W=G+nn; Y1=W+nn; Y2=Y1+nn; T=Y2+nn; dH=T+nn; RC=dH+nn;
+
+  /* G = C' R^-1 C, R factored in the front of RC, R^-1 C behind it */
+  m_copy(RC, R, q, q);
+  if(m_chol(RC, q)){ g=1; goto out; }
+  m_copy(RC+q*q, C, q, n);
+  if(m_chol_solve(RC, q, RC+q*q, n)){ g=2; goto out; }
+  if(m_gemm(1, 0, n, n, q, 1, C, RC+q*q, 0, G)){ g=2; goto out; }
+  m_transpose(A, Ak, n, n);
+  m_copy(X, Q, n, n);
+
+  for(it=0; it<DARE_ITER; it++){
+    /* W = I + G H, Y1 = W^-1 Ak, Y2 = W^-1 G */
+    m_eye(W, n, n);
+    if(m_gemm(0, 0, n, n, n, 1, G, X, 1, W)){ g=2; break; }
+    if(m_LU(W, n, pr, &per)){ g=1; break; }
+    m_copy(Y1, Ak, n, n);
+    m_copy(Y2, G, n, n);
+    if(m_lu_solve(W, n, pr, Y1, n) || m_lu_solve(W, n, pr, Y2, n)){ g=2; break; }
+
+    /* dH = Ak' H Y1, G += Ak Y2 Ak', Ak = Ak Y1 */
+    if(m_gemm(0, 0, n, n, n, 1, X, Y1, 0, T) ||
+       m_gemm(1, 0, n, n, n, 1, Ak, T, 0, dH) ||
+       m_gemm(0, 0, n, n, n, 1, Ak, Y2, 0, T) ||
+       m_gemm(0, 1, n, n, n, 1, T, Ak, 1, G) ||
+       m_gemm(0, 0, n, n, n, 1, Ak, Y1, 0, T)){ g=2; break; }
+    t=Ak; Ak=T; T=t;
+
+    /* H += dH, kept symmetric against rounding */
+    d=h=0;
+    for(i=0; i<n; i++)
+      for(j=i; j<n; j++){
+        X[i*n+j] += 0.5*(dH[i*n+j] + dH[j*n+i]);
+        X[j*n+i] = X[i*n+j];
+        G[i*n+j] = G[j*n+i] = 0.5*(G[i*n+j] + G[j*n+i]);
+        if(Fabs(dH[i*n+j]) > d) d=Fabs(dH[i*n+j]);
+        if(Fabs(X[i*n+j]) > h) h=Fabs(X[i*n+j]);
+      }
+    if(d <= 10*EPS*h){ g=0; break; }
+  }
+
+out:
+  m_free(w);
+  m_Free(pr);
+  return g;
+}
@@ -26,7 +26,9 @@
 #ifndef __M2_H__
 #define __M2_H__
 
-#if 1
+#include <stddef.h>
+
+#ifndef M2_SINGLE
 
 #define Float double
 #define Fabs  fabs
@@ -35,10 +37,12 @@
 
 #else
 
+#include "m2_single.h"
+
 #define Float float
 #define Fabs  fabsf
 #define EPS     1e-7
-#deifne NONZERO 1e-16
+#define NONZERO 1e-30
 
 #endif
 
@@ -47,6 +51,8 @@ extern int m_err;
 Float* m_new(int rows, int cols);
 Float* m_dup(Float* A, int nrow, int ncol);
 Float* m_copy(Float *B, Float *A, int nrow, int ncol);
+Float* m_copy_strided(Float *B, int rsb, int csb, const Float *A, int rsa, int csa,
+                      int nrow, int ncol);
 void   m_free(Float* m);
 void   m_print(Float *a, int nrow, int ncol, char *s);
 void   m_set0(Float *m, int rows, int cols);
@@ -56,6 +62,11 @@ void   m_descramble_rows(Float *A, Float *B, int nrow, int ncol, int *pr);
 void   m_descramble_cols(Float *A, Float *B, int nrow, int ncol, int *pc);
 int    m_LU(Float *A, int nrow, int *pr, int *per);
 int    m_inversion(Float *A, Float *B, int nrow);
+int    m_lu_solve(Float *LU, int nrow, int *pr, Float *B, int nrhs);
+int    m_solve(Float *A, Float *B, Float *X, int nrow, int nrhs);
+int    m_chol(Float *A, int nrow);
+int    m_chol_solve(Float *L, int nrow, Float *B, int nrhs);
+int    m_chol_inv(Float *A, Float *B, int nrow);
 void   m_transpose(Float *A, Float *B, int nrow, int ncol);
 Float  m_tr(Float *A, int nrow);
 Float  m_prod(Float *A, int nrow);
@@ -63,9 +74,135 @@ Float  m_det(Float *A, int nrow);
 void   m_add(Float *A, Float *B, Float *C, int nrow, int ncol);
 void   m_add_scalar(Float a, Float *A, Float *B, int nrow, int ncol);
 void   m_sub(Float *A, Float *B, Float *C, int nrow, int ncol);
+void   m_emul(Float *A, Float *B, Float *C, int nrow, int ncol);
 void   m_scale(Float a, Float *A, int nrow, int ncol);
 void   m_mul(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB);
+void   m_mul_tn(Float *A, Float *B, Float *C, int nrowA, int ncolA, int ncolB);
+void   m_mul_nt(Float *A, Float *B, Float *C, int nrowA, int ncolA, int nrowB);
+int    m_dare(Float *A, Float *C, Float *Q, Float *R, int nrow, int q, Float *X);
+
+/* m2_simd.c - elementwise kernels over n consecutive elements */
+struct m_simd_ops {
+  const char *name;
+  void (*add)(const Float *A, const Float *B, Float *C, int n);
+  void (*sub)(const Float *A, const Float *B, Float *C, int n);
+  void (*mul)(const Float *A, const Float *B, Float *C, int n);
+  void (*scale)(Float a, Float *A, int n);
+  void (*adds)(Float a, const Float *A, Float *B, int n);
+  void (*fill)(Float a, Float *A, int n);
+};
+
+extern struct m_simd_ops m_simd;
+
+void   m_simd_init(void);
+
+/* m2_thread.c */
+#define M2_MAX_THREADS 64
+
+int    m_set_num_threads(int n);
+int    m_get_num_threads(void);
+void   m_parallel(void (*fn)(void *arg, int i), void *arg, int ntasks);
+
+/* m2_alloc.c */
+#define M2_ALIGN 64
+
+struct m_allocator {
+  void *(*alloc)(size_t size, void *ctx);
+  void  (*free)(void *p, size_t size, void *ctx);
+  void  *ctx;
+};
+
+void  *m_alloc(size_t size);
+void   m_release(void *p);
+void   m_set_allocator(const struct m_allocator *a);
+void   m_alloc_trim(void);
+
+/* m2_gemm.c */
+int    m_gemm(int ta, int tb, int m, int n, int k, Float alpha,
+              const Float *A, const Float *B, Float beta, Float *C);
+int    m_gemm_blocked(int m, int n, int k, Float alpha, const Float *A, int lda,
+                      const Float *B, int ldb, Float beta, Float *C, int ldc);
+int    m_gemm_strided(int m, int n, int k, Float alpha,
+                      const Float *A, int rsa, int csa,
+                      const Float *B, int rsb, int csb,
+                      Float beta, Float *C, int ldc);
+int    m_sandwich(int n, int k, const Float *A, const Float *P, Float beta,
+                  Float *S, Float *W);
+int    m_gemm_pack_size(int m, int n, int k);
+int    m_gemm_ws(int ta, int tb, int m, int n, int k, Float alpha,
+                 const Float *A, const Float *B, Float beta, Float *C, Float *pack);
+int    m_sandwich_ws(int n, int k, const Float *A, const Float *P, Float beta,
+                     Float *S, Float *W, Float *pack);
 
 void m_eye(Float *A, int nrow, int ncol);
 
+#ifndef M2_SINGLE
+/*
+ single precision versions of the Float routines, built from the same
+ sources with M2_SINGLE defined (see m2_single.h)
+ */
+float* mf_new(int rows, int cols);
+float* mf_dup(float* A, int nrow, int ncol);
+float* mf_copy(float *B, float *A, int nrow, int ncol);
+float* mf_copy_strided(float *B, int rsb, int csb, const float *A, int rsa, int csa,
+                       int nrow, int ncol);
+void   mf_free(float* m);
+void   mf_print(float *a, int nrow, int ncol, char *s);
+void   mf_set0(float *m, int rows, int cols);
+void   mf_set1(float *m, int rows, int cols);
+void   mf_descramble(float *A, float *B, int nrow, int ncol, int *pr, int *pc);
+void   mf_descramble_rows(float *A, float *B, int nrow, int ncol, int *pr);
+void   mf_descramble_cols(float *A, float *B, int nrow, int ncol, int *pc);
+int    mf_LU(float *A, int nrow, int *pr, int *per);
+int    mf_inversion(float *A, float *B, int nrow);
+int    mf_lu_solve(float *LU, int nrow, int *pr, float *B, int nrhs);
+int    mf_solve(float *A, float *B, float *X, int nrow, int nrhs);
+int    mf_chol(float *A, int nrow);
+int    mf_chol_solve(float *L, int nrow, float *B, int nrhs);
+int    mf_chol_inv(float *A, float *B, int nrow);
+void   mf_transpose(float *A, float *B, int nrow, int ncol);
+float  mf_tr(float *A, int nrow);
+float  mf_prod(float *A, int nrow);
+float  mf_det(float *A, int nrow);
+void   mf_add(float *A, float *B, float *C, int nrow, int ncol);
+void   mf_add_scalar(float a, float *A, float *B, int nrow, int ncol);
+void   mf_sub(float *A, float *B, float *C, int nrow, int ncol);
+void   mf_emul(float *A, float *B, float *C, int nrow, int ncol);
+void   mf_scale(float a, float *A, int nrow, int ncol);
+void   mf_mul(float *A, float *B, float *C, int nrowA, int ncolA, int ncolB);
+void   mf_mul_tn(float *A, float *B, float *C, int nrowA, int ncolA, int ncolB);
+void   mf_mul_nt(float *A, float *B, float *C, int nrowA, int ncolA, int nrowB);
+int    mf_dare(float *A, float *C, float *Q, float *R, int nrow, int q, float *X);
+void   mf_eye(float *A, int nrow, int ncol);
+
+struct mf_simd_ops {
+  const char *name;
+  void (*add)(const float *A, const float *B, float *C, int n);
+  void (*sub)(const float *A, const float *B, float *C, int n);
+  void (*mul)(const float *A, const float *B, float *C, int n);
+  void (*scale)(float a, float *A, int n);
+  void (*adds)(float a, const float *A, float *B, int n);
+  void (*fill)(float a, float *A, int n);
+};
+
+extern struct mf_simd_ops mf_simd;
+
+void   mf_simd_init(void);
+int    mf_gemm(int ta, int tb, int m, int n, int k, float alpha,
+               const float *A, const float *B, float beta, float *C);
+int    mf_gemm_blocked(int m, int n, int k, float alpha, const float *A, int lda,
+                       const float *B, int ldb, float beta, float *C, int ldc);
+int    mf_gemm_strided(int m, int n, int k, float alpha,
+                       const float *A, int rsa, int csa,
+                       const float *B, int rsb, int csb,
+                       float beta, float *C, int ldc);
+int    mf_sandwich(int n, int k, const float *A, const float *P, float beta,
+                   float *S, float *W);
+int    mf_gemm_pack_size(int m, int n, int k);
+int    mf_gemm_ws(int ta, int tb, int m, int n, int k, float alpha,
+                  const float *A, const float *B, float beta, float *C, float *pack);
+int    mf_sandwich_ws(int n, int k, const float *A, const float *P, float beta,
+                      float *S, float *W, float *pack);
+#endif
+
 #endif
@@ -0,0 +1,295 @@
+/*
+  m2_alloc.c
+      Matrix data allocator for m2.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "m2.h"
+
+/*
+ Every block returned by m_alloc() is M2_ALIGN (64) bytes aligned and
+ preceded by a header of the same size that tells m_free() where the
+ block came from:
+
+   small  - up to POOL_MAX bytes, rounded up to a power of two size
+            class; freed blocks are kept on a per class free list and
+            reused (at most POOL_KEEP bytes per class)
+   huge   - HUGE_MIN bytes and more, mmap()ed directly and advised
+            to be backed by transparent huge pages
+   system - everything else, posix_memalign()
+   hook   - any size while user hooks are installed (m_set_allocator),
+            M2_ALIGN bytes more are asked for to align the block in
+            whatever the hook returns
+
+ Define M2_SYSTEM_ALLOC to bypass all of it and use plain malloc.
+*/
+
+#define POOL_MIN_SHIFT 6                      /* 64 B */
+#define POOL_MAX_SHIFT 16                     /* 64 kB */
+#define POOL_MAX       (1 << POOL_MAX_SHIFT)
+#define POOL_CLASSES   (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_KEEP      (1024*1024)
+#define HUGE_MIN       (2*1024*1024)
+
+#if !defined(M2_SYSTEM_ALLOC) && defined(__unix__)
+#include <sys/mman.h>
+#define M2_HAVE_MMAP
+#endif
+
+#ifndef M2_NO_THREADS
+#include <pthread.h>
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  once = PTHREAD_ONCE_INIT;
+#define LOCK()   pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+enum { BLOCK_SMALL, BLOCK_HUGE, BLOCK_SYSTEM, BLOCK_HOOK };
+
+struct block {
+  void *base;             /* what the backing allocator returned */
+  size_t size;            /* size of the whole allocation at base */
+  int kind;
+  int cls;                /* size class of small blocks */
+  void (*free)(void *p, size_t size, void *ctx);
+  void *ctx;
+  struct block *next;     /* free list link */
+};
+
+#define HEADER M2_ALIGN
+
+static struct block *pool[POOL_CLASSES];
+static size_t pool_bytes[POOL_CLASSES];
+
+static struct m_allocator hooks;   /* alloc is NULL without hooks */
+
+
+#ifndef M2_NO_THREADS
+static void
+atfork_child(void)
+{
+  pthread_mutex_init(&lock, NULL);
+}
+
+static void
+init_once(void)
+{
+  pthread_atfork(NULL, NULL, atfork_child);
+}
+#endif
+
+
+static void *
+system_alloc(size_t size)
+{
+  void *p;
+
+  if(posix_memalign(&p, M2_ALIGN, size)) return NULL;
+  return p;
+}
+
+
+/*
+ header of a block returned to the user
+ */
+static struct block *
+header(void *p)
+{
+  return (struct block *)((char *)p - HEADER);
+}
+
+
+static void *
+finish(void *base, size_t size, int kind, int cls)
+{
+  struct block *b = (struct block *)base;
+
+  b->base = base;
+  b->size = size;
+  b->kind = kind;
+  b->cls  = cls;
+  b->free = NULL;
+  b->ctx  = NULL;
+  b->next = NULL;
+
+  return (char *)base + HEADER;
+}
+
+
+/*
+ allocate size bytes, M2_ALIGN aligned
+ */
+void *
+m_alloc(size_t size)
+{
+#ifdef M2_SYSTEM_ALLOC
+  return malloc(size ? size : 1);
+#else
+  struct m_allocator user;
+  struct block *b;
+  size_t total;
+  void *base;
+  int cls;
+
+#ifndef M2_NO_THREADS
+  pthread_once(&once, init_once);
+#endif
+
+  total = size + HEADER;
+  if(total < size) return NULL; /* overflow */
+
+  /* the hooks are called on a copy outside the lock, they may allocate
+     through m2 themselves or be replaced meanwhile */
+  LOCK();
+  user = hooks;
+  UNLOCK();
+  if(user.alloc){
+    char *p;
+
+    if(total + M2_ALIGN < total) return NULL;
+    total += M2_ALIGN;
+    base = user.alloc(total, user.ctx);
+    if(base == NULL) return NULL;
+    /* first aligned address with room for the header before it */
+    p = (char *)(((uintptr_t)base + HEADER + M2_ALIGN - 1) & ~(uintptr_t)(M2_ALIGN - 1));
+    b = header(p);
+    finish(b, total, BLOCK_HOOK, -1);
+    b->base = base;
+    b->free = user.free;
+    b->ctx  = user.ctx;
+    return p;
+  }
+
+  if(total <= POOL_MAX){
+    for(cls=0; ((size_t)1 << (cls+POOL_MIN_SHIFT)) < total; cls++)
+      ;
+    LOCK();
+    b = pool[cls];
+    if(b){
+      pool[cls] = b->next;
+      pool_bytes[cls] -= b->size;
+      b->next = NULL;
+    }
+    UNLOCK();
+    if(b)
+      return (char *)b + HEADER;
+    total = (size_t)1 << (cls+POOL_MIN_SHIFT);
+    base = system_alloc(total);
+    return base ? finish(base, total, BLOCK_SMALL, cls) : NULL;
+  }
+
+#ifdef M2_HAVE_MMAP
+  if(total >= HUGE_MIN){
+    base = mmap(NULL, total, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(base, total, MADV_HUGEPAGE);
+#endif
+    return finish(base, total, BLOCK_HUGE, -1);
+  }
+#endif
+
+  base = system_alloc(total);
+  return base ? finish(base, total, BLOCK_SYSTEM, -1) : NULL;
+#endif /* M2_SYSTEM_ALLOC */
+}
+
+
+/*
+ release block from m_alloc(), NULL is ignored
+ */
+void
+m_release(void *p)
+{
+#ifdef M2_SYSTEM_ALLOC
+  free(p);
+#else
+  struct block *b;
+
+  if(p == NULL) return;
+  b = header(p);
+
+  switch(b->kind){
+  case BLOCK_SMALL:
+    LOCK();
+    if(pool_bytes[b->cls] + b->size <= POOL_KEEP){
+      b->next = pool[b->cls];
+      pool[b->cls] = b;
+      pool_bytes[b->cls] += b->size;
+      b = NULL;
+    }
+    UNLOCK();
+    if(b) free(b->base);
+    break;
+#ifdef M2_HAVE_MMAP
+  case BLOCK_HUGE:
+    munmap(b->base, b->size);
+    break;
+#endif
+  case BLOCK_HOOK:
+    b->free(b->base, b->size, b->ctx);
+    break;
+  default:
+    free(b->base);
+  }
+#endif /* M2_SYSTEM_ALLOC */
+}
+
+
+/*
+ install user hooks for all new allocations, NULL restores the default;
+ blocks allocated before are still released the way they were made
+ */
+void
+m_set_allocator(const struct m_allocator *a)
+{
+  LOCK();
+  if(a)
+    hooks = *a;
+  else
+    memset(&hooks, 0, sizeof(hooks));
+  UNLOCK();
+}
+
+
+/*
+ return the cached small blocks to the system
+ */
+void
+m_alloc_trim(void)
+{
+  struct block *b;
+  int cls;
+
+  LOCK();
+  for(cls=0; cls<POOL_CLASSES; cls++){
+    while((b = pool[cls]) != NULL){
+      pool[cls] = b->next;
+      free(b->base);
+    }
+    pool_bytes[cls] = 0;
+  }
+  UNLOCK();
+}
@@ -0,0 +1,484 @@
+/*
+  m2_gemm.c
+      Cache blocked matrix multiply for m2.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "m2.h"
+
+/*
+ Blocking of C = alpha A * B + beta C (A is m x k, B is k x n)
+
+   NC  - columns of B kept in L3       (KC x NC block of B)
+   KC  - depth of one rank-KC update   (KC x NR sliver of B lives in L1)
+   MC  - rows of A kept in L2          (MC x KC block of A)
+   MR x NR - register tile of C computed by the micro kernel
+
+ Both operands are packed into contiguous micro panels so that the
+ kernel reads them with unit stride:
+
+   packed A:  MR rows, column after column   a[p*MR + i]
+   packed B:  NR cols, row after row         b[p*NR + j]
+
+ Partial panels at the edges are padded with zeros.
+*/
+
+#define MR  4
+#define NR  8
+#define MC  96
+#define KC  256
+#define NC  2048
+
+/* products smaller than this (m*n*k) are not worth packing */
+#define GEMM_SMALL (32*32*32)
+
+/* products smaller than this (m*n*k) are not worth waking the pool */
+#define GEMM_PARALLEL (128*128*128)
+
+
+/*
+  pack mc x kc block of A (strides rsa, csa) into MR row panels
+ */
+static void
+pack_A(const Float *A, int rsa, int csa, int mc, int kc, Float *pa)
+{
+  const Float *a;
+  int i, ii, p, mr;
+
+  for(ii=0; ii<mc; ii+=MR){
+    mr = (mc-ii < MR)? mc-ii : MR;
+    for(p=0; p<kc; p++){
+      a = A + ii*rsa + p*csa;
+      for(i=0; i<mr; i++)
+        *pa++ = a[i*rsa];
+      for(; i<MR; i++)
+        *pa++ = 0;
+    }
+  }
+}
+
+
+/*
+  pack kc x nc block of B (strides rsb, csb) into NR column panels
+ */
+static void
+pack_B(const Float *B, int rsb, int csb, int kc, int nc, Float *pb)
+{
+  const Float *b;
+  int j, jj, p, nr;
+
+  for(jj=0; jj<nc; jj+=NR){
+    nr = (nc-jj < NR)? nc-jj : NR;
+    b = B + jj*csb;
+    for(p=0; p<kc; p++, b+=rsb){
+      for(j=0; j<nr; j++)
+        *pb++ = b[j*csb];
+      for(; j<NR; j++)
+        *pb++ = 0;
+    }
+  }
+}
+
+
+/*
+  MR x NR tile of C = alpha * packed A panel * packed B panel + beta C
+
+  beta==0 overwrites C without reading it
+ */
+static void
+kernel(int kc, const Float *a, const Float *b, Float *C, int ldc,
+       int mr, int nr, Float alpha, Float beta)
+{
+  Float c[MR][NR];
+  Float ai;
+  int i, j, p;
+
+  for(i=0; i<MR; i++)
+    for(j=0; j<NR; j++)
+      c[i][j] = 0;
+
+  for(p=0; p<kc; p++, a+=MR, b+=NR){
+    for(i=0; i<MR; i++){
+      ai = a[i];
+      for(j=0; j<NR; j++)
+        c[i][j] += ai * b[j];
+    }
+  }
+
+  for(i=0; i<mr; i++, C+=ldc){
+    if(beta==0)
+      for(j=0; j<nr; j++) C[j] = alpha*c[i][j];
+    else if(beta==1)
+      for(j=0; j<nr; j++) C[j] += alpha*c[i][j];
+    else
+      for(j=0; j<nr; j++) C[j] = alpha*c[i][j] + beta*C[j];
+  }
+}
+
+
+/*
+  scale m x n block of C by beta, zero it for beta==0
+ */
+static void
+scale_C(int m, int n, Float beta, Float *C, int ldc)
+{
+  int i, j;
+
+  if(beta==1) return;
+  for(i=0; i<m; i++, C+=ldc){
+    if(beta==0)
+      memset(C, 0, n*sizeof(Float));
+    else
+      for(j=0; j<n; j++) C[j] *= beta;
+  }
+}
+
+
+/*
+  C = alpha A * B + beta C for small operands,
+  i-k-j order streams rows of B and C
+ */
+static void
+gemm_small(int m, int n, int k, Float alpha, const Float *A, int rsa, int csa,
+           const Float *B, int rsb, int csb, Float beta, Float *C, int ldc)
+{
+  const Float *b;
+  Float a, *c;
+  int i, j, p;
+
+  scale_C(m, n, beta, C, ldc);
+  for(i=0; i<m; i++, A+=rsa, C+=ldc){
+    b = B;
+    for(p=0; p<k; p++, b+=rsb){
+      a = alpha*A[p*csa];
+      c = C;
+      if(csb==1)
+        for(j=0; j<n; j++)
+          c[j] += a * b[j];
+      else
+        for(j=0; j<n; j++)
+          c[j] += a * b[j*csb];
+    }
+  }
+}
+
+
+/*
+  Floats of the packing panels of an m x n x k product, the A panel
+  is followed by the B panel
+ */
+int
+m_gemm_pack_size(int m, int n, int k)
+{
+  int ma = (m < MC)? m : MC;
+  int na = (n < NC)? n : NC;
+  int ka = (k < KC)? k : KC;
+
+  return ((ma+MR-1)/MR*MR + (na+NR-1)/NR*NR) * ka;
+}
+
+
+/*
+  C = alpha A * B + beta C on the calling thread, in the panels of
+  pack (m_gemm_pack_size(m, n, k) Floats) or in allocated ones when
+  pack is NULL
+ */
+static int
+gemm_serial(int m, int n, int k, Float alpha, const Float *A, int rsa, int csa,
+            const Float *B, int rsb, int csb, Float beta, Float *C, int ldc,
+            Float *pack)
+{
+  Float *pa, *pb;
+  int ic, jc, pc, ir, jr;
+  int mc, nc, kc, ma, na, ka;
+
+  if(m<=0 || n<=0) return 0;
+
+  if(k<=0 || alpha==0){
+    scale_C(m, n, beta, C, ldc);
+    return 0;
+  }
+
+  if((double)m*n*k < GEMM_SMALL){
+    gemm_small(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc);
+    return 0;
+  }
+
+  /* packing buffers only as large as the blocks of this product, the
+     panels are padded to whole MR and NR tiles */
+  ma = (m < MC)? m : MC;
+  na = (n < NC)? n : NC;
+  ka = (k < KC)? k : KC;
+  if(pack!=NULL){
+    pa = pack;
+    pb = pack + (ma+MR-1)/MR*MR*ka;
+  } else {
+    pa = m_new((ma+MR-1)/MR*MR, ka);
+    pb = m_new(ka, (na+NR-1)/NR*NR);
+    if(pa==NULL || pb==NULL){
+      m_free(pa);
+      m_free(pb);
+      return 2;
+    }
+  }
+
+  for(jc=0; jc<n; jc+=NC){                 /* L3: columns of B and C */
+    nc = (n-jc < NC)? n-jc : NC;
+
+    for(pc=0; pc<k; pc+=KC){               /* L1: rank-KC updates */
+      kc = (k-pc < KC)? k-pc : KC;
+      pack_B(B + pc*rsb + jc*csb, rsb, csb, kc, nc, pb);
+
+      for(ic=0; ic<m; ic+=MC){             /* L2: rows of A and C */
+        mc = (m-ic < MC)? m-ic : MC;
+        pack_A(A + ic*rsa + pc*csa, rsa, csa, mc, kc, pa);
+
+        for(jr=0; jr<nc; jr+=NR)           /* register tiles */
+          for(ir=0; ir<mc; ir+=MR)
+            kernel(kc, pa + ir*kc, pb + jr*kc,
+                   C + (ic+ir)*ldc + jc + jr, ldc,
+                   (mc-ir < MR)? mc-ir : MR,
+                   (nc-jr < NR)? nc-jr : NR,
+                   alpha, (pc==0)? beta : 1);
+      }
+    }
+  }
+
+  if(pack==NULL){
+    m_free(pa);
+    m_free(pb);
+  }
+
+  return 0;
+}
+
+
+/*
+  one slice of a parallel product, C is split into ntasks bands of
+  whole MR rows (or NR columns when C is wider than tall)
+ */
+struct gemm_job {
+  int m, n, k;
+  Float alpha, beta;
+  const Float *A; int rsa, csa;
+  const Float *B; int rsb, csb;
+  Float *C; int ldc;
+  int by_rows, step, status;
+};
+
+static void
+gemm_task(void *arg, int i)
+{
+  struct gemm_job *g = (struct gemm_job *)arg;
+  int lo, len, s;
+
+  lo = i * g->step;
+  if(g->by_rows){
+    len = (g->m - lo < g->step)? g->m - lo : g->step;
+    if(len <= 0) return;
+    s = gemm_serial(len, g->n, g->k, g->alpha, g->A + lo*g->rsa, g->rsa, g->csa,
+                    g->B, g->rsb, g->csb, g->beta, g->C + lo*g->ldc, g->ldc, NULL);
+  } else {
+    len = (g->n - lo < g->step)? g->n - lo : g->step;
+    if(len <= 0) return;
+    s = gemm_serial(g->m, len, g->k, g->alpha, g->A, g->rsa, g->csa,
+                    g->B + lo*g->csb, g->rsb, g->csb, g->beta, g->C + lo, g->ldc, NULL);
+  }
+  if(s) g->status = s;
+}
+
+
+/*
+  m_gemm_strided() in the panels of pack when it is not NULL, a
+  product split over threads allocates the panels of each band
+ */
+static int
+gemm_strided_ws(int m, int n, int k, Float alpha,
+                const Float *A, int rsa, int csa,
+                const Float *B, int rsb, int csb,
+                Float beta, Float *C, int ldc, Float *pack)
+{
+  struct gemm_job g;
+  int nt, unit, len;
+
+  nt = m_get_num_threads();
+  if(nt <= 1 || (double)m*n*k < GEMM_PARALLEL)
+    return gemm_serial(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc, pack);
+
+  g.m = m; g.n = n; g.k = k;
+  g.alpha = alpha; g.beta = beta;
+  g.A = A; g.rsa = rsa; g.csa = csa;
+  g.B = B; g.rsb = rsb; g.csb = csb;
+  g.C = C; g.ldc = ldc;
+  g.by_rows = (m >= n);
+  g.status = 0;
+
+  unit = g.by_rows? MR : NR;
+  len  = g.by_rows? m : n;
+  if(nt > len/unit) nt = len/unit;
+  if(nt <= 1)
+    return gemm_serial(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc, pack);
+
+  /* band size, rounded up to whole register tiles */
+  g.step = ((len + nt - 1) / nt + unit - 1) / unit * unit;
+  nt = (len + g.step - 1) / g.step;
+
+  m_parallel(gemm_task, &g, nt);
+
+  return g.status;
+}
+
+
+/*
+  C = alpha A * B + beta C
+
+  A is m x k and B is k x n, element [i][j] of A is A[i*rsa + j*csa]
+  (likewise for B), so transposed and sliced operands are read in
+  place. C is m x n, row major with row stride ldc, and is not read
+  when beta is 0. Large products are split over m_get_num_threads()
+  threads.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_gemm_strided(int m, int n, int k, Float alpha,
+               const Float *A, int rsa, int csa,
+               const Float *B, int rsb, int csb,
+               Float beta, Float *C, int ldc)
+{
+  return gemm_strided_ws(m, n, k, alpha, A, rsa, csa, B, rsb, csb, beta, C, ldc, NULL);
+}
+
+
+/*
+  C = alpha A * B + beta C
+
+  A is m x k, B is k x n, C is m x n, all row major with
+  row strides lda, ldb and ldc. C is not read when beta is 0.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_gemm_blocked(int m, int n, int k, Float alpha, const Float *A, int lda,
+               const Float *B, int ldb, Float beta, Float *C, int ldc)
+{
+  return m_gemm_strided(m, n, k, alpha, A, lda, 1, B, ldb, 1, beta, C, ldc);
+}
+
+
+/*
+  C = alpha op(A) * op(B) + beta C, op(X) is X or transpose(X)
+  when tX is set.
+
+  op(A) is m x k, op(B) is k x n and C is m x n, all stored as plain
+  row major arrays (A is k x m when transposed). The product is
+  accumulated into C in place, no temporary is needed for
+  expressions like A*P*A' + Q. C is not read when beta is 0.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_gemm(int ta, int tb, int m, int n, int k, Float alpha,
+       const Float *A, const Float *B, Float beta, Float *C)
+{
+  return m_gemm_ws(ta, tb, m, n, k, alpha, A, B, beta, C, NULL);
+}
+
+
+/*
+  m_gemm() packing the operands into pack, m_gemm_pack_size(m, n, k)
+  Floats (or more) owned by the caller, so that a repeated product
+  does not allocate. Only a product split over threads, m*n*k of
+  GEMM_PARALLEL (128^3) or more with m_get_num_threads() > 1, still
+  allocates the panels of each band. pack may be NULL.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_gemm_ws(int ta, int tb, int m, int n, int k, Float alpha,
+          const Float *A, const Float *B, Float beta, Float *C, Float *pack)
+{
+  return gemm_strided_ws(m, n, k, alpha,
+                         A, ta? 1 : k, ta? m : 1,
+                         B, tb? 1 : n, tb? k : 1,
+                         beta, C, n, pack);
+}
+
+
+/* row panels of the result in m_sandwich, the upper triangle takes
+   (SYM_PANELS+1)/(2 SYM_PANELS) of the full product */
+#define SYM_PANELS 8
+
+/*
+  S = A * P * transpose(A) + beta S for symmetric P and S
+
+  A is n x k, P is k x k, S is n x n. Only the upper triangle of the
+  second product is computed, panel by panel, then mirrored into the
+  lower one, the lower triangle of S is not read. W (n x k) receives
+  A * P, it is allocated internally when NULL. S is not read when beta
+  is 0, it may then be the same array as P.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_sandwich(int n, int k, const Float *A, const Float *P, Float beta, Float *S, Float *W)
+{
+  return m_sandwich_ws(n, k, A, P, beta, S, W, NULL);
+}
+
+
+/*
+  m_sandwich() packing the operands into pack, m_gemm_pack_size(n,
+  max(n, k), k) Floats owned by the caller, see m_gemm_ws(). With W
+  and pack given it does not allocate below GEMM_PARALLEL.
+  Return: 0 - OK
+          2 - Alloc error
+ */
+int
+m_sandwich_ws(int n, int k, const Float *A, const Float *P, Float beta, Float *S,
+              Float *W, Float *pack)
+{
+  Float *w = W;
+  int i, j, ib, nb, s;
+
+  if(w==NULL && (w = m_new(n, k))==NULL)
+    return 2;
+
+  s = gemm_strided_ws(n, k, k, 1, A, k, 1, P, k, 1, 0, w, k, pack);
+
+  nb = ((n + SYM_PANELS - 1)/SYM_PANELS + MR - 1)/MR*MR;
+  for(ib=0; ib<n && s==0; ib+=nb){
+    /* S[ib.., ib..n] = W[ib..] * transpose(A[ib..n]) */
+    s = gemm_strided_ws((n-ib < nb)? n-ib : nb, n-ib, k, 1,
+                        w + ib*k, k, 1, A + ib*k, 1, k,
+                        beta, S + ib*n + ib, n, pack);
+  }
+
+  if(s==0)
+    for(i=1; i<n; i++)
+      for(j=0; j<i; j++)
+        S[i*n+j] = S[j*n+i];
+
+  if(w!=W)
+    m_free(w);
+
+  return s;
+}
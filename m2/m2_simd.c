@@ -0,0 +1,530 @@
+/*
+  m2_simd.c
+      Elementwise kernels for m2 with runtime CPU dispatch.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "m2.h"
+
+/*
+ Every kernel works on n consecutive elements:
+
+   add     C = A + B
+   sub     C = A - B
+   mul     C = A .* B
+   scale   A = a * A
+   adds    B = a + A
+   fill    A = a
+
+ The scalar versions are always there. SSE2, AVX2 and AVX-512
+ versions are built with GCC target attributes, so the module itself
+ needs no special compiler flags, and m_simd_init() picks the widest
+ one the CPU supports.
+
+ Results bigger than STREAM_MIN bytes are written with non-temporal
+ stores, they would not fit in the cache anyway.
+*/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define M2_SIMD_X86
+#include <immintrin.h>
+
+/* the same kernels serve both precisions, V(_mm_add) is _mm_add_pd or _ps */
+#ifdef M2_SINGLE
+#define V(f) f##_ps
+#define V128 __m128
+#define V256 __m256
+#define V512 __m512
+#else
+#define V(f) f##_pd
+#define V128 __m128d
+#define V256 __m256d
+#define V512 __m512d
+#endif
+
+/* elements per register */
+#define L128 (int)(16/sizeof(Float))
+#define L256 (int)(32/sizeof(Float))
+#define L512 (int)(64/sizeof(Float))
+#endif
+
+#define STREAM_MIN (4*1024*1024)
+
+
+static void
+add_scalar(const Float *A, const Float *B, Float *C, int n)
+{
+  for(; n>0; n--)
+    *C++=*A+++*B++;
+}
+
+static void
+sub_scalar(const Float *A, const Float *B, Float *C, int n)
+{
+  for(; n>0; n--)
+    *C++=*A++-*B++;
+}
+
+static void
+mul_scalar(const Float *A, const Float *B, Float *C, int n)
+{
+  for(; n>0; n--)
+    *C++=*A++**B++;
+}
+
+static void
+scale_scalar(Float a, Float *A, int n)
+{
+  for(; n>0; n--)
+    *A++*=a;
+}
+
+static void
+adds_scalar(Float a, const Float *A, Float *B, int n)
+{
+  for(; n>0; n--)
+    *B++=a+*A++;
+}
+
+static void
+fill_scalar(Float a, Float *A, int n)
+{
+  for(; n>0; n--)
+    *A++=a;
+}
+
+
+struct m_simd_ops m_simd = {
+  "scalar",
+  add_scalar,
+  sub_scalar,
+  mul_scalar,
+  scale_scalar,
+  adds_scalar,
+  fill_scalar,
+};
+
+
+#ifdef M2_SIMD_X86
+
+/*
+ number of leading elements to store one by one before dst is aligned
+ to the vector size, all of n if the result is too small to stream or
+ dst is not aligned to the item size and never gets vector aligned
+ */
+static int
+stream_head(const Float *dst, int n, int vbytes)
+{
+  int k;
+
+  if((size_t)n*sizeof(Float) < STREAM_MIN || (uintptr_t)dst % sizeof(Float))
+    return n;
+  k = (int)(((vbytes - ((uintptr_t)dst % vbytes)) % vbytes) / sizeof(Float));
+  return (k < n)? k : n;
+}
+
+
+/*
+ SSE2 - 16 byte registers
+ */
+__attribute__((target("sse2"))) static void
+add_sse2(const Float *A, const Float *B, Float *C, int n)
+{
+  int i;
+  for(i=0; i+2*L128<=n; i+=2*L128){
+    V(_mm_storeu)(C+i, V(_mm_add)(V(_mm_loadu)(A+i), V(_mm_loadu)(B+i)));
+    V(_mm_storeu)(C+i+L128, V(_mm_add)(V(_mm_loadu)(A+i+L128), V(_mm_loadu)(B+i+L128)));
+  }
+  add_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("sse2"))) static void
+sub_sse2(const Float *A, const Float *B, Float *C, int n)
+{
+  int i;
+  for(i=0; i+2*L128<=n; i+=2*L128){
+    V(_mm_storeu)(C+i, V(_mm_sub)(V(_mm_loadu)(A+i), V(_mm_loadu)(B+i)));
+    V(_mm_storeu)(C+i+L128, V(_mm_sub)(V(_mm_loadu)(A+i+L128), V(_mm_loadu)(B+i+L128)));
+  }
+  sub_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("sse2"))) static void
+mul_sse2(const Float *A, const Float *B, Float *C, int n)
+{
+  int i;
+  for(i=0; i+2*L128<=n; i+=2*L128){
+    V(_mm_storeu)(C+i, V(_mm_mul)(V(_mm_loadu)(A+i), V(_mm_loadu)(B+i)));
+    V(_mm_storeu)(C+i+L128, V(_mm_mul)(V(_mm_loadu)(A+i+L128), V(_mm_loadu)(B+i+L128)));
+  }
+  mul_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("sse2"))) static void
+scale_sse2(Float a, Float *A, int n)
+{
+  V128 va = V(_mm_set1)(a);
+  int i;
+  for(i=0; i+2*L128<=n; i+=2*L128){
+    V(_mm_storeu)(A+i, V(_mm_mul)(va, V(_mm_loadu)(A+i)));
+    V(_mm_storeu)(A+i+L128, V(_mm_mul)(va, V(_mm_loadu)(A+i+L128)));
+  }
+  scale_scalar(a, A+i, n-i);
+}
+
+__attribute__((target("sse2"))) static void
+adds_sse2(Float a, const Float *A, Float *B, int n)
+{
+  V128 va = V(_mm_set1)(a);
+  int i;
+  for(i=0; i+2*L128<=n; i+=2*L128){
+    V(_mm_storeu)(B+i, V(_mm_add)(va, V(_mm_loadu)(A+i)));
+    V(_mm_storeu)(B+i+L128, V(_mm_add)(va, V(_mm_loadu)(A+i+L128)));
+  }
+  adds_scalar(a, A+i, B+i, n-i);
+}
+
+__attribute__((target("sse2"))) static void
+fill_sse2(Float a, Float *A, int n)
+{
+  V128 va = V(_mm_set1)(a);
+  int i, h;
+
+  h = stream_head(A, n, 16);
+  if(h==n) {
+    for(i=0; i+2*L128<=n; i+=2*L128){
+      V(_mm_storeu)(A+i, va);
+      V(_mm_storeu)(A+i+L128, va);
+    }
+  } else {
+    fill_scalar(a, A, h);
+    for(i=h; i+2*L128<=n; i+=2*L128){
+      V(_mm_stream)(A+i, va);
+      V(_mm_stream)(A+i+L128, va);
+    }
+    _mm_sfence();
+  }
+  fill_scalar(a, A+i, n-i);
+}
+
+
+/*
+ AVX2 - 32 byte registers
+ */
+__attribute__((target("avx2"))) static void
+add_avx2(const Float *A, const Float *B, Float *C, int n)
+{
+  V256 v0, v1;
+  int i, h;
+
+  h = stream_head(C, n, 32);
+  if(h==n) {
+    for(i=0; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_add)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_add)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_storeu)(C+i, v0);
+      V(_mm256_storeu)(C+i+L256, v1);
+    }
+  } else {
+    add_scalar(A, B, C, h);
+    for(i=h; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_add)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_add)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_stream)(C+i, v0);
+      V(_mm256_stream)(C+i+L256, v1);
+    }
+    _mm_sfence();
+  }
+  add_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx2"))) static void
+sub_avx2(const Float *A, const Float *B, Float *C, int n)
+{
+  V256 v0, v1;
+  int i, h;
+
+  h = stream_head(C, n, 32);
+  if(h==n) {
+    for(i=0; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_sub)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_sub)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_storeu)(C+i, v0);
+      V(_mm256_storeu)(C+i+L256, v1);
+    }
+  } else {
+    sub_scalar(A, B, C, h);
+    for(i=h; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_sub)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_sub)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_stream)(C+i, v0);
+      V(_mm256_stream)(C+i+L256, v1);
+    }
+    _mm_sfence();
+  }
+  sub_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx2"))) static void
+mul_avx2(const Float *A, const Float *B, Float *C, int n)
+{
+  V256 v0, v1;
+  int i, h;
+
+  h = stream_head(C, n, 32);
+  if(h==n) {
+    for(i=0; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_mul)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_mul)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_storeu)(C+i, v0);
+      V(_mm256_storeu)(C+i+L256, v1);
+    }
+  } else {
+    mul_scalar(A, B, C, h);
+    for(i=h; i+2*L256<=n; i+=2*L256){
+      v0 = V(_mm256_mul)(V(_mm256_loadu)(A+i), V(_mm256_loadu)(B+i));
+      v1 = V(_mm256_mul)(V(_mm256_loadu)(A+i+L256), V(_mm256_loadu)(B+i+L256));
+      V(_mm256_stream)(C+i, v0);
+      V(_mm256_stream)(C+i+L256, v1);
+    }
+    _mm_sfence();
+  }
+  mul_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx2"))) static void
+scale_avx2(Float a, Float *A, int n)
+{
+  V256 va = V(_mm256_set1)(a);
+  int i;
+  for(i=0; i+2*L256<=n; i+=2*L256){
+    V(_mm256_storeu)(A+i, V(_mm256_mul)(va, V(_mm256_loadu)(A+i)));
+    V(_mm256_storeu)(A+i+L256, V(_mm256_mul)(va, V(_mm256_loadu)(A+i+L256)));
+  }
+  scale_scalar(a, A+i, n-i);
+}
+
+__attribute__((target("avx2"))) static void
+adds_avx2(Float a, const Float *A, Float *B, int n)
+{
+  V256 va = V(_mm256_set1)(a);
+  int i, h;
+
+  h = stream_head(B, n, 32);
+  if(h==n) {
+    for(i=0; i+2*L256<=n; i+=2*L256){
+      V(_mm256_storeu)(B+i, V(_mm256_add)(va, V(_mm256_loadu)(A+i)));
+      V(_mm256_storeu)(B+i+L256, V(_mm256_add)(va, V(_mm256_loadu)(A+i+L256)));
+    }
+  } else {
+    adds_scalar(a, A, B, h);
+    for(i=h; i+2*L256<=n; i+=2*L256){
+      V(_mm256_stream)(B+i, V(_mm256_add)(va, V(_mm256_loadu)(A+i)));
+      V(_mm256_stream)(B+i+L256, V(_mm256_add)(va, V(_mm256_loadu)(A+i+L256)));
+    }
+    _mm_sfence();
+  }
+  adds_scalar(a, A+i, B+i, n-i);
+}
+
+__attribute__((target("avx2"))) static void
+fill_avx2(Float a, Float *A, int n)
+{
+  V256 va = V(_mm256_set1)(a);
+  int i, h;
+
+  h = stream_head(A, n, 32);
+  if(h==n) {
+    for(i=0; i+2*L256<=n; i+=2*L256){
+      V(_mm256_storeu)(A+i, va);
+      V(_mm256_storeu)(A+i+L256, va);
+    }
+  } else {
+    fill_scalar(a, A, h);
+    for(i=h; i+2*L256<=n; i+=2*L256){
+      V(_mm256_stream)(A+i, va);
+      V(_mm256_stream)(A+i+L256, va);
+    }
+    _mm_sfence();
+  }
+  fill_scalar(a, A+i, n-i);
+}
+
+
+/*
+ AVX-512 - 64 byte registers
+ */
+__attribute__((target("avx512f"))) static void
+add_avx512(const Float *A, const Float *B, Float *C, int n)
+{
+  V512 v;
+  int i, h;
+
+  h = stream_head(C, n, 64);
+  if(h==n) {
+    for(i=0; i+L512<=n; i+=L512){
+      v = V(_mm512_add)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_storeu)(C+i, v);
+    }
+  } else {
+    add_scalar(A, B, C, h);
+    for(i=h; i+L512<=n; i+=L512){
+      v = V(_mm512_add)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_stream)(C+i, v);
+    }
+    _mm_sfence();
+  }
+  add_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx512f"))) static void
+sub_avx512(const Float *A, const Float *B, Float *C, int n)
+{
+  V512 v;
+  int i, h;
+
+  h = stream_head(C, n, 64);
+  if(h==n) {
+    for(i=0; i+L512<=n; i+=L512){
+      v = V(_mm512_sub)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_storeu)(C+i, v);
+    }
+  } else {
+    sub_scalar(A, B, C, h);
+    for(i=h; i+L512<=n; i+=L512){
+      v = V(_mm512_sub)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_stream)(C+i, v);
+    }
+    _mm_sfence();
+  }
+  sub_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx512f"))) static void
+mul_avx512(const Float *A, const Float *B, Float *C, int n)
+{
+  V512 v;
+  int i, h;
+
+  h = stream_head(C, n, 64);
+  if(h==n) {
+    for(i=0; i+L512<=n; i+=L512){
+      v = V(_mm512_mul)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_storeu)(C+i, v);
+    }
+  } else {
+    mul_scalar(A, B, C, h);
+    for(i=h; i+L512<=n; i+=L512){
+      v = V(_mm512_mul)(V(_mm512_loadu)(A+i), V(_mm512_loadu)(B+i));
+      V(_mm512_stream)(C+i, v);
+    }
+    _mm_sfence();
+  }
+  mul_scalar(A+i, B+i, C+i, n-i);
+}
+
+__attribute__((target("avx512f"))) static void
+scale_avx512(Float a, Float *A, int n)
+{
+  V512 va = V(_mm512_set1)(a);
+  int i;
+  for(i=0; i+L512<=n; i+=L512)
+    V(_mm512_storeu)(A+i, V(_mm512_mul)(va, V(_mm512_loadu)(A+i)));
+  scale_scalar(a, A+i, n-i);
+}
+
+__attribute__((target("avx512f"))) static void
+adds_avx512(Float a, const Float *A, Float *B, int n)
+{
+  V512 va = V(_mm512_set1)(a);
+  int i, h;
+
+  h = stream_head(B, n, 64);
+  if(h==n) {
+    for(i=0; i+L512<=n; i+=L512)
+      V(_mm512_storeu)(B+i, V(_mm512_add)(va, V(_mm512_loadu)(A+i)));
+  } else {
+    adds_scalar(a, A, B, h);
+    for(i=h; i+L512<=n; i+=L512)
+      V(_mm512_stream)(B+i, V(_mm512_add)(va, V(_mm512_loadu)(A+i)));
+    _mm_sfence();
+  }
+  adds_scalar(a, A+i, B+i, n-i);
+}
+
+__attribute__((target("avx512f"))) static void
+fill_avx512(Float a, Float *A, int n)
+{
+  V512 va = V(_mm512_set1)(a);
+  int i, h;
+
+  h = stream_head(A, n, 64);
+  if(h==n) {
+    for(i=0; i+L512<=n; i+=L512)
+      V(_mm512_storeu)(A+i, va);
+  } else {
+    fill_scalar(a, A, h);
+    for(i=h; i+L512<=n; i+=L512)
+      V(_mm512_stream)(A+i, va);
+    _mm_sfence();
+  }
+  fill_scalar(a, A+i, n-i);
+}
+
+#endif /* M2_SIMD_X86 */
+
+
+/*
+ select the kernels for the running CPU, called once at module init
+ */
+void
+m_simd_init(void)
+{
+#ifdef M2_SIMD_X86
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx512f")){
+    m_simd.name  = "avx512";
+    m_simd.add   = add_avx512;
+    m_simd.sub   = sub_avx512;
+    m_simd.mul   = mul_avx512;
+    m_simd.scale = scale_avx512;
+    m_simd.adds  = adds_avx512;
+    m_simd.fill  = fill_avx512;
+  } else if(__builtin_cpu_supports("avx2")){
+    m_simd.name  = "avx2";
+    m_simd.add   = add_avx2;
+    m_simd.sub   = sub_avx2;
+    m_simd.mul   = mul_avx2;
+    m_simd.scale = scale_avx2;
+    m_simd.adds  = adds_avx2;
+    m_simd.fill  = fill_avx2;
+  } else if(__builtin_cpu_supports("sse2")){
+    m_simd.name  = "sse2";
+    m_simd.add   = add_sse2;
+    m_simd.sub   = sub_sse2;
+    m_simd.mul   = mul_sse2;
+    m_simd.scale = scale_sse2;
+    m_simd.adds  = adds_sse2;
+    m_simd.fill  = fill_sse2;
+  }
+#endif
+}
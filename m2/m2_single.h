@@ -0,0 +1,75 @@
+/*
+  m2_single.h
+      Symbol names of the single precision build of m2.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+/*
+ m2f.c, m2f_gemm.c and m2f_simd.c define M2_SINGLE and include the
+ double precision sources, these renames give the float routines their
+ mf_ names. Every Float routine declared in m2.h must be listed here.
+*/
+
+#ifndef __M2_SINGLE_H__
+#define __M2_SINGLE_H__
+
+#define m_new             mf_new
+#define m_dup             mf_dup
+#define m_copy            mf_copy
+#define m_copy_strided    mf_copy_strided
+#define m_free            mf_free
+#define m_print           mf_print
+#define m_set0            mf_set0
+#define m_set1            mf_set1
+#define m_descramble      mf_descramble
+#define m_descramble_rows mf_descramble_rows
+#define m_descramble_cols mf_descramble_cols
+#define m_LU              mf_LU
+#define m_inversion       mf_inversion
+#define m_lu_solve        mf_lu_solve
+#define m_solve           mf_solve
+#define m_chol            mf_chol
+#define m_chol_solve      mf_chol_solve
+#define m_chol_inv        mf_chol_inv
+#define m_transpose       mf_transpose
+#define m_tr              mf_tr
+#define m_prod            mf_prod
+#define m_det             mf_det
+#define m_add             mf_add
+#define m_add_scalar      mf_add_scalar
+#define m_sub             mf_sub
+#define m_emul            mf_emul
+#define m_scale           mf_scale
+#define m_mul             mf_mul
+#define m_mul_tn          mf_mul_tn
+#define m_mul_nt          mf_mul_nt
+#define m_dare            mf_dare
+#define m_eye             mf_eye
+#define m_simd_ops        mf_simd_ops
+#define m_simd            mf_simd
+#define m_simd_init       mf_simd_init
+#define m_gemm            mf_gemm
+#define m_gemm_blocked    mf_gemm_blocked
+#define m_gemm_strided    mf_gemm_strided
+#define m_sandwich        mf_sandwich
+#define m_gemm_pack_size  mf_gemm_pack_size
+#define m_gemm_ws         mf_gemm_ws
+#define m_sandwich_ws     mf_sandwich_ws
+
+#endif
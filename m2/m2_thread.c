@@ -0,0 +1,216 @@
+/*
+  m2_thread.c
+      Worker thread pool for m2.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include "m2.h"
+
+/*
+ m_parallel(fn, arg, ntasks) runs fn(arg, 0) .. fn(arg, ntasks-1), task 0
+ in the calling thread and the others on the pool workers, and returns
+ when all of them are finished.
+
+ Workers are started lazily the first time they are needed and then
+ sleep on a condition variable between jobs. Build with M2_NO_THREADS
+ for platforms without pthreads, everything then runs in the caller.
+*/
+
+#ifndef M2_NO_THREADS
+
+#include <pthread.h>
+#include <unistd.h>
+
+static struct {
+  pthread_mutex_t lock;      /* protects everything below */
+  pthread_cond_t  work;      /* a new job was posted */
+  pthread_cond_t  done;      /* a worker finished its task */
+  pthread_mutex_t run;       /* one job at a time */
+  pthread_t thread[M2_MAX_THREADS];
+  unsigned born[M2_MAX_THREADS]; /* generation when the worker was created */
+  int started;               /* number of running workers */
+  unsigned generation;       /* job counter, workers wait for a change */
+  int pending;               /* tasks of the current job not finished yet */
+  int ntasks;
+  void (*fn)(void *arg, int i);
+  void *arg;
+} pool = {
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_MUTEX_INITIALIZER,
+};
+
+static int nthreads = 0; /* 0 - not set yet, use the number of CPUs */
+
+
+static void *
+worker(void *p)
+{
+  int id = (int)(long)p;
+  unsigned seen;
+
+  pthread_mutex_lock(&pool.lock);
+  seen = pool.born[id];
+  for(;;){
+    while(pool.generation == seen)
+      pthread_cond_wait(&pool.work, &pool.lock);
+    seen = pool.generation;
+
+    if(id < pool.ntasks){
+      pthread_mutex_unlock(&pool.lock);
+      pool.fn(pool.arg, id);
+      pthread_mutex_lock(&pool.lock);
+      if(--pool.pending == 0)
+        pthread_cond_signal(&pool.done);
+    }
+  }
+
+  return NULL;
+}
+
+
+/*
+ a forked child has the pool memory but not the threads
+ */
+static void
+atfork_child(void)
+{
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_mutex_init(&pool.run, NULL);
+  pthread_cond_init(&pool.work, NULL);
+  pthread_cond_init(&pool.done, NULL);
+  pool.started = 0;
+}
+
+
+/*
+ make sure workers 1..n-1 are running, return how many tasks can run
+ */
+static int
+pool_start(int n)
+{
+  static int atfork = 0;
+
+  if(!atfork){
+    pthread_atfork(NULL, NULL, atfork_child);
+    atfork = 1;
+  }
+
+  while(pool.started+1 < n){
+    pool.born[pool.started+1] = pool.generation;
+    if(pthread_create(&pool.thread[pool.started+1], NULL, worker,
+                      (void*)(long)(pool.started+1)) != 0)
+      break;
+    pthread_detach(pool.thread[pool.started+1]);
+    pool.started++;
+  }
+
+  return pool.started+1;
+}
+
+
+int
+m_set_num_threads(int n)
+{
+  if(n < 1) return 1;
+  if(n > M2_MAX_THREADS) n = M2_MAX_THREADS;
+  nthreads = n;
+  return 0;
+}
+
+
+int
+m_get_num_threads(void)
+{
+  long n;
+
+  if(nthreads == 0){
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if(n < 1) n = 1;
+    if(n > M2_MAX_THREADS) n = M2_MAX_THREADS;
+    nthreads = (int)n;
+  }
+
+  return nthreads;
+}
+
+
+void
+m_parallel(void (*fn)(void *arg, int i), void *arg, int ntasks)
+{
+  int i, n;
+
+  if(ntasks <= 1){
+    if(ntasks == 1) fn(arg, 0);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.run);
+  pthread_mutex_lock(&pool.lock);
+
+  n = pool_start(ntasks);
+  if(n > ntasks) n = ntasks;
+  pool.fn = fn;
+  pool.arg = arg;
+  pool.ntasks = n;
+  pool.pending = n-1;
+  pool.generation++;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  fn(arg, 0);
+  /* tasks left over when some thread could not be started */
+  for(i=n; i<ntasks; i++)
+    fn(arg, i);
+
+  pthread_mutex_lock(&pool.lock);
+  while(pool.pending > 0)
+    pthread_cond_wait(&pool.done, &pool.lock);
+  pthread_mutex_unlock(&pool.lock);
+
+  pthread_mutex_unlock(&pool.run);
+}
+
+#else /* M2_NO_THREADS */
+
+int
+m_set_num_threads(int n)
+{
+  return (n < 1)? 1 : 0;
+}
+
+
+int
+m_get_num_threads(void)
+{
+  return 1;
+}
+
+
+void
+m_parallel(void (*fn)(void *arg, int i), void *arg, int ntasks)
+{
+  int i;
+
+  for(i=0; i<ntasks; i++)
+    fn(arg, i);
+}
+
+#endif /* M2_NO_THREADS */
@@ -28,286 +28,2038 @@
 
 #include "pnumeric.h"
 
+// file backed matrixes, see matrix_mmap()
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PN_HAVE_MMAP
+#endif
+
+
+
+/*
+ * dtype from Python object, None is the default 'f8'
+ * return PN_F8, PN_F4 or -1 with exception set
+ */
+int
+dtype_parse(PyObject *o)
+{
+    char *s;
+
+    if (o == NULL || o == Py_None)
+        return PN_F8;
+
+    if (PyString_Check(o)) {
+        s = PyString_AsString(o);
+        if (!strcmp(s, "f8") || !strcmp(s, "d") || !strcmp(s, "float64"))
+            return PN_F8;
+        if (!strcmp(s, "f4") || !strcmp(s, "f") || !strcmp(s, "float32"))
+            return PN_F4;
+    }
+
+    PyErr_SetString(PyExc_TypeError, "dtype must be 'f8' or 'f4'");
+    return -1;
+}
+
+
+
+/*
+ * dtype name, 'f8' or 'f4'
+ */
+const char *
+dtype_name(int dtype)
+{
+    return (dtype == PN_F4)? "f4" : "f8";
+}
+
+
+
+/*
+ * size of one element in bytes
+ */
+size_t
+dtype_size(int dtype)
+{
+    return (dtype == PN_F4)? sizeof(float) : sizeof(double);
+}
+
+
+
+/*
+ * convert n elements between dtypes
+ */
+void
+dtype_convert(void *dst, int dst_dtype, const void *src, int src_dtype, int n)
+{
+    int i;
+
+    if (dst_dtype == src_dtype) {
+        memcpy(dst, src, n*dtype_size(dst_dtype));
+    } else if (dst_dtype == PN_F4) {
+        for (i=0; i<n; i++)
+            ((float *)dst)[i] = (float)((const double *)src)[i];
+    } else {
+        for (i=0; i<n; i++)
+            ((double *)dst)[i] = ((const float *)src)[i];
+    }
+}
+
+
+
+/*
+ * a[i*inc] op= b[i], or op= x if b is NULL, for n elements of dtype,
+ * a contiguous run goes to the m2 kernels
+ */
+void
+dtype_update(Float *a, int inc, int op, const Float *b, Float x, int n, int dtype)
+{
+    Float *c = (Float *)b;
+    double v;
+    int i;
+
+    if (inc == 1 && dtype == PN_F4) {
+        if (c == NULL && op == PN_IMUL)
+            mf_scale((float)x, FDATA(a), 1, n);
+        else if (c == NULL)
+            mf_add_scalar((float)(op == PN_ISUB? -x : x), FDATA(a), FDATA(a), 1, n);
+        else if (op == PN_IADD)
+            mf_add(FDATA(a), FDATA(c), FDATA(a), 1, n);
+        else if (op == PN_ISUB)
+            mf_sub(FDATA(a), FDATA(c), FDATA(a), 1, n);
+        else
+            mf_emul(FDATA(a), FDATA(c), FDATA(a), 1, n);
+        return;
+    }
+    if (inc == 1) {
+        if (c == NULL && op == PN_IMUL)
+            m_scale(x, a, 1, n);
+        else if (c == NULL)
+            m_add_scalar(op == PN_ISUB? -x : x, a, a, 1, n);
+        else if (op == PN_IADD)
+            m_add(a, c, a, 1, n);
+        else if (op == PN_ISUB)
+            m_sub(a, c, a, 1, n);
+        else
+            m_emul(a, c, a, 1, n);
+        return;
+    }
+
+    for (i=0; i<n; i++) {
+        v = (c == NULL)? x : PN_GET(c, dtype, i);
+        if (op == PN_IADD)
+            v = PN_GET(a, dtype, i*inc) + v;
+        else if (op == PN_ISUB)
+            v = PN_GET(a, dtype, i*inc) - v;
+        else
+            v = PN_GET(a, dtype, i*inc) * v;
+        PN_SET(a, dtype, i*inc, v);
+    }
+}
+
+
+
+/*
+ * number o as double, float and int objects are read in place
+ * return -1 and exception if o is not a number
+ */
+static double
+as_double(PyObject *o)
+{
+    if (PyFloat_CheckExact(o))
+        return PyFloat_AS_DOUBLE(o);
+    if (PyInt_CheckExact(o))
+        return (double)PyInt_AS_LONG(o);
+    return PyFloat_AsDouble(o);
+}
+
+
+
+/*
+ * items of list or tuple seq to data of dtype
+ * return 0 - success, -1 - error
+ */
+int
+dtype_fill(Float *data, int dtype, PyObject *seq)
+{
+    PyObject **items = PySequence_Fast_ITEMS(seq);
+    Py_ssize_t i, n = PySequence_Fast_GET_SIZE(seq);
+    double x;
+
+    for (i=0; i<n; i++) {
+        x = as_double(items[i]);
+        if (x == -1 && PyErr_Occurred())
+            return -1;
+        PN_SET(data, dtype, i, x);
+    }
+    return 0;
+}
+
+
+
+/*
+ * element [i][j] of Matrix m, as double
+ */
+#define AT(m, i, j) PN_GET((m)->data, (m)->dtype, (i)*(m)->rs + (j)*(m)->cs)
+
+
+
+/*
+ * matrix owning the data, self unless self is a view
+ */
+static MatrixObject *
+owner(MatrixObject *m)
+{
+    return (m->base != NULL)? (MatrixObject *)m->base : m;
+}
+
+
+
+/*
+ * free cached LU factorization
+ */
+static void
+drop_lu(MatrixObject *self)
+{
+    if (self->lu != NULL) {
+        m_free(self->lu);
+        self->lu = NULL;
+    }
+    if (self->lu_pr != NULL) {
+        PyMem_Free(self->lu_pr);
+        self->lu_pr = NULL;
+    }
+}
+
+
+
+/*
+ * new Matrix object without data
+ */
+static MatrixObject *
+blank(int dtype)
+{
+    MatrixObject *y;
+
+    y = (MatrixObject *) PyMem_Malloc(sizeof(MatrixType));
+    if (y == NULL) {
+        PyErr_SetString(PyExc_MemoryError, "Can't allocate memory for Matrix");
+        return NULL;
+    }
+
+    PyObject_Init((PyObject *)y, &MatrixType);
+    y->data = NULL;
+    y->rows = 0;
+    y->cols = 0;
+    y->rs = 0;
+    y->cs = 1;
+    y->dtype = dtype;
+    y->base = NULL;
+    y->version = 0;
+    y->buffer = NULL;
+    y->exports = 0;
+    y->map = NULL;
+    y->map_size = 0;
+    y->lu = NULL;
+    y->lu_pr = NULL;
+    y->lu_version = 0;
+
+    return y;
+}
+
+
+
+/*
+ * deallocating matrix form memory
+ */
+PyAPI_FUNC(void) matrix_dealloc(MatrixObject *matrix)
+{
+    drop_lu(matrix);
+    if (matrix->base != NULL)
+        Py_DECREF(matrix->base);
+    else if (matrix->buffer != NULL)
+        buffer_free(matrix->buffer);
+#ifdef PN_HAVE_MMAP
+    else if (matrix->map != NULL)
+        munmap(matrix->map, matrix->map_size);
+#endif
+    else
+        m_free(matrix->data);
+    PyObject_Del(matrix);
+}
+
+
+
+/*
+ * copy elements into row major array dst of the matrix dtype
+ */
+PyAPI_FUNC(void)
+matrix_pack(MatrixObject *self, Float *dst)
+{
+    if (dst == self->data && Matrix_IsContiguous(self))
+        return;
+    if (self->dtype == PN_F4)
+        mf_copy_strided(FDATA(dst), self->cols, 1, FDATA(self->data), self->rs, self->cs,
+                        self->rows, self->cols);
+    else
+        m_copy_strided(dst, self->cols, 1, self->data, self->rs, self->cs,
+                       self->rows, self->cols);
+}
+
+
+
+/*
+ * row major data of the matrix, a packed copy for views
+ * return NULL if no memory, free with unpacked()
+ */
+static Float *
+packed(MatrixObject *m)
+{
+    Float *p;
+
+    if (Matrix_IsContiguous(m))
+        return m->data;
+
+    if (m->dtype == PN_F4)
+        p = (Float *)mf_new(m->rows, m->cols);
+    else
+        p = m_new(m->rows, m->cols);
+    if (p != NULL)
+        matrix_pack(m, p);
+    return p;
+}
+
+static void
+unpacked(MatrixObject *m, Float *p)
+{
+    if (p != m->data)
+        m_free(p);
+}
+
+
+
+/*
+ * repr, printing the matrix
+ */
+PyAPI_FUNC(PyObject *)
+matrix_repr(MatrixObject *v)
+{
+    int i, j;
+    Float d;
+    char fstr[64];
+    PyObject *s;
+    PyObject *result;
+
+    if (v->rows == 0 || v->cols == 0) {
+        return PyString_FromString("Matrix([])");
+    }
+
+    result = PyString_FromString("Matrix([\n");
+    for (i = 0; i < v->rows; i++) {
+        for (j = 0; j < v->cols; j++) {
+            d = AT(v, i, j);
+            sprintf(fstr, "   %6g", d);
+            PyString_ConcatAndDel(&result, PyString_FromString(fstr));
+        }
+        PyString_ConcatAndDel(&result, PyString_FromString("\n"));
+    }
+
+    PyString_ConcatAndDel(&result, PyString_FromString("])"));
+    return result;
+}
+
+
+
+/*
+ * LU factorization of square matrix, computed on first use and kept
+ * in the object until matrix_modified() is called
+ * return m_LU status (0 - OK, 1 or -1 - singular, 2 - no memory)
+ */
+PyAPI_FUNC(int)
+matrix_lu(MatrixObject *self)
+{
+    int n = self->rows;
+
+    // memory shared with other objects may change behind our back
+    if (self->lu != NULL && self->lu_version == owner(self)->version
+            && owner(self)->buffer == NULL && owner(self)->exports == 0)
+        return self->lu_status;
+    drop_lu(self);
+
+    if (self->dtype == PN_F4)
+        self->lu = (Float *)mf_new(n, n);
+    else
+        self->lu = m_new(n, n);
+    self->lu_pr = (int *)PyMem_Malloc(sizeof(int)*(n > 0 ? n : 1));
+    if (self->lu == NULL || self->lu_pr == NULL) {
+        drop_lu(self);
+        return 2;
+    }
+    matrix_pack(self, self->lu);
+    self->lu_version = owner(self)->version;
+
+    if (self->dtype == PN_F4)
+        self->lu_status = mf_LU(FDATA(self->lu), n, self->lu_pr, &self->lu_per);
+    else
+        self->lu_status = m_LU(self->lu, n, self->lu_pr, &self->lu_per);
+    if (self->lu_status == 2) {
+        drop_lu(self);
+        return 2;
+    }
+
+    return self->lu_status;
+}
+
+
+
+/*
+ * drop cached results after the matrix data were changed,
+ * caches of other views of the same data are checked against
+ * the owner version
+ */
+PyAPI_FUNC(void)
+matrix_modified(MatrixObject *self)
+{
+    drop_lu(self);
+    owner(self)->version++;
+}
+
+
+
+/*
+ * allocate memory array for matrix data
+ * return 0 - success, 1 - failed
+ */
+PyAPI_FUNC(int)
+matrix_alloc(MatrixObject *mo, int rows, int cols)
+{
+    if (mo->dtype == PN_F4)
+        mo->data = (Float *)mf_new(rows, cols);
+    else
+        mo->data = m_new(rows, cols);
+    if (mo->data == NULL) {
+        PyErr_NoMemory();
+        return 1;
+    }
+
+    mo->rows = rows;
+    mo->cols = cols;
+    mo->rs = cols;
+    mo->cs = 1;
+
+    return 0;
+}
+
+
+
+/*
+ * returning matrix row
+ */
+PyAPI_FUNC(PyObject *)
+matrix_item(MatrixObject *a, int i)
+{
+    PyObject *out = NULL;
+    if (i < 0 || i >= a->rows) {
+        PyErr_SetObject(PyExc_IndexError, PyString_FromString("row index out of range"));
+        return NULL;
+    }
+
+    out = (PyObject*)matrixrow2vector((PyObject *)a, PN_PTR(a->data, a->dtype, i*(a->rs)));
+    //TODO: is this necessary?
+    Py_INCREF(out);
+
+    return out;
+}
+
+
+
+/*
+ * comparison of two matrixes
+ */
+PyAPI_FUNC(int)
+matrix_cmp(MatrixObject *self, MatrixObject *other)
+{
+    Float s, o, sub, max;
+    Float eps = 1e-8;  // TODO: hope this will be enough
+    int i, j;
+
+    if (self->rows != other->rows || self->cols != other->cols) {
+        return 1;
+    }
+
+    if (self->dtype == PN_F4 || other->dtype == PN_F4)
+        eps = 1e-6;
+
+    for (i=0; i<self->rows; i++) {
+        for (j=0; j<self->cols; j++) {
+            s = AT(self, i, j);
+            o = AT(other, i, j);
+            sub = s-o;
+            max = MAX(s, o);
+
+            if (max != 0) {
+                sub = sub / max;
+            }
+
+            if (Fabs(sub) > eps) {
+                return 1;
+            }
+        }
+    }
+
+    // TODO: which matrix is bigger? (to return -1 instead of 1)
+    return 0;
+}
+
+
+
+/*
+ * matrix inversion
+ */
+PyAPI_FUNC(PyObject *)
+matrix_inv(MatrixObject *self)
+{
+    MatrixObject *out;
+    int g;
+
+    if (self->rows != self->cols) {
+        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+        return NULL;
+    }
+
+    g = matrix_lu(self);
+    if (g == 2)
+        return PyErr_NoMemory();
+    if (g) {
+        PyErr_SetString(PyExc_ValueError, "singular matrix");
+        return NULL;
+    }
+
+    out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+    if (out == NULL)
+        return NULL;
+    if (self->dtype == PN_F4) {
+        mf_eye(FDATA(out->data), out->rows, out->cols);
+        g = mf_lu_solve(FDATA(self->lu), self->rows, self->lu_pr, FDATA(out->data), out->cols);
+    } else {
+        m_eye(out->data, out->rows, out->cols);
+        g = m_lu_solve(self->lu, self->rows, self->lu_pr, out->data, out->cols);
+    }
+    if (g) {
+        Py_DECREF(out);
+        return PyErr_NoMemory();
+    }
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * Cholesky factor L of symmetric positive definite matrix, self = L * L'
+ */
+PyAPI_FUNC(PyObject *)
+matrix_cholesky(MatrixObject *self)
+{
+    MatrixObject *out;
+    int g;
+
+    if (self->rows != self->cols) {
+        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+        return NULL;
+    }
+
+    out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+    if (out == NULL)
+        return NULL;
+    matrix_pack(self, out->data);
+    if (self->dtype == PN_F4)
+        g = mf_chol(FDATA(out->data), out->rows);
+    else
+        g = m_chol(out->data, out->rows);
+    if (g) {
+        Py_DECREF(out);
+        if (g == 2)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, "matrix is not positive definite");
+        return NULL;
+    }
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * return determinant
+ */
+PyAPI_FUNC(PyObject *)
+matrix_det(MatrixObject *self)
+{
+    Float det;
+    int g;
+
+    if (self->rows != self->cols) {
+        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+        return NULL;
+    }
+
+    g = matrix_lu(self);
+    if (g == 2)
+        return PyErr_NoMemory();
+
+    if (g) {
+        det = 0;
+    } else {
+        if (self->dtype == PN_F4)
+            det = mf_prod(FDATA(self->lu), self->rows);
+        else
+            det = m_prod(self->lu, self->rows);
+        det = (self->lu_per == 1)? det : -det;
+    }
+    return PyFloat_FromDouble(det);
+}
+
+
+
+/*
+ * solve A x = b for Matrix or Vector b
+ */
+static PyObject *
+solve(MatrixObject *a, PyObject *b)
+{
+    PyObject *out;
+    Float *xdata;
+    int n = a->rows, nrhs, g, dtype;
+
+    if (a->rows != a->cols) {
+        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+        return NULL;
+    }
+
+    if (Matrix_Check(b)) {
+        if (((MatrixObject *)b)->rows != n) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+            return NULL;
+        }
+        nrhs = ((MatrixObject *)b)->cols;
+        dtype = ((MatrixObject *)b)->dtype;
+        if (dtype != a->dtype) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            return NULL;
+        }
+        out = (PyObject *)matrix_new_dtype(n, nrhs, dtype);
+        if (out == NULL)
+            return NULL;
+        xdata = ((MatrixObject *)out)->data;
+        matrix_pack((MatrixObject *)b, xdata);
+    } else if (Vector_Check(b)) {
+        if (vector_length((VectorObject *)b) != n) {
+            PyErr_SetString(PyExc_ValueError, "Vector length does not match");
+            return NULL;
+        }
+        nrhs = 1;
+        dtype = ((VectorObject *)b)->dtype;
+        if (dtype != a->dtype) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            return NULL;
+        }
+        out = (PyObject *)vector_new_dtype(n, dtype);
+        if (out == NULL)
+            return NULL;
+        xdata = vector_dataptr((VectorObject *)out);
+        vector_pack((VectorObject *)b, xdata);
+    } else {
+        PyErr_SetString(PyExc_TypeError, "right hand side must be Matrix or Vector");
+        return NULL;
+    }
+
+    g = matrix_lu(a);
+    if (g == 0 && dtype == PN_F4) {
+        g = mf_lu_solve(FDATA(a->lu), n, a->lu_pr, FDATA(xdata), nrhs);
+    } else if (g == 0) {
+        g = m_lu_solve(a->lu, n, a->lu_pr, xdata, nrhs);
+    } else if (g < 0) {
+        g = 1;
+    }
+    if (g) {
+        Py_DECREF(out);
+        if (g == 2)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, "singular matrix");
+        return NULL;
+    }
+
+    return out;
+}
+
+
+
+/*
+ * solve self * x = b
+ */
+PyAPI_FUNC(PyObject *)
+matrix_solve(MatrixObject *self, PyObject *b)
+{
+    return solve(self, b);
+}
+
+
+
+/*
+ * pnumeric.solve(A, b)
+ */
+PyAPI_FUNC(PyObject *)
+matrix_solve_func(PyObject *self, PyObject *args)
+{
+    MatrixObject *a;
+    PyObject *b;
+
+    if (!PyArg_ParseTuple(args, "O!O", &MatrixType, &a, &b))
+        return NULL;
+
+    return solve(a, b);
+}
+
+
+
+/*
+ * value of 0x0 scalar matrix made by matrix_coerce()
+ */
+#define SCALAR(m) PN_GET((m)->data, (m)->dtype, 0)
+
+
+
+/*
+ * out = a + m, out has the dtype of m
+ */
+static void
+scalar_add(Float a, MatrixObject *m, MatrixObject *out)
+{
+    matrix_pack(m, out->data);
+    if (m->dtype == PN_F4)
+        mf_add_scalar((float)a, FDATA(out->data), FDATA(out->data), m->rows, m->cols);
+    else
+        m_add_scalar(a, out->data, out->data, m->rows, m->cols);
+}
+
+
+
+/*
+ * out = a * m, out has the dtype of m
+ */
+static void
+scalar_mul(Float a, MatrixObject *m, MatrixObject *out)
+{
+    matrix_pack(m, out->data);
+    if (m->dtype == PN_F4)
+        mf_scale((float)a, FDATA(out->data), m->rows, m->cols);
+    else
+        m_scale(a, out->data, m->rows, m->cols);
+}
+
+
+
+/*
+ * mixed precision is not converted implicitly
+ */
+static int
+check_dtypes(MatrixObject *self, MatrixObject *other)
+{
+    if (self->dtype != other->dtype) {
+        PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/*
+ * matrix add
+ */
+PyAPI_FUNC(PyObject *)
+matrix_add(MatrixObject *self, MatrixObject *other)
+{
+    MatrixObject *out;
+    Float *b;
+
+    if (self->rows==0 && self->cols==0) { // first matrix is scalar
+        out = matrix_new_dtype(other->rows, other->cols, other->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_add(SCALAR(self), other, out);
+    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
+        out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_add(SCALAR(other), self, out);
+    } else {
+        if (self->rows != other->rows && self->cols != other->cols) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes are not aligned");
+            return NULL;
+        }
+        if (check_dtypes(self, other))
+            return NULL;
+        out = matrix_new_dtype(self->rows, other->cols, self->dtype);
+        if (out == NULL)
+            return NULL;
+        b = packed(other);
+        if (b == NULL) {
+            Py_DECREF(out);
+            return PyErr_NoMemory();
+        }
+        matrix_pack(self, out->data);
+        if (self->dtype == PN_F4)
+            mf_add(FDATA(out->data), FDATA(b), FDATA(out->data), self->rows, self->cols);
+        else
+            m_add(out->data, b, out->data, self->rows, self->cols);
+        unpacked(other, b);
+    }
+
+    Py_INCREF(out);
+    return (PyObject*)out;
+}
+
+
+
+/*
+ * matrix negative
+ */
+PyAPI_FUNC(PyObject *)
+matrix_negative(MatrixObject *self)
+{
+    MatrixObject *out;
+
+    out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+    if (out == NULL)
+        return NULL;
+    scalar_mul(-1, self, out);
+    Py_INCREF(out);
+    return (PyObject*)out;
+}
+
+
+
+/*
+ * matrix subtraction
+ */
+PyAPI_FUNC(PyObject *)
+matrix_sub(MatrixObject *self, MatrixObject *other)
+{
+    MatrixObject *out;
+    Float *b;
+
+    if (self->rows==0 && self->cols==0) { // first matrix is scalar
+        out = matrix_new_dtype(other->rows, other->cols, other->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_mul(-1, other, out);
+        scalar_add(SCALAR(self), out, out);
+    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
+        out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_add(-SCALAR(other), self, out);
+    } else {
+        if (self->rows != other->rows && self->cols != other->cols) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes are not aligned");
+            return NULL;
+        }
+        if (check_dtypes(self, other))
+            return NULL;
+
+        out = matrix_new_dtype(self->rows, other->cols, self->dtype);
+        if (out == NULL)
+            return NULL;
+        b = packed(other);
+        if (b == NULL) {
+            Py_DECREF(out);
+            return PyErr_NoMemory();
+        }
+        matrix_pack(self, out->data);
+        if (self->dtype == PN_F4)
+            mf_sub(FDATA(out->data), FDATA(b), FDATA(out->data), self->rows, self->cols);
+        else
+            m_sub(out->data, b, out->data, self->rows, self->cols);
+        unpacked(other, b);
+    }
+
+    Py_INCREF(out);
+    return (PyObject*)out;
+}
+
+
+
+/*
+ * self op= other written into the data of self, other is a number or
+ * a Matrix of the same shape, return NotImplemented for anything else
+ */
+static PyObject *
+inplace(MatrixObject *self, PyObject *other, int op)
+{
+    MatrixObject *m;
+    Float x = 0, *b = NULL;
+    int i;
+
+    if (PyInt_Check(other) || PyLong_Check(other) || PyFloat_Check(other)) {
+        x = PyFloat_AsDouble(other);
+        if (x == -1 && PyErr_Occurred())
+            return NULL;
+    } else if (Matrix_Check(other)) {
+        m = (MatrixObject *)other;
+        if (m->rows != self->rows || m->cols != self->cols) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes are not aligned");
+            return NULL;
+        }
+        if (check_dtypes(self, m))
+            return NULL;
+        // an overlapping operand laid out differently is read from a copy
+        if (owner(m) == owner(self) && !(m->data == self->data && m->rs == self->rs && m->cs == self->cs)) {
+            b = (m->dtype == PN_F4)? (Float *)mf_new(m->rows, m->cols) : m_new(m->rows, m->cols);
+            if (b != NULL)
+                matrix_pack(m, b);
+        } else {
+            b = packed(m);
+        }
+        if (b == NULL)
+            return PyErr_NoMemory();
+    } else {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    if (Matrix_IsContiguous(self))
+        dtype_update(self->data, 1, op, b, x, self->rows*self->cols, self->dtype);
+    else
+        for (i=0; i<self->rows; i++)
+            dtype_update(PN_PTR(self->data, self->dtype, i*self->rs), self->cs, op,
+                         b? PN_PTR(b, self->dtype, i*self->cols) : NULL, x, self->cols, self->dtype);
+    if (b != NULL)
+        unpacked((MatrixObject *)other, b);
+
+    matrix_modified(self);
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+
+
+/*
+ * self += other
+ */
+PyAPI_FUNC(PyObject *)
+matrix_inplace_add(MatrixObject *self, PyObject *other)
+{
+    return inplace(self, other, PN_IADD);
+}
+
+
+
+/*
+ * self -= other
+ */
+PyAPI_FUNC(PyObject *)
+matrix_inplace_sub(MatrixObject *self, PyObject *other)
+{
+    return inplace(self, other, PN_ISUB);
+}
+
+
+
+/*
+ * self *= number, Matrix * Matrix is a matrix product and makes a new
+ * Matrix as before
+ */
+PyAPI_FUNC(PyObject *)
+matrix_inplace_mul(MatrixObject *self, PyObject *other)
+{
+    if (Matrix_Check(other)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    return inplace(self, other, PN_IMUL);
+}
+
+
+
+/*
+ * self /= number
+ */
+PyAPI_FUNC(PyObject *)
+matrix_inplace_div(MatrixObject *self, PyObject *other)
+{
+    Float x;
+
+    if (!PyInt_Check(other) && !PyLong_Check(other) && !PyFloat_Check(other)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    x = PyFloat_AsDouble(other);
+    if (x == -1 && PyErr_Occurred())
+        return NULL;
+    if (x == 0) {
+        PyErr_SetString(PyExc_ZeroDivisionError, "Matrix division by zero");
+        return NULL;
+    }
+    other = PyFloat_FromDouble(1/x);
+    if (other == NULL)
+        return NULL;
+    self = (MatrixObject *)inplace(self, other, PN_IMUL);
+    Py_DECREF(other);
+    return (PyObject *)self;
+}
+
+
+
+/*
+ * matrix multiply
+ */
+PyAPI_FUNC(PyObject *)
+matrix_mul(MatrixObject *self, MatrixObject *other)
+{
+    MatrixObject *out;
+    int g;
+    DEBUG(" Matrix multiply\n");
+
+    if (self->rows==0 && self->cols==0) { // first matrix is scalar
+        out = matrix_new_dtype(other->rows, other->cols, other->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_mul(SCALAR(self), other, out);
+    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
+        out = matrix_new_dtype(self->rows, self->cols, self->dtype);
+        if (out == NULL)
+            return NULL;
+        scalar_mul(SCALAR(other), self, out);
+    } else {
+        if (self->cols != other->rows) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+            return NULL;
+        }
+        if (check_dtypes(self, other))
+            return NULL;
+        out = matrix_new_dtype(self->rows, other->cols, self->dtype);
+        if (out == NULL) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        if (Matrix_IsContiguous(self) && Matrix_IsContiguous(other)) {
+            if (self->dtype == PN_F4)
+                mf_mul(FDATA(self->data), FDATA(other->data), FDATA(out->data), self->rows, self->cols, other->cols);
+            else
+                m_mul(self->data, other->data, out->data, self->rows, self->cols, other->cols);
+        } else {
+            // views are read in place by the strided kernel
+            if (self->dtype == PN_F4)
+                g = mf_gemm_strided(self->rows, other->cols, self->cols, 1,
+                        FDATA(self->data), self->rs, self->cs,
+                        FDATA(other->data), other->rs, other->cs,
+                        0, FDATA(out->data), other->cols);
+            else
+                g = m_gemm_strided(self->rows, other->cols, self->cols, 1,
+                        self->data, self->rs, self->cs,
+                        other->data, other->rs, other->cs,
+                        0, out->data, other->cols);
+            if (g) {
+                Py_DECREF(out);
+                return PyErr_NoMemory();
+            }
+        }
+    }
+
+    Py_INCREF(out);
+    return (PyObject*)out;
+}
+
+
+
+/*
+ * pnumeric.dot(A, B, transA=False, transB=False) = op(A) * op(B),
+ * op() transposes when the flag is set, the transposed operand is
+ * read in place by the multiply kernel
+ */
+PyAPI_FUNC(PyObject *)
+matrix_dot(PyObject *self, PyObject *args, PyObject *kws)
+{
+    MatrixObject *a, *b, *out;
+    int ta = 0, tb = 0, m, n, k, g;
+    static char *kwlist[] = {"A", "B", "transA", "transB", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O!O!|ii", kwlist,
+            &MatrixType, &a, &MatrixType, &b, &ta, &tb))
+        return NULL;
+
+    m = ta? a->cols : a->rows;
+    k = ta? a->rows : a->cols;
+    n = tb? b->rows : b->cols;
+    if ((tb? b->cols : b->rows) != k) {
+        PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+        return NULL;
+    }
+    if (check_dtypes(a, b))
+        return NULL;
+
+    out = matrix_new_dtype(m, n, a->dtype);
+    if (out == NULL)
+        return NULL;
+    if (a->dtype == PN_F4)
+        g = mf_gemm_strided(m, n, k, 1,
+                FDATA(a->data), ta? a->cs : a->rs, ta? a->rs : a->cs,
+                FDATA(b->data), tb? b->cs : b->rs, tb? b->rs : b->cs,
+                0, FDATA(out->data), n);
+    else
+        g = m_gemm_strided(m, n, k, 1,
+                a->data, ta? a->cs : a->rs, ta? a->rs : a->cs,
+                b->data, tb? b->cs : b->rs, tb? b->rs : b->cs,
+                0, out->data, n);
+    if (g) {
+        Py_DECREF(out);
+        return PyErr_NoMemory();
+    }
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * pnumeric.gemm(alpha, A, B, beta, C, transA=False, transB=False),
+ * C = alpha op(A) * op(B) + beta C computed in place, returns C
+ */
+PyAPI_FUNC(PyObject *)
+matrix_gemm(PyObject *self, PyObject *args, PyObject *kws)
+{
+    MatrixObject *a, *b, *c;
+    Float *cdata, alpha, beta;
+    int ta = 0, tb = 0, m, n, k, ldc, g;
+    static char *kwlist[] = {"alpha", "A", "B", "beta", "C", "transA", "transB", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "dO!O!dO!|ii", kwlist,
+            &alpha, &MatrixType, &a, &MatrixType, &b, &beta, &MatrixType, &c, &ta, &tb))
+        return NULL;
+
+    m = ta? a->cols : a->rows;
+    k = ta? a->rows : a->cols;
+    n = tb? b->rows : b->cols;
+    if ((tb? b->cols : b->rows) != k || c->rows != m || c->cols != n) {
+        PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+        return NULL;
+    }
+    if (check_dtypes(a, c) || check_dtypes(b, c))
+        return NULL;
+
+    // the kernel writes C with unit column stride and must not
+    // overwrite operands it still reads, use a packed copy then
+    cdata = c->data;
+    ldc = c->rs;
+    if (c->cs != 1 || owner(a) == owner(c) || owner(b) == owner(c)) {
+        if (c->dtype == PN_F4)
+            cdata = (Float *)mf_new(m, n);
+        else
+            cdata = m_new(m, n);
+        if (cdata == NULL)
+            return PyErr_NoMemory();
+        matrix_pack(c, cdata);
+        ldc = n;
+    }
+
+    if (c->dtype == PN_F4)
+        g = mf_gemm_strided(m, n, k, (float)alpha,
+                FDATA(a->data), ta? a->cs : a->rs, ta? a->rs : a->cs,
+                FDATA(b->data), tb? b->cs : b->rs, tb? b->rs : b->cs,
+                (float)beta, FDATA(cdata), ldc);
+    else
+        g = m_gemm_strided(m, n, k, alpha,
+                a->data, ta? a->cs : a->rs, ta? a->rs : a->cs,
+                b->data, tb? b->cs : b->rs, tb? b->rs : b->cs,
+                beta, cdata, ldc);
+
+    if (cdata != c->data) {
+        if (g == 0) {
+            if (c->dtype == PN_F4)
+                mf_copy_strided(FDATA(c->data), c->rs, c->cs, FDATA(cdata), n, 1, m, n);
+            else
+                m_copy_strided(c->data, c->rs, c->cs, cdata, n, 1, m, n);
+        }
+        m_free(cdata);
+    }
+    if (g)
+        return PyErr_NoMemory();
+
+    matrix_modified(c);
+    Py_INCREF(c);
+    return (PyObject *)c;
+}
+
+
+
+/*
+ * self * P * transpose(self) (+ Q) for symmetric P, only one
+ * triangle of the product is computed, Q is any square matrix
+ */
+PyAPI_FUNC(PyObject *)
+matrix_sandwich(MatrixObject *self, PyObject *args)
+{
+    MatrixObject *p, *q = NULL, *out;
+    Float *a, *pd, *qd = NULL;
+    int n = self->rows, k = self->cols, g;
+
+    if (!PyArg_ParseTuple(args, "O!|O!", &MatrixType, &p, &MatrixType, &q))
+        return NULL;
+    if (p->rows != k || p->cols != k || (q && (q->rows != n || q->cols != n))) {
+        PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+        return NULL;
+    }
+    if (check_dtypes(self, p) || (q && check_dtypes(self, q)))
+        return NULL;
+
+    out = matrix_new_dtype(n, n, self->dtype);
+    if (out == NULL)
+        return NULL;
+
+    // m_sandwich() mirrors its upper triangle, Q is added after it so
+    // that Q need not be symmetric
+    a = packed(self);
+    pd = packed(p);
+    if (q)
+        qd = packed(q);
+    if (a == NULL || pd == NULL || (q && qd == NULL))
+        g = 2;
+    else if (self->dtype == PN_F4) {
+        g = mf_sandwich(n, k, FDATA(a), FDATA(pd), 0, FDATA(out->data), NULL);
+        if (g == 0 && q)
+            mf_add(FDATA(out->data), FDATA(qd), FDATA(out->data), n, n);
+    } else {
+        g = m_sandwich(n, k, a, pd, 0, out->data, NULL);
+        if (g == 0 && q)
+            m_add(out->data, qd, out->data, n, n);
+    }
+    if (a)
+        unpacked(self, a);
+    if (pd)
+        unpacked(p, pd);
+    if (qd)
+        unpacked(q, qd);
+    if (g) {
+        Py_DECREF(out);
+        return PyErr_NoMemory();
+    }
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * copy of the matrix in dtype
+ */
+static PyObject *
+convert(MatrixObject *self, int dtype)
+{
+    MatrixObject *out;
+    int i, j;
+
+    out = matrix_new_dtype(self->rows, self->cols, dtype);
+    if (out == NULL)
+        return NULL;
+    if (dtype == self->dtype)
+        matrix_pack(self, out->data);
+    else if (Matrix_IsContiguous(self))
+        dtype_convert(out->data, dtype, self->data, self->dtype, self->rows*self->cols);
+    else
+        for (i=0; i<self->rows; i++)
+            for (j=0; j<self->cols; j++)
+                PN_SET(out->data, dtype, i*self->cols + j, AT(self, i, j));
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * copy of the matrix converted to dtype
+ */
+PyAPI_FUNC(PyObject *)
+matrix_astype(MatrixObject *self, PyObject *args)
+{
+    PyObject *o;
+    int dtype;
+
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+    dtype = dtype_parse(o);
+    if (dtype < 0)
+        return NULL;
+
+    return convert(self, dtype);
+}
+
+
+
+/*
+ * contiguous copy
+ */
+PyAPI_FUNC(PyObject *)
+matrix_copy(MatrixObject *self)
+{
+    return convert(self, self->dtype);
+}
+
+
+
+/*
+ * view sharing the data of self, element [i][j] of the view is
+ * self[r0 + i*dr][c0 + j*dc], steps may be negative
+ */
+PyAPI_FUNC(MatrixObject *)
+matrix_view(MatrixObject *self, int r0, int c0, int rows, int cols, int dr, int dc)
+{
+    MatrixObject *y;
+
+    y = blank(self->dtype);
+    if (y == NULL)
+        return NULL;
+    y->data = PN_PTR(self->data, self->dtype, r0*self->rs + c0*self->cs);
+    y->rows = rows;
+    y->cols = cols;
+    y->rs = dr*self->rs;
+    y->cs = dc*self->cs;
+    y->base = (PyObject *)owner(self);
+    Py_INCREF(y->base);
+
+    return y;
+}
+
+
+
+/*
+ * transposed view, no data are copied
+ */
+PyAPI_FUNC(PyObject *)
+matrix_transpose(MatrixObject *self)
+{
+    MatrixObject *t;
+    int tmp;
+
+    t = matrix_view(self, 0, 0, self->rows, self->cols, 1, 1);
+    if (t == NULL)
+        return NULL;
+    tmp = t->rows; t->rows = t->cols; t->cols = tmp;
+    tmp = t->rs; t->rs = t->cs; t->cs = tmp;
+
+    return (PyObject *)t;
+}
+
+
+
+/*
+ * one dimension of a subscript, an index or a slice
+ * sel[0] - start, sel[1] - step, sel[2] - number of elements
+ * return 0 - index, 1 - slice, -1 - error
+ */
+static int
+select_dim(PyObject *o, int len, Py_ssize_t *sel)
+{
+    Py_ssize_t stop, i;
+
+    if (PySlice_Check(o)) {
+        if (PySlice_GetIndicesEx((PySliceObject *)o, len, &sel[0], &stop, &sel[1], &sel[2]) < 0)
+            return -1;
+        return 1;
+    }
+
+    if (PyIndex_Check(o)) {
+        i = PyNumber_AsSsize_t(o, PyExc_IndexError);
+        if (i == -1 && PyErr_Occurred())
+            return -1;
+        if (i < 0)
+            i += len;
+        if (i < 0 || i >= len) {
+            PyErr_SetString(PyExc_IndexError, "index out of range");
+            return -1;
+        }
+        sel[0] = i;
+        sel[1] = 1;
+        sel[2] = 1;
+        return 0;
+    }
+
+    PyErr_SetString(PyExc_TypeError, "Matrix indices must be integers or slices");
+    return -1;
+}
+
+
+
+/*
+ * rows and columns selected by key, a single index/slice selects rows
+ * return bit 0 - row is an index, bit 1 - column is an index, -1 - error
+ */
+static int
+select_key(MatrixObject *self, PyObject *key, Py_ssize_t *r, Py_ssize_t *c)
+{
+    int kr, kc;
+
+    if (PyTuple_Check(key)) {
+        if (PyTuple_GET_SIZE(key) != 2) {
+            PyErr_SetString(PyExc_IndexError, "Matrix takes two indices");
+            return -1;
+        }
+        if ((kr = select_dim(PyTuple_GET_ITEM(key, 0), self->rows, r)) < 0)
+            return -1;
+        if ((kc = select_dim(PyTuple_GET_ITEM(key, 1), self->cols, c)) < 0)
+            return -1;
+        return (kr == 0) | ((kc == 0) << 1);
+    }
+
+    if ((kr = select_dim(key, self->rows, r)) < 0)
+        return -1;
+    c[0] = 0;
+    c[1] = 1;
+    c[2] = self->cols;
+    return kr == 0;
+}
+
+
+
+/*
+ * m[i] - row Vector, m[i, j] - element,
+ * m[r0:r1, c0:c1], m[:, j], m[r0:r1] - views sharing the data of m
+ */
+PyAPI_FUNC(PyObject *)
+matrix_subscript(MatrixObject *self, PyObject *key)
+{
+    Py_ssize_t r[3], c[3];
+    int k;
+
+    if ((k = select_key(self, key, r, c)) < 0)
+        return NULL;
+
+    if (k == 3)
+        return PyFloat_FromDouble(AT(self, r[0], c[0]));
+    if (k == 1 && !PyTuple_Check(key))
+        return matrix_item(self, r[0]);
+
+    return (PyObject *)matrix_view(self, r[0], c[0], r[2], c[2], r[1], c[1]);
+}
+
+
+
+/*
+ * m[key] = value, value is a number, a Matrix of the selected shape or
+ * a Vector for one row or column
+ */
+static int
+matrix_ass_subscript(MatrixObject *self, PyObject *key, PyObject *value)
+{
+    Py_ssize_t r[3], c[3];
+    MatrixObject *src = NULL;
+    VectorObject *v = NULL;
+    Float x = 0, *dst, *vp = NULL;
+    int i, j, step;
+
+    if (value == NULL) {
+        PyErr_SetString(PyExc_TypeError, "Matrix items can't be deleted");
+        return -1;
+    }
+    if (select_key(self, key, r, c) < 0)
+        return -1;
+    dst = PN_PTR(self->data, self->dtype, r[0]*self->rs + c[0]*self->cs);
+    step = (r[2] == 1)? c[1]*self->cs : r[1]*self->rs;
+
+    if (Matrix_Check(value)) {
+        src = (MatrixObject *)value;
+        if (src->rows != r[2] || src->cols != c[2]) {
+            PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
+            return -1;
+        }
+        // a view of the target itself, as after m[r0:r1] += x
+        if (src->data == dst && src->dtype == self->dtype
+                && (src->rs == r[1]*self->rs || src->rows <= 1)
+                && (src->cs == c[1]*self->cs || src->cols <= 1)) {
+            matrix_modified(self);
+            return 0;
+        }
+        // the source may overlap the target
+        if (owner(src) == owner(self))
+            src = (MatrixObject *)matrix_copy(src);
+        else
+            Py_INCREF(src);
+        if (src == NULL)
+            return -1;
+    } else if (Vector_Check(value)) {
+        v = (VectorObject *)value;
+        if ((r[2] != 1 && c[2] != 1) || vector_length(v) != r[2]*c[2]) {
+            PyErr_SetString(PyExc_ValueError, "Vector length differs from the selection");
+            return -1;
+        }
+        // the row itself, as after m[i] += x
+        if (vector_dataptr(v) == dst && v->dtype == self->dtype
+                && (v->stride == step || vector_length(v) <= 1)) {
+            matrix_modified(self);
+            return 0;
+        }
+        vp = (v->dtype == PN_F4)? (Float *)mf_new(1, vector_length(v)) : m_new(1, vector_length(v));
+        if (vp == NULL) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        vector_pack(v, vp);
+    } else {
+        x = PyFloat_AsDouble(value);
+        if (x == -1 && PyErr_Occurred()) {
+            PyErr_SetString(PyExc_TypeError, "value must be number, Matrix or Vector");
+            return -1;
+        }
+    }
+
+    for (i=0; i<r[2]; i++)
+        for (j=0; j<c[2]; j++)
+            PN_SET(self->data, self->dtype,
+                   (r[0] + i*r[1])*self->rs + (c[0] + j*c[1])*self->cs,
+                   src? AT(src, i, j) : vp? PN_GET(vp, v->dtype, i + j) : x);
+
+    Py_XDECREF(src);
+    if (vp != NULL)
+        m_free(vp);
+    matrix_modified(self);
+    return 0;
+}
+
 
 
 /*
- * deallocating matrix form memory
+ * number of rows
  */
-PyAPI_FUNC(void) matrix_dealloc(MatrixObject *matrix)
+static Py_ssize_t
+matrix_length(MatrixObject *self)
 {
-    m_free(matrix->data);
-    PyObject_Del(matrix);
+    return self->rows;
 }
 
 
 
 /*
- * repr, printing the matrix
+ * owner of the data of self has n more (or less) exported buffers,
+ * writes through them are not seen, so cached results are dropped
  */
-PyAPI_FUNC(PyObject *)
-matrix_repr(MatrixObject *v)
+PyAPI_FUNC(void)
+matrix_exports(MatrixObject *self, int n)
 {
-    int i, j;
-    Float d;
-    char fstr[64];
-    PyObject *s;
-    PyObject *result;
+    owner(self)->exports += n;
+    matrix_modified(self);
+}
 
-    if (v->rows == 0 || v->cols == 0) {
-        return PyString_FromString("Matrix([])");
-    }
 
-    result = PyString_FromString("Matrix([\n");
-    for (i = 0; i < v->rows; i++) {
-        for (j = 0; j < v->cols; j++) {
-            d = v->data[i*(v->cols) + j];
-            sprintf(fstr, "   %6g", d);
-            PyString_ConcatAndDel(&result, PyString_FromString(fstr));
-        }
-        PyString_ConcatAndDel(&result, PyString_FromString("\n"));
-    }
 
-    PyString_ConcatAndDel(&result, PyString_FromString("])"));
-    return result;
+/*
+ * new buffer protocol, 2-D data with the strides of the matrix
+ */
+static int
+matrix_getbuffer(MatrixObject *self, Py_buffer *view, int flags)
+{
+    int shape[2], strides[2];
+
+    shape[0] = self->rows;
+    shape[1] = self->cols;
+    strides[0] = self->rs;
+    strides[1] = self->cs;
+    if (buffer_export((PyObject *)self, view, flags, self->data, self->dtype, 2, shape, strides, self->layout))
+        return -1;
+    matrix_exports(self, 1);
+    return 0;
+}
+
+static void
+matrix_releasebuffer(MatrixObject *self, Py_buffer *view)
+{
+    matrix_exports(self, -1);
 }
 
 
 
 /*
- * allocate memory array for matrix data
- * return 0 - success, 1 - failed
+ * old buffer protocol, contiguous data only
  */
-PyAPI_FUNC(int)
-matrix_alloc(MatrixObject *mo, int rows, int cols)
+static Py_ssize_t
+matrix_getreadbuffer(MatrixObject *self, Py_ssize_t seg, void **ptr)
 {
-    mo->data = m_new(rows, cols);
-    if (mo->data == NULL) {
-        PyErr_NoMemory();
-        return 1;
-    }
+    return buffer_segment(self->data, self->rows*self->cols*dtype_size(self->dtype),
+                          Matrix_IsContiguous(self), seg, ptr);
+}
 
-    mo->rows = rows;
-    mo->cols = cols;
+static Py_ssize_t
+matrix_getwritebuffer(MatrixObject *self, Py_ssize_t seg, void **ptr)
+{
+    matrix_modified(self);
+    return matrix_getreadbuffer(self, seg, ptr);
+}
 
-    return 0;
+static Py_ssize_t
+matrix_getsegcount(MatrixObject *self, Py_ssize_t *len)
+{
+    if (len != NULL)
+        *len = self->rows*self->cols*dtype_size(self->dtype);
+    return 1;
 }
 
 
 
 /*
- * returning matrix row
+ * Matrix of buffer data, shared unless copy is set or the buffer is
+ * read only, arguments (buffer, shape=None, dtype=None, offset=0)
  */
-PyAPI_FUNC(PyObject *)
-matrix_item(MatrixObject *a, int i)
+static PyObject *
+from_buffer(PyObject *args, PyObject *kws, char **kwlist, int copy)
 {
-    PyObject *out = NULL;
-    if (i < 0 || i >= a->rows) {
-        PyErr_SetObject(PyExc_IndexError, PyString_FromString("row index out of range"));
+    PyObject *obj, *shape_o = Py_None, *dtype_o = Py_None;
+    Py_ssize_t offset = 0, shape[2] = {-1, -1}, strides[2];
+    Py_buffer *view;
+    MatrixObject *y;
+    Float *data;
+    int dtype = -1, rows, cols;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|OOn", kwlist, &obj, &shape_o, &dtype_o, &offset))
+        return NULL;
+    if (dtype_o != Py_None && (dtype = dtype_parse(dtype_o)) < 0)
+        return NULL;
+    if (shape_o != Py_None && !PyArg_ParseTuple(shape_o, "nn;shape must be (rows, cols)", &shape[0], &shape[1]))
         return NULL;
+
+    if ((view = buffer_acquire(obj)) == NULL)
+        return NULL;
+    data = buffer_layout(view, &dtype, offset, 2, shape, strides);
+    if (data == NULL) {
+        buffer_free(view);
+        return NULL;
+    }
+    rows = shape[0];
+    cols = shape[1];
+
+    if (view->readonly || copy) {
+        y = matrix_new_dtype(rows, cols, dtype);
+        if (y != NULL) {
+            if (dtype == PN_F4)
+                mf_copy_strided(FDATA(y->data), cols, 1, FDATA(data), strides[0], strides[1], rows, cols);
+            else
+                m_copy_strided(y->data, cols, 1, data, strides[0], strides[1], rows, cols);
+        }
+        buffer_free(view);
+        return (PyObject *)y;
     }
 
-    out = (PyObject*)matrixrow2vector(a, (a->data) + i*(a->cols));
-    //TODO: is this necessary?
-    Py_INCREF(out);
+    if (buffer_aligned(data, dtype) || (y = blank(dtype)) == NULL) {
+        buffer_free(view);
+        return NULL;
+    }
+    y->data = data;
+    y->rows = rows;
+    y->cols = cols;
+    y->rs = strides[0];
+    y->cs = strides[1];
+    y->buffer = view;
 
-    return out;
+    return (PyObject *)y;
 }
 
 
 
 /*
- * comparison of two matrixes
+ * Matrix.frombuffer(buffer, shape=None, dtype=None, offset=0)
+ * Matrix sharing the memory of buffer, shape and dtype are taken from
+ * the buffer if they are not given, a read only buffer is copied
  */
-PyAPI_FUNC(int)
-matrix_cmp(MatrixObject *self, MatrixObject *other)
+PyAPI_FUNC(PyObject *)
+matrix_frombuffer(PyObject *cls, PyObject *args, PyObject *kws)
 {
-    Float *s, *o, sub, max;
-    Float eps = 1e-8;  // TODO: hope this will be enough
-    int i;
-
-    if (self->rows != other->rows || self->cols != other->cols) {
-        return 1;
-    }
+    static char *kwlist[] = {"buffer", "shape", "dtype", "offset", NULL};
 
-    s = self->data;
-    o = other->data;
-
-    for (i=0; i<(self->rows*self->cols); i++) {
-        sub = *s-*o;
-        max = MAX(*s, *o);
+    return from_buffer(args, kws, kwlist, 0);
+}
 
-        if (max != 0) {
-            sub = sub / max;
-        }
 
-        s++;
-        o++;
 
-        if (Fabs(sub) > eps) {
-            return 1;
-        }
-    }
+/*
+ * Matrix.fromstring(string, shape=None, dtype=None, offset=0)
+ * Matrix of binary data, always a copy
+ */
+PyAPI_FUNC(PyObject *)
+matrix_fromstring(PyObject *cls, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"string", "shape", "dtype", "offset", NULL};
 
-    // TODO: which matrix is bigger? (to return -1 instead of 1)
-    return 0;
+    return from_buffer(args, kws, kwlist, 1);
 }
 
 
 
 /*
- * matrix inversion
+ * Matrix.fromiter(iterable, shape, dtype=None)
+ * numbers of iterable fill the matrix row by row, rows may be -1 to
+ * take all items; the length hint of iterable sizes the data once,
+ * they grow geometrically if it is wrong
  */
 PyAPI_FUNC(PyObject *)
-matrix_inv(MatrixObject *self)
+matrix_fromiter(PyObject *cls, PyObject *args, PyObject *kws)
 {
-    MatrixObject *out;
-
-    if (self->rows != self->cols) {
-        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+    static char *kwlist[] = {"iterable", "shape", "dtype", NULL};
+    PyObject *obj, *it, *o, *dtype_o = Py_None;
+    Py_ssize_t rows, cols, n = 0, size;
+    MatrixObject *out = NULL;
+    Float *data, *p;
+    double x;
+    int dtype;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O(nn)|O", kwlist, &obj, &rows, &cols, &dtype_o))
+        return NULL;
+    if ((dtype = dtype_parse(dtype_o)) < 0)
+        return NULL;
+    if (rows < -1 || cols < 0) {
+        PyErr_SetString(PyExc_ValueError, "shape must be (rows, cols), rows may be -1");
+        return NULL;
+    }
+    if (cols > INT_MAX || (rows > 0 && cols > 0 && rows > INT_MAX/cols)) {
+        PyErr_SetString(PyExc_OverflowError, "matrix is too large, rows*cols exceeds int");
         return NULL;
     }
 
-    out = matrix_new(self->rows, self->cols);
-    m_inversion(self->data, out->data, self->rows);
-    Py_INCREF(out);
+    if (rows >= 0) {
+        out = matrix_new_dtype(rows, cols, dtype);
+        if (out == NULL)
+            return NULL;
+        data = out->data;
+        size = rows*cols;
+    } else {
+        size = _PyObject_LengthHint(obj, 64);
+        if (size < 0)
+            return NULL;
+        size = (size < 16)? 16 : size;
+        data = (Float *)PyMem_Malloc(size*dtype_size(dtype));
+        if (data == NULL)
+            return PyErr_NoMemory();
+    }
 
+    if ((it = PyObject_GetIter(obj)) == NULL)
+        goto fail;
+    while ((o = PyIter_Next(it)) != NULL) {
+        x = as_double(o);
+        Py_DECREF(o);
+        if (x == -1 && PyErr_Occurred())
+            break;
+        if (n == size) {
+            if (out != NULL) {
+                PyErr_SetString(PyExc_ValueError, "iterable is longer than the shape");
+                break;
+            }
+            p = (Float *)PyMem_Realloc(data, 2*size*dtype_size(dtype));
+            if (p == NULL) {
+                PyErr_NoMemory();
+                break;
+            }
+            data = p;
+            size *= 2;
+        }
+        PN_SET(data, dtype, n++, x);
+    }
+    Py_DECREF(it);
+    if (PyErr_Occurred())
+        goto fail;
+
+    if (out != NULL) {
+        if (n != size) {
+            PyErr_SetString(PyExc_ValueError, "iterable is shorter than the shape");
+            goto fail;
+        }
+        return (PyObject *)out;
+    }
+
+    if (cols == 0 || n % cols) {
+        PyErr_SetString(PyExc_ValueError, "number of items is not a multiple of cols");
+        goto fail;
+    }
+    if (n/cols > INT_MAX/cols) {
+        PyErr_SetString(PyExc_OverflowError, "matrix is too large, rows*cols exceeds int");
+        goto fail;
+    }
+    out = matrix_new_dtype(n/cols, cols, dtype);
+    if (out != NULL)
+        memcpy(out->data, data, n*dtype_size(dtype));
+    PyMem_Free(data);
     return (PyObject *)out;
+
+fail:
+    if (out != NULL)
+        Py_DECREF(out);
+    else
+        PyMem_Free(data);
+    return NULL;
 }
 
 
 
 /*
- * return determinant
+ * Matrix.mmap(path, rows=-1, cols=1, mode='r', dtype=None, offset=0)
+ * Matrix backed by a file of row major items from offset bytes, only
+ * the pages in use are resident. Mode 'r' (or 'c') keeps the file
+ * unchanged, changes stay in memory; 'r+' writes changes to the file;
+ * 'w+' creates or extends the file to the shape. rows = -1 takes all
+ * rows of the file. offset must be a multiple of the item size and
+ * rows*cols must fit an int.
  */
 PyAPI_FUNC(PyObject *)
-matrix_det(MatrixObject *self)
+matrix_mmap(PyObject *cls, PyObject *args, PyObject *kws)
 {
-    Float det;
+    static char *kwlist[] = {"path", "rows", "cols", "mode", "dtype", "offset", NULL};
+    char *path, *mode = "r";
+    PyObject *dtype_o = Py_None;
+    Py_ssize_t rows = -1, cols = 1, offset = 0;
+    int dtype;
+#ifdef PN_HAVE_MMAP
+    MatrixObject *y;
+    struct stat st;
+    size_t row, size, start;
+    void *p;
+    int fd, oflags, share;
+#endif
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "s|nnsOn", kwlist, &path, &rows, &cols, &mode, &dtype_o, &offset))
+        return NULL;
+    if ((dtype = dtype_parse(dtype_o)) < 0)
+        return NULL;
 
-    if (self->rows != self->cols) {
-        PyErr_SetString(PyExc_ValueError, "not a square matrix");
+#ifdef PN_HAVE_MMAP
+    if (!strcmp(mode, "r") || !strcmp(mode, "c")) {
+        // copy on write, no swap is reserved for pages never written
+        oflags = O_RDONLY;
+        share = MAP_PRIVATE;
+#ifdef MAP_NORESERVE
+        share |= MAP_NORESERVE;
+#endif
+    } else if (!strcmp(mode, "r+")) {
+        oflags = O_RDWR;
+        share = MAP_SHARED;
+    } else if (!strcmp(mode, "w+")) {
+        oflags = O_RDWR | O_CREAT;
+        share = MAP_SHARED;
+    } else {
+        PyErr_SetString(PyExc_ValueError, "mode must be 'r', 'c', 'r+' or 'w+'");
+        return NULL;
+    }
+    if (cols <= 0 || rows < -1 || offset < 0 || (rows < 0 && (oflags & O_CREAT))) {
+        PyErr_SetString(PyExc_ValueError, "rows and cols must be positive, rows may be -1 for an existing file");
+        return NULL;
+    }
+    if (offset % dtype_size(dtype)) {
+        PyErr_SetString(PyExc_ValueError, "offset must be a multiple of the item size");
         return NULL;
     }
 
-    det = m_det(self->data, self->rows);
-    return PyFloat_FromDouble(det);
+    fd = open(path, oflags, 0666);
+    if (fd < 0)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+    if (fstat(fd, &st) < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+        close(fd);
+        return NULL;
+    }
+
+    row = cols*dtype_size(dtype);
+    if (rows < 0) {
+        if (st.st_size < offset || (st.st_size - offset) % row) {
+            PyErr_SetString(PyExc_ValueError, "file size is not a multiple of the row size");
+            close(fd);
+            return NULL;
+        }
+        rows = (st.st_size - offset)/row;
+    }
+    if (cols > INT_MAX || rows > INT_MAX/cols) {
+        PyErr_SetString(PyExc_OverflowError, "matrix is too large, rows*cols exceeds int");
+        close(fd);
+        return NULL;
+    }
+    size = offset + rows*row;
+    if ((size_t)st.st_size < size) {
+        if (!(oflags & O_CREAT)) {
+            PyErr_SetString(PyExc_ValueError, "file is shorter than the shape");
+            close(fd);
+            return NULL;
+        }
+        if (ftruncate(fd, size) < 0) {
+            PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+            close(fd);
+            return NULL;
+        }
+    }
+    if (rows == 0) {
+        close(fd);
+        return (PyObject *)matrix_new_dtype(0, cols, dtype);
+    }
+
+    // the mapping starts at a page boundary
+    start = offset - offset % sysconf(_SC_PAGESIZE);
+    p = mmap(NULL, size - start, PROT_READ | PROT_WRITE, share, fd, start);
+    close(fd);
+    if (p == MAP_FAILED)
+        return PyErr_SetFromErrnoWithFilename(PyExc_IOError, path);
+
+    y = blank(dtype);
+    if (y == NULL) {
+        munmap(p, size - start);
+        return NULL;
+    }
+    y->data = (Float *)((char *)p + (offset - start));
+    y->rows = rows;
+    y->cols = cols;
+    y->rs = cols;
+    y->map = p;
+    y->map_size = size - start;
+
+    return (PyObject *)y;
+#else
+    PyErr_SetString(PyExc_NotImplementedError, "memory mapped files are not supported on this platform");
+    return NULL;
+#endif
 }
 
 
 
 /*
- * matrix add
+ * the data of self are going to be read once from start to end, the
+ * kernel reads a file mapping ahead and drops the pages behind early
  */
-PyAPI_FUNC(PyObject *)
-matrix_add(MatrixObject *self, MatrixObject *other)
+PyAPI_FUNC(void)
+matrix_stream(MatrixObject *self)
 {
-    MatrixObject *out;
-
-    if (self->rows==0 && self->cols==0) { // first matrix is scalar
-        out = matrix_new(other->rows, other->cols);
-        m_add_scalar(*(self->data), other->data, out->data, other->rows, other->cols);
-    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
-        out = matrix_new(self->rows, self->cols);
-        m_add_scalar(*(other->data), self->data, out->data, self->rows, self->cols);
-    } else {
-        if (self->rows != other->rows && self->cols != other->cols) {
-            PyErr_SetString(PyExc_ValueError, "Matrixes are not aligned");
-            return NULL;
-        }
-        out = matrix_new(self->rows, other->cols);
-        m_add(self->data, other->data, out->data, self->rows, self->cols);
-    }
+#if defined(PN_HAVE_MMAP) && defined(MADV_SEQUENTIAL)
+    MatrixObject *o = owner(self);
 
-    Py_INCREF(out);
-    return (PyObject*)out;
+    if (o->map != NULL)
+        madvise(o->map, o->map_size, MADV_SEQUENTIAL);
+#endif
 }
 
 
 
 /*
- * matrix negative
+ * rows, cols and data of a block of vstack() or hstack(), a Vector is
+ * a row for vstack and a column for hstack
+ * return 0 - success, -1 - not a Matrix or Vector
  */
-PyAPI_FUNC(PyObject *)
-matrix_negative(MatrixObject *self)
+static int
+block(PyObject *o, int vertical, int *rows, int *cols, int *rs, int *cs, Float **data, int *dtype)
 {
-    MatrixObject *out;
-
-    out = matrix_new(self->rows, self->cols);
-    m_copy(out->data, self->data, self->rows, self->cols);
-    m_scale(-1, out->data, out->rows, out->cols);
-    Py_INCREF(out);
-    return (PyObject*)out;
+    MatrixObject *m;
+    VectorObject *v;
+
+    if (Matrix_Check(o)) {
+        m = (MatrixObject *)o;
+        *rows = m->rows;
+        *cols = m->cols;
+        *rs = m->rs;
+        *cs = m->cs;
+        *data = m->data;
+        *dtype = m->dtype;
+        return 0;
+    }
+    if (Vector_Check(o)) {
+        v = (VectorObject *)o;
+        *rows = vertical? 1 : vector_length(v);
+        *cols = vertical? vector_length(v) : 1;
+        *rs = vertical? 0 : v->stride;
+        *cs = vertical? v->stride : 0;
+        *data = vector_dataptr(v);
+        *dtype = v->dtype;
+        return 0;
+    }
+    PyErr_SetString(PyExc_TypeError, "only Matrix and Vector can be stacked");
+    return -1;
 }
 
 
 
 /*
- * matrix subtraction
+ * Matrix of the blocks of seq, one below another or side by side
  */
-PyAPI_FUNC(PyObject *)
-matrix_sub(MatrixObject *self, MatrixObject *other)
+static PyObject *
+stack(PyObject *seq, int vertical)
 {
-    MatrixObject *out;
-    Float *tmp;
+    PyObject *fast;
+    MatrixObject *out = NULL;
+    Float *data, *dst;
+    Py_ssize_t i, n;
+    int rows = 0, cols = 0, r, c, rs, cs, dtype, first = -1, at = 0;
+
+    fast = PySequence_Fast(seq, "argument must be a sequence of Matrix or Vector");
+    if (fast == NULL)
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(fast);
+    if (n == 0) {
+        PyErr_SetString(PyExc_ValueError, "nothing to stack");
+        goto done;
+    }
 
-    if (self->rows==0 && self->cols==0) { // first matrix is scalar
-        out = matrix_new(other->rows, other->cols);
-        tmp = m_new(other->rows, other->cols);
-        m_copy(tmp, other->data, other->rows, other->cols);
-        m_scale(-1, tmp, other->rows, other->cols);
-        m_add_scalar(*(self->data), tmp, out->data, other->rows, other->cols);
-        m_free(tmp);
-    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
-        out = matrix_new(self->rows, self->cols);
-        m_add_scalar(-*(other->data), self->data, out->data, self->rows, self->cols);
-    } else {
-        if (self->rows != other->rows && self->cols != other->cols) {
+    // the shape first, data are copied once
+    for (i=0; i<n; i++) {
+        if (block(PySequence_Fast_GET_ITEM(fast, i), vertical, &r, &c, &rs, &cs, &data, &dtype))
+            goto done;
+        if (i == 0) {
+            first = dtype;
+            rows = vertical? 0 : r;
+            cols = vertical? c : 0;
+        }
+        if (dtype != first) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            goto done;
+        }
+        if ((vertical && c != cols) || (!vertical && r != rows)) {
             PyErr_SetString(PyExc_ValueError, "Matrixes are not aligned");
-            return NULL;
+            goto done;
         }
+        if (vertical)
+            rows += r;
+        else
+            cols += c;
+    }
 
-        out = matrix_new(self->rows, other->cols);
-        m_sub(self->data, other->data, out->data, self->rows, self->cols);
+    out = matrix_new_dtype(rows, cols, first);
+    if (out == NULL)
+        goto done;
+    for (i=0; i<n; i++) {
+        block(PySequence_Fast_GET_ITEM(fast, i), vertical, &r, &c, &rs, &cs, &data, &dtype);
+        dst = PN_PTR(out->data, dtype, vertical? at*cols : at);
+        if (dtype == PN_F4)
+            mf_copy_strided(FDATA(dst), cols, 1, FDATA(data), rs, cs, r, c);
+        else
+            m_copy_strided(dst, cols, 1, data, rs, cs, r, c);
+        at += vertical? r : c;
     }
 
-    Py_INCREF(out);
-    return (PyObject*)out;
+done:
+    Py_DECREF(fast);
+    return (PyObject *)out;
 }
 
 
 
 /*
- * matrix multiply
+ * pnumeric.vstack(seq), matrices and vectors (rows) one below another
  */
 PyAPI_FUNC(PyObject *)
-matrix_mul(MatrixObject *self, MatrixObject *other)
+matrix_vstack(PyObject *self, PyObject *seq)
 {
-    MatrixObject *out;
-    DEBUG(" Matrix multiply\n");
+    return stack(seq, 1);
+}
 
-    if (self->rows==0 && self->cols==0) { // first matrix is scalar
-        out = matrix_new(other->rows, other->cols);
-        m_copy(out->data, other->data, other->rows, other->cols);
-        m_scale(*(self->data), out->data, other->rows, other->cols);
-    } else if (other->rows==0 && other->cols==0) { // second matrix is scalar
-        out = matrix_new(self->rows, self->cols);
-        m_copy(out->data, self->data, self->rows, self->cols);
-        m_scale(*(other->data), out->data, self->rows, self->cols);
-    } else {
-        out = matrix_new(self->rows, other->cols);
-        if (self == NULL) {
-            PyErr_NoMemory();
-            return NULL;
-        }
-        if (self->rows != other->cols) {
-            PyErr_SetString(PyExc_ValueError, "Matrixes not aligned");
-            return NULL;
-        }
-        m_mul(self->data, other->data, out->data, self->rows, self->cols, other->cols);
-    }
 
-    Py_INCREF(out);
-    return (PyObject*)out;
+
+/*
+ * pnumeric.hstack(seq), matrices and vectors (columns) side by side
+ */
+PyAPI_FUNC(PyObject *)
+matrix_hstack(PyObject *self, PyObject *seq)
+{
+    return stack(seq, 0);
 }
 
 
@@ -315,6 +2067,21 @@ matrix_mul(MatrixObject *self, MatrixObject *other)
 PyMethodDef MatrixObject_methods[] = {
     {"inv", (PyCFunction)matrix_inv, METH_NOARGS, "matrix inversion"},
     {"det", (PyCFunction)matrix_det, METH_NOARGS, "determinant of matrix"},
+    {"solve", (PyCFunction)matrix_solve, METH_O, "solve self * x = b"},
+    {"cholesky", (PyCFunction)matrix_cholesky, METH_NOARGS, "Cholesky factor L, self = L * L'"},
+    {"astype", (PyCFunction)matrix_astype, METH_VARARGS, "copy converted to dtype 'f8' or 'f4'"},
+    {"transpose", (PyCFunction)matrix_transpose, METH_NOARGS, "transposed view sharing the data"},
+    {"copy", (PyCFunction)matrix_copy, METH_NOARGS, "contiguous copy"},
+    {"sandwich", (PyCFunction)matrix_sandwich, METH_VARARGS, "self * P * self' (+ Q) for symmetric P, Q need not be symmetric"},
+    {"frombuffer", (PyCFunction)matrix_frombuffer, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "Matrix sharing the memory of a buffer object"},
+    {"fromstring", (PyCFunction)matrix_fromstring, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "Matrix of binary data"},
+    {"fromiter", (PyCFunction)matrix_fromiter, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "Matrix of the numbers of an iterable"},
+    {"mmap", (PyCFunction)matrix_mmap, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "Matrix backed by a memory mapped file"},
+    {"__reduce__", (PyCFunction)serial_reduce, METH_NOARGS, "pickle support, raw data of dumps()"},
     {NULL}  /* Sentinel */
 };
 
@@ -339,12 +2106,20 @@ matrix_getattr(MatrixObject *self, char *name)
     else if (!strcmp(name, "cols")) {
         result = PyInt_FromLong(self->cols);
     }
+    else if (!strcmp(name, "dtype")) {
+        result = PyString_FromString(dtype_name(self->dtype));
+    }
+    else if (!strcmp(name, "T")) {
+        result = matrix_transpose(self);
+    }
     else  if (strcmp(name, "__members__") == 0) {
-        result = PyList_New(3);
+        result = PyList_New(5);
         if (result) {
             PyList_SetItem(result, 0, PyString_FromString("shape"));
             PyList_SetItem(result, 1, PyString_FromString("rows"));
             PyList_SetItem(result, 2, PyString_FromString("cols"));
+            PyList_SetItem(result, 3, PyString_FromString("dtype"));
+            PyList_SetItem(result, 4, PyString_FromString("T"));
             if (PyErr_Occurred()) {
                 Py_DECREF(result);
                 result = NULL;
@@ -406,16 +2181,23 @@ matrix_coerce(MatrixObject **v, PyObject **w)
  */
 PyAPI_FUNC(MatrixObject *)
 matrix_new(int rows, int cols)
+{
+    return matrix_new_dtype(rows, cols, PN_F8);
+}
+
+
+
+/*
+ * create a new emtpy matrix object with given dtype
+ */
+PyAPI_FUNC(MatrixObject *)
+matrix_new_dtype(int rows, int cols, int dtype)
 {
     MatrixObject *y=NULL;
 
-    y = (MatrixObject *) PyMem_Malloc(sizeof(MatrixType));
-    if (y == NULL) {
-        PyErr_SetString(PyExc_MemoryError, "Can't allocate memory for Matrix");
+    y = blank(dtype);
+    if (y == NULL)
         return NULL;
-    }
-
-    PyObject_Init((PyObject *)y, &MatrixType);
     if (matrix_alloc(y, rows, cols)) {
         PyErr_SetString(PyExc_MemoryError, "Can't allocate memory for Matrix data");
         Py_DECREF(y);
@@ -438,22 +2220,25 @@ matrix_new(int rows, int cols)
  * 0 0 0 1
  */
 PyAPI_FUNC(MatrixObject *)
-matrix_eye(PyObject *self, PyObject *args)
+matrix_eye(PyObject *self, PyObject *args, PyObject *kws)
 {
-    int i;
+    int i, dtype;
     long size;
     MatrixObject *result;
+    PyObject *o_dtype = NULL;
+    static char *kwlist[] = {"size", "dtype", NULL};
 
-    if (!PyArg_ParseTuple(args, "l", &size)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "l|O", kwlist, &size, &o_dtype)) {
         return (MatrixObject*)Py_None;
     }
+    if ((dtype = dtype_parse(o_dtype)) < 0)
+        return NULL;
 
-    result = matrix_new(size, size);
+    result = matrix_new_dtype(size, size, dtype);
     if (!result) return (MatrixObject*)Py_None;
-    m_set0(result->data, size, size);
 
-    for (i=0; i<size; i++) {
-        *(result->data + i*size + i) = 1.0;
+    for (i=0; i<size*size; i++) {
+        PN_SET(result->data, dtype, i, (i % (size+1) == 0)? 1.0 : 0.0);
     }
 
     return result;
@@ -465,21 +2250,29 @@ matrix_eye(PyObject *self, PyObject *args)
  * retun new matrix object with ones at all positions
  */
 PyAPI_FUNC(MatrixObject *)
-matrix_ones(PyObject *self, PyObject *args)
+matrix_ones(PyObject *self, PyObject *args, PyObject *kws)
 {
     long size;
+    int dtype;
     MatrixObject *result;
+    PyObject *o_dtype = NULL;
+    static char *kwlist[] = {"size", "dtype", NULL};
 
-    if (!PyArg_ParseTuple(args, "l", &size)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "l|O", kwlist, &size, &o_dtype)) {
         return (MatrixObject*)Py_None;
     }
+    if ((dtype = dtype_parse(o_dtype)) < 0)
+        return NULL;
 
-    result = matrix_new(size, size);
+    result = matrix_new_dtype(size, size, dtype);
 
     if (!result)
         return (MatrixObject*)Py_None;
 
-    m_set1(result->data, size, size);
+    if (dtype == PN_F4)
+        mf_set1(FDATA(result->data), size, size);
+    else
+        m_set1(result->data, size, size);
     return result;
 }
 
@@ -489,27 +2282,27 @@ matrix_ones(PyObject *self, PyObject *args)
  * create new MatrixObject from list (tuple)
  */
 PyAPI_FUNC(PyObject *)
-MatrixObject_New(PyTypeObject *type, PyObject *args)
+MatrixObject_New(PyTypeObject *type, PyObject *args, PyObject *kws)
 {
     MatrixObject *self;
     PyObject *item=NULL, *w=NULL;
-    int i, cols=0, rows=0;
-    PyObject * (*getitem)(PyObject *, int);
-    PyObject *listObject;
+    int i, cols=0, rows=0, dtype;
+    PyObject *listObject, *o_dtype = NULL;
+    static char *kwlist[] = {"data", "dtype", NULL};
 
-    if (!PyArg_ParseTuple(args, "O", &listObject)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|O", kwlist, &listObject, &o_dtype)) {
         PyErr_BadArgument();
         return NULL;
     }
+    if ((dtype = dtype_parse(o_dtype)) < 0)
+        return NULL;
 
     // [0]
-    if (PyList_Check(listObject)) {
-        rows = PyList_Size(listObject);
-        getitem = PyList_GetItem;
-    } else if (PyTuple_Check(listObject)) {
-        rows = PyTuple_Size(listObject);
-        getitem = PyTuple_GetItem;
+    if (PyList_Check(listObject) || PyTuple_Check(listObject)) {
+        rows = PySequence_Fast_GET_SIZE(listObject);
     } else if (listObject->ob_type == &MatrixType) {
+        if (o_dtype != NULL && dtype != ((MatrixObject *)listObject)->dtype)
+            return convert((MatrixObject *)listObject, dtype);
         Py_INCREF(listObject);
         return listObject;
     } else {
@@ -522,29 +2315,31 @@ MatrixObject_New(PyTypeObject *type, PyObject *args)
     }
 
     // [0][0]
-    item = (*getitem)(listObject, 0);
-    if (PyList_Check(item)) {
-        cols = PyList_Size(item);
-    } else if (PyTuple_Check(item)) {
-        cols = PyTuple_Size(item);
+    item = PySequence_Fast_GET_ITEM(listObject, 0);
+    if (PyList_Check(item) || PyTuple_Check(item)) {
+        cols = PySequence_Fast_GET_SIZE(item);
     } else {
         PyErr_BadArgument();
         return NULL;
     }
 
-    self = matrix_new(rows, cols);
+    self = matrix_new_dtype(rows, cols, dtype);
     if (self == NULL) {
         PyErr_NoMemory();
         return NULL;
     }
 
-    if (cols > 0) {
-        for (i=0; i<rows; i++) {
-            w = (*getitem)(listObject, i);
-            if (!PyArg_GetDoubleArray(w, 1, 0, cols, self->data+cols*i)) {
-                PyErr_BadArgument();
-                return NULL;
-            }
+    // rows of numbers are read directly, not item by item through PyArg_
+    for (i=0; i<rows; i++) {
+        w = PySequence_Fast_GET_ITEM(listObject, i);
+        if (!(PyList_Check(w) || PyTuple_Check(w)) || PySequence_Fast_GET_SIZE(w) != cols) {
+            Py_DECREF(self);
+            PyErr_BadArgument();
+            return NULL;
+        }
+        if (dtype_fill(PN_PTR(self->data, dtype, i*cols), dtype, w)) {
+            Py_DECREF(self);
+            return NULL;
         }
     }
 
@@ -558,21 +2353,29 @@ MatrixObject_New(PyTypeObject *type, PyObject *args)
  * retun new matrix object with zeros at all positions
  */
 PyAPI_FUNC(MatrixObject *)
-matrix_zeros(PyObject *self, PyObject *args)
+matrix_zeros(PyObject *self, PyObject *args, PyObject *kws)
 {
     long size;
+    int dtype;
     MatrixObject *result;
+    PyObject *o_dtype = NULL;
+    static char *kwlist[] = {"size", "dtype", NULL};
 
-    if (!PyArg_ParseTuple(args, "l", &size)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "l|O", kwlist, &size, &o_dtype)) {
         return (MatrixObject*)Py_None;
     }
+    if ((dtype = dtype_parse(o_dtype)) < 0)
+        return NULL;
 
-    result = matrix_new(size, size);
+    result = matrix_new_dtype(size, size, dtype);
 
     if (!result)
         return (MatrixObject*)Py_None;
 
-    m_set0(result->data, size, size);
+    if (dtype == PN_F4)
+        mf_set0(FDATA(result->data), size, size);
+    else
+        m_set0(result->data, size, size);
     return result;
 }
 
@@ -593,6 +2396,14 @@ PyAPI_DATA(PySequenceMethods) matrix_as_sequence = {
 
 
 
+static PyMappingMethods matrix_as_mapping = {
+    (lenfunc)matrix_length,                 /* mp_length */
+    (binaryfunc)matrix_subscript,           /* mp_subscript */
+    (objobjargproc)matrix_ass_subscript,    /* mp_ass_subscript */
+};
+
+
+
 PyAPI_DATA(PyNumberMethods) matrix_as_number = {
     (binaryfunc)matrix_add,          /*nb_add*/
     (binaryfunc)matrix_sub,          /*nb_subtract*/
@@ -620,10 +2431,10 @@ PyAPI_DATA(PyNumberMethods) matrix_as_number = {
     0,//matrix_hex,              /* nb_hex */
     /*This code adds augmented assignment functionality*/
     /*that was made available in Python 2.0*/
-    0,//(binaryfunc)matrix_add,          /*inplace_add*/
-    0,//(binaryfunc)array_inplace_subtract,     /*inplace_subtract*/
-    0,//(binaryfunc)matrix_inplace_multiply,     /*inplace_multiply*/
-    0,//(binaryfunc)array_inplace_divide,       /*inplace_divide*/
+    (binaryfunc)matrix_inplace_add,  /*inplace_add*/
+    (binaryfunc)matrix_inplace_sub,  /*inplace_subtract*/
+    (binaryfunc)matrix_inplace_mul,  /*inplace_multiply*/
+    (binaryfunc)matrix_inplace_div,  /*inplace_divide*/
     0,//(binaryfunc)array_inplace_remainder,    /*inplace_remainder*/
     0,//(ternaryfunc)array_inplace_power,       /*inplace_power*/
     0,//(binaryfunc)array_inplace_lshift,       /*inplace_lshift*/
@@ -631,6 +2442,21 @@ PyAPI_DATA(PyNumberMethods) matrix_as_number = {
     0,//(binaryfunc)array_inplace_bitwise_and,  /*inplace_and*/
     0,//(binaryfunc)array_inplace_bitwise_xor,  /*inplace_xor*/
     0,//(binaryfunc)array_inplace_bitwise_or,   /*inplace_or*/
+    0,                               /*nb_floor_divide*/
+    0,                               /*nb_true_divide*/
+    0,                               /*nb_inplace_floor_divide*/
+    (binaryfunc)matrix_inplace_div,  /*nb_inplace_true_divide*/
+};
+
+
+
+static PyBufferProcs matrix_as_buffer = {
+    (readbufferproc)matrix_getreadbuffer,   /* bf_getreadbuffer */
+    (writebufferproc)matrix_getwritebuffer, /* bf_getwritebuffer */
+    (segcountproc)matrix_getsegcount,       /* bf_getsegcount */
+    (charbufferproc)matrix_getreadbuffer,   /* bf_getcharbuffer */
+    (getbufferproc)matrix_getbuffer,        /* bf_getbuffer */
+    (releasebufferproc)matrix_releasebuffer,/* bf_releasebuffer */
 };
 
 
@@ -649,14 +2475,14 @@ PyAPI_DATA(PyTypeObject) MatrixType = {
     (reprfunc)matrix_repr,      /*tp_repr*/
     &matrix_as_number,          /*tp_as_number*/
     &matrix_as_sequence,        /*tp_as_sequence*/
-    0,                          /*tp_as_mapping*/
+    &matrix_as_mapping,         /*tp_as_mapping*/
     0,                          /*tp_hash */
     0,                          /*tp_call*/
     (reprfunc)matrix_repr,       /*tp_str*/
     0,//(getattrofunc)matrix_getattr,/*tp_getattro*/
     0,//(setattrofunc)0,            /*tp_setattro*/
-    0,                          /*tp_as_buffer*/
-    Py_TPFLAGS_DEFAULT,         /*tp_flags*/
+    &matrix_as_buffer,          /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /*tp_flags*/
     "Matrix object",            /* tp_doc */
     0,                          /* tp_traverse */
     0,                          /* tp_clear */
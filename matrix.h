@@ -29,43 +29,141 @@
 #include "Python.h"
 #include "m2/m2.h"
 
+// element types of Matrix and Vector data
+#define PN_F8 0 // double, 'f8'
+#define PN_F4 1 // float, 'f4', data points to float array
+
 typedef struct {
     PyObject_HEAD
-    Float *data;
+    Float *data;   // element [0][0], for a view this is base data + offset
     int rows;
     int cols;
+    int dtype;     // PN_F8 or PN_F4
+
+    // element [i][j] is at data[i*rs + j*cs], rs == cols and cs == 1
+    // unless the matrix is a view (transpose, slice, column)
+    int rs;
+    int cs;
+    PyObject *base;        // matrix owning the data of a view, NULL if data are own
+    unsigned long version; // bumped by matrix_modified() on the owner
+    Py_buffer *buffer;     // memory of another object wrapped by frombuffer(), owner only
+    int exports;           // buffers of the owner data held by other objects
+    Py_ssize_t layout[4];  // shape and strides in bytes of exported buffers
+    void *map;             // file mapping of Matrix.mmap(), owner only
+    size_t map_size;
+
+    // LU factorization cache, see matrix_lu(), NULL until first used
+    Float *lu;
+    int *lu_pr;    // row permutation
+    int lu_per;    // permutation sign
+    int lu_status; // m_LU return value
+    unsigned long lu_version; // owner version the cache was made for
 } MatrixObject;
 
 PyAPI_DATA(PyTypeObject) MatrixType;
 
 #define Matrix_Check(op) PyObject_TypeCheck(op, &MatrixType)
+// data are one row major block, usable by the plain m2 routines
+#define Matrix_IsContiguous(m) ((m)->cs == 1 && ((m)->rs == (m)->cols || (m)->rows <= 1))
+
+// dtype from Python object ('f8', 'f4', ...), -1 and exception if unknown
+int dtype_parse(PyObject *o);
+// dtype name, 'f8' or 'f4'
+const char *dtype_name(int dtype);
+// size of one element in bytes
+size_t dtype_size(int dtype);
+// convert n elements between dtypes
+void dtype_convert(void *dst, int dst_dtype, const void *src, int src_dtype, int n);
+
+// operations of dtype_update()
+#define PN_IADD 0
+#define PN_ISUB 1
+#define PN_IMUL 2
+// a[i*inc] op= b[i], or op= x if b is NULL, for n elements of dtype
+void dtype_update(Float *a, int inc, int op, const Float *b, Float x, int n, int dtype);
+// items of list or tuple seq to data of dtype, 0 - success, -1 - error
+int dtype_fill(Float *data, int dtype, PyObject *seq);
 
 // create a new emtpy matrix object
 PyAPI_FUNC(MatrixObject *) matrix_new(int rows, int cols);
+// create a new emtpy matrix object with given dtype
+PyAPI_FUNC(MatrixObject *) matrix_new_dtype(int rows, int cols, int dtype);
+// copy of the matrix converted to dtype
+PyAPI_FUNC(PyObject *) matrix_astype(MatrixObject *self, PyObject *args);
 // deallocating matrix form memory
 PyAPI_FUNC(void) matrix_dealloc(MatrixObject *matrix);
 // repr, printing the matrix
 PyAPI_FUNC(PyObject *) matrix_repr(MatrixObject *v);
+// LU factorization of square matrix, cached until the data change
+PyAPI_FUNC(int) matrix_lu(MatrixObject *self);
+// drop cached results after the matrix data were changed
+PyAPI_FUNC(void) matrix_modified(MatrixObject *self);
+// view sharing the data of self, element [i][j] is self[r0 + i*dr][c0 + j*dc]
+PyAPI_FUNC(MatrixObject *) matrix_view(MatrixObject *self, int r0, int c0, int rows, int cols, int dr, int dc);
+// transposed view
+PyAPI_FUNC(PyObject *) matrix_transpose(MatrixObject *self);
+// contiguous copy
+PyAPI_FUNC(PyObject *) matrix_copy(MatrixObject *self);
+// owner of the data of self has n more (or less) exported buffers
+PyAPI_FUNC(void) matrix_exports(MatrixObject *self, int n);
+// Matrix.frombuffer(buffer, shape, dtype, offset), no data are copied
+PyAPI_FUNC(PyObject *) matrix_frombuffer(PyObject *cls, PyObject *args, PyObject *kws);
+// Matrix.fromstring(string, shape, dtype, offset), copy of binary data
+PyAPI_FUNC(PyObject *) matrix_fromstring(PyObject *cls, PyObject *args, PyObject *kws);
+// Matrix.fromiter(iterable, shape, dtype), rows may be -1
+PyAPI_FUNC(PyObject *) matrix_fromiter(PyObject *cls, PyObject *args, PyObject *kws);
+// Matrix.mmap(path, rows, cols, mode, dtype, offset), data in a mapped file
+PyAPI_FUNC(PyObject *) matrix_mmap(PyObject *cls, PyObject *args, PyObject *kws);
+// hint that the data of self are going to be read once in order
+PyAPI_FUNC(void) matrix_stream(MatrixObject *self);
+// pnumeric.vstack(seq), matrices and vectors (rows) one below another
+PyAPI_FUNC(PyObject *) matrix_vstack(PyObject *self, PyObject *seq);
+// pnumeric.hstack(seq), matrices and vectors (columns) side by side
+PyAPI_FUNC(PyObject *) matrix_hstack(PyObject *self, PyObject *seq);
+// copy elements into row major array dst of the matrix dtype
+PyAPI_FUNC(void) matrix_pack(MatrixObject *self, Float *dst);
 // allocate memory array for matrix data
 PyAPI_FUNC(int) matrix_alloc(MatrixObject *mo, int rows, int cols);
 // returning matrix row
 PyAPI_FUNC(PyObject *) matrix_item(MatrixObject *a, int i);
+// m[i], m[i, j], m[r0:r1, c0:c1], m[:, j]
+PyAPI_FUNC(PyObject *) matrix_subscript(MatrixObject *self, PyObject *key);
 // comparison of two matrixes
 PyAPI_FUNC(int) matrix_cmp(MatrixObject *self, MatrixObject *other);
 // matrix inversion
 PyAPI_FUNC(PyObject *) matrix_inv(MatrixObject *self);
+// Cholesky factor of symmetric positive definite matrix
+PyAPI_FUNC(PyObject *) matrix_cholesky(MatrixObject *self);
 // return determinant
 PyAPI_FUNC(PyObject *) matrix_det(MatrixObject *self);
+// solve self * x = b, b is Matrix or Vector
+PyAPI_FUNC(PyObject *) matrix_solve(MatrixObject *self, PyObject *b);
+// pnumeric.solve(A, b)
+PyAPI_FUNC(PyObject *) matrix_solve_func(PyObject *self, PyObject *args);
 // matrix add
 PyAPI_FUNC(PyObject *) matrix_add(MatrixObject *self, MatrixObject *other);
 // matrix negative
 PyAPI_FUNC(PyObject *) matrix_negative(MatrixObject *self);
 // matrix subtraction
 PyAPI_FUNC(PyObject *) matrix_sub(MatrixObject *self, MatrixObject *other);
+// self += other, other is a number or Matrix
+PyAPI_FUNC(PyObject *) matrix_inplace_add(MatrixObject *self, PyObject *other);
+// self -= other, other is a number or Matrix
+PyAPI_FUNC(PyObject *) matrix_inplace_sub(MatrixObject *self, PyObject *other);
+// self *= number
+PyAPI_FUNC(PyObject *) matrix_inplace_mul(MatrixObject *self, PyObject *other);
+// self /= number
+PyAPI_FUNC(PyObject *) matrix_inplace_div(MatrixObject *self, PyObject *other);
 // matrix multiply
 PyAPI_FUNC(PyObject *) matrix_mul(MatrixObject *self, MatrixObject *other);
+// self * P * self' (+ Q) for symmetric P
+PyAPI_FUNC(PyObject *) matrix_sandwich(MatrixObject *self, PyObject *args);
+// pnumeric.dot(A, B, transA, transB)
+PyAPI_FUNC(PyObject *) matrix_dot(PyObject *self, PyObject *args, PyObject *kws);
+// pnumeric.gemm(alpha, A, B, beta, C, transA, transB), C updated in place
+PyAPI_FUNC(PyObject *) matrix_gemm(PyObject *self, PyObject *args, PyObject *kws);
 // create new MatrixObject from list (tuple)
-PyAPI_FUNC(PyObject *) MatrixObject_New(PyTypeObject *type, PyObject *args);
+PyAPI_FUNC(PyObject *) MatrixObject_New(PyTypeObject *type, PyObject *args, PyObject *kws);
 // return attribute value
 PyAPI_FUNC(PyObject *) matrix_getattr(MatrixObject *self, char *name);
 // a little hack - make a 0x0 matrix data set to value
@@ -73,11 +171,11 @@ MatrixObject * PyFloat2matrix(const Float value);
 // to decide, if we can make arithmetic operation on current datatypes
 int matrix_coerce(MatrixObject **v, PyObject **w);
 // return eye matrix of given dimensions. Example of 4-dim eye:
-PyAPI_FUNC(MatrixObject *) matrix_eye(PyObject *self, PyObject *args);
+PyAPI_FUNC(MatrixObject *) matrix_eye(PyObject *self, PyObject *args, PyObject *kws);
 // retun new matrix object with ones at all positions
-PyAPI_FUNC(MatrixObject *) matrix_ones(PyObject *self, PyObject *args);
+PyAPI_FUNC(MatrixObject *) matrix_ones(PyObject *self, PyObject *args, PyObject *kws);
 // retun new matrix object with zeros at all positions
-PyAPI_FUNC(MatrixObject *) matrix_zeros(PyObject *self, PyObject *args);
+PyAPI_FUNC(MatrixObject *) matrix_zeros(PyObject *self, PyObject *args, PyObject *kws);
 
 
 #endif /* matrix.h */
@@ -34,6 +34,58 @@
 
 
 
+/*
+ * the routines below work in double precision only
+ */
+static int
+require_f8(PyObject *o)
+{
+    int dtype = Matrix_Check(o)? ((MatrixObject *)o)->dtype : ((VectorObject *)o)->dtype;
+
+    if (dtype != PN_F8) {
+        PyErr_SetString(PyExc_TypeError, "float32 data not supported, convert with astype('f8')");
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/*
+ * the Kalman filter reads the matrixes as plain row major arrays
+ */
+static int
+require_contiguous(MatrixObject *m)
+{
+    if (!Matrix_IsContiguous(m)) {
+        PyErr_SetString(PyExc_ValueError, "Matrix view not supported, make a copy with copy()");
+        return 1;
+    }
+    return 0;
+}
+
+
+
+/*
+ * a mapped file under o is going to be read once in order
+ */
+static void
+stream(PyObject *o)
+{
+    if (Vector_Check(o))
+        o = ((VectorObject *)o)->object;
+    if (o != NULL && Matrix_Check(o))
+        matrix_stream((MatrixObject *)o);
+}
+
+
+
+// samples of y and u reordered for the filter at once, so they are
+// never copied whole and a file mapped log streams through
+#define KF_CHUNK 1024
+
+
+
 /*
  * Kalman filter process
  */
@@ -41,15 +93,17 @@ static PyObject *
 kf_process(PyObject *self, PyObject *args, PyObject *kws)
 {
     MatrixObject *A, *B, *C, *D, *x0, *P0, *Q, *R, *x, *P;
-    Float *x_est, *y_est, *P_est;
+    Float *x_est, *y_est, *P_est, *yv, *uv, *K = NULL, *xs, *Ps;
     PyObject *out, *tmp, *tmp1, *x_est_out, *y_est_out, *P_est_out, *result;
-    PyObject *mupdate_callback = NULL, *arglist;
-    int i, j, k, n, p, q, datalength;
+    PyObject *mupdate_callback = NULL, *arglist, *steady_o = NULL, *sequential_o = NULL;
+    int i, j, k, n, p, q, datalength, c0, chunk, g = 0, steady = KF_TRACK, converged = 0;
+    int sequential = 1, done = 0;
     MatrixObject *y, *u;
+    kf_workspace *ws;
 
-    static char *kwlist[] = {"A", "B", "C", "D", "y", "u", "x0", "P0", "Q", "R", "mupdate_callback", NULL};
+    static char *kwlist[] = {"A", "B", "C", "D", "y", "u", "x0", "P0", "Q", "R", "mupdate_callback", "steady", "sequential", NULL};
 
-    if (!PyArg_ParseTupleAndKeywords(args, kws, "O!O!O!O!O!O!O!O!O!O!|O:set_callback", kwlist,
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O!O!O!O!O!O!O!O!O!O!|OOO:kf_process", kwlist,
             &MatrixType, &A,
             &MatrixType, &B,
             &MatrixType, &C,
@@ -60,7 +114,23 @@ kf_process(PyObject *self, PyObject *args, PyObject *kws)
             &MatrixType, &P0,
             &MatrixType, &Q,
             &MatrixType, &R,
-            &mupdate_callback))
+            &mupdate_callback, &steady_o, &sequential_o))
+        return NULL;
+    if (mupdate_callback == Py_None)
+        mupdate_callback = NULL;
+
+    if (require_f8((PyObject *)A) || require_f8((PyObject *)B) ||
+        require_f8((PyObject *)C) || require_f8((PyObject *)D) ||
+        require_f8((PyObject *)y) || require_f8((PyObject *)u) ||
+        require_f8((PyObject *)x0) || require_f8((PyObject *)P0) ||
+        require_f8((PyObject *)Q) || require_f8((PyObject *)R))
+        return NULL;
+
+    if (require_contiguous(A) || require_contiguous(B) ||
+        require_contiguous(C) || require_contiguous(D) ||
+        require_contiguous(y) || require_contiguous(u) ||
+        require_contiguous(x0) || require_contiguous(P0) ||
+        require_contiguous(Q) || require_contiguous(R))
         return NULL;
 
     if (A->rows != A->cols) {
@@ -119,10 +189,68 @@ kf_process(PyObject *self, PyObject *args, PyObject *kws)
             return NULL;
         }
     }
+    // steady=True gain from the Riccati equation, 'auto' once P converges
+    if (steady_o != NULL && PyString_Check(steady_o)) {
+        if (strcmp(PyString_AS_STRING(steady_o), "auto")) {
+            PyErr_SetString(PyExc_ValueError, "steady must be True, False or 'auto'");
+            return NULL;
+        }
+        steady = KF_AUTO;
+    } else if (steady_o != NULL && (steady = PyObject_IsTrue(steady_o)) < 0) {
+        return NULL;
+    }
+    if (steady != KF_TRACK && mupdate_callback != NULL) {
+        PyErr_SetString(PyExc_ValueError, "steady state needs a fixed model, not mupdate_callback");
+        return NULL;
+    }
+    // scalar updates output by output if R is diagonal, unless sequential=False
+    if (sequential_o != NULL && (sequential = PyObject_IsTrue(sequential_o)) < 0)
+        return NULL;
 
     x_est = m_new(n, datalength);
-    y_est = m_new(n, datalength);
+    y_est = m_new(q, datalength);
     P_est = m_new(n, n*datalength);
+    // y and u hold one sample per column, the filter wants them per row
+    yv = m_new(KF_CHUNK, q);
+    uv = m_new(KF_CHUNK, p);
+    ws = kf_workspace_new(n, p, q);
+    if (x_est == NULL || y_est == NULL || P_est == NULL || yv == NULL || uv == NULL || ws == NULL) {
+        m_free(x_est);
+        m_free(y_est);
+        m_free(P_est);
+        m_free(yv);
+        m_free(uv);
+        kf_workspace_free(ws);
+        return PyErr_NoMemory();
+    }
+    ws->sequential = sequential && kf_diagonal(R->data, q);
+    stream((PyObject *)y);
+    stream((PyObject *)u);
+
+    if (steady != KF_TRACK) {
+        // gain (Nxq) and a posteriori covariance (NxN) of the steady state
+        K = m_new(1, n*q + n*n);
+        if (K == NULL)
+            g = 2;
+        else if (steady == KF_STEADY)
+            g = kf_steady(A->data, C->data, Q->data, R->data, n, q, K, K + n*q);
+        converged = (steady == KF_STEADY);
+        if (g != 0) {
+            m_free(x_est);
+            m_free(y_est);
+            m_free(P_est);
+            m_free(yv);
+            m_free(uv);
+            m_free(K);
+            kf_workspace_free(ws);
+            if (g == 2)
+                return PyErr_NoMemory();
+            PyErr_SetString(PyExc_ValueError, (g == 3)?
+                "Riccati equation did not converge, (A, C) must be detectable" :
+                "R and the innovation covariance must be positive definite");
+            return NULL;
+        }
+    }
 
     if (mupdate_callback != NULL) {
         Py_XINCREF(mupdate_callback);  // Add a reference to new callback
@@ -133,26 +261,68 @@ kf_process(PyObject *self, PyObject *args, PyObject *kws)
         m_copy(P->data, P0->data, n, n);
 
         for (i=0; i<datalength; i++) {
-            tick(A->data, B->data, C->data, D->data,
-                n, p, q,
-                y->data+i*q, u->data+i*p,
+            if (i % KF_CHUNK == 0) {
+                chunk = (datalength - i < KF_CHUNK)? datalength - i : KF_CHUNK;
+                m_copy_strided(yv, q, 1, y->data + i, 1, datalength, chunk, q);
+                m_copy_strided(uv, p, 1, u->data + i, 1, datalength, chunk, p);
+            }
+            g = tick_ws(ws, A->data, B->data, C->data, D->data,
+                yv+(i % KF_CHUNK)*q, uv+(i % KF_CHUNK)*p,
                 x->data, P->data,
                 Q->data, R->data,
                 x_est+i*n, y_est+i*q, P_est+i*n*n);
+            if (g) {
+                done = i;
+                break;
+            }
             // copy x and P values into output array
             m_copy(x->data, x_est+i*n, n, 1);
             m_copy(P->data, P_est+i*n*n, n, n);
-            // update the matrixes
+            // update the matrixes, an exception of the callback stops the filter
             arglist = Py_BuildValue("(i, O, O, O, O, O)", i, A, B, C, D, x);
-            result = PyEval_CallObject(mupdate_callback, arglist);
-            Py_DECREF(arglist);
+            result = (arglist != NULL)? PyEval_CallObject(mupdate_callback, arglist) : NULL;
+            Py_XDECREF(arglist);
+            if (result == NULL) {
+                g = -1;
+                break;
+            }
+            Py_DECREF(result);
         }
         Py_DECREF(x);
         Py_DECREF(P);
     } else { // model update not needed
-        process(A->data, B->data, C->data, D->data,
-                n, p, q, y->data, u->data, x0->data, P0->data, Q->data, R->data, datalength,
-                x_est, y_est, P_est);
+        for (c0=0; c0<datalength && g == 0; c0+=KF_CHUNK) {
+            chunk = (datalength - c0 < KF_CHUNK)? datalength - c0 : KF_CHUNK;
+            m_copy_strided(yv, q, 1, y->data + c0, 1, datalength, chunk, q);
+            m_copy_strided(uv, p, 1, u->data + c0, 1, datalength, chunk, p);
+            // a chunk starts from the last estimate of the previous one
+            xs = c0? x_est+(c0-1)*n : x0->data;
+            Ps = c0? P_est+(c0-1)*n*n : (steady == KF_STEADY)? K + n*q : P0->data;
+            if (steady == KF_TRACK)
+                g = process_ws(ws, A->data, B->data, C->data, D->data,
+                        yv, uv, xs, Ps, Q->data, R->data, chunk,
+                        x_est+c0*n, y_est+c0*q, P_est+c0*n*n, &done);
+            else
+                g = process_auto(ws, A->data, B->data, C->data, D->data,
+                        yv, uv, xs, Ps, Q->data, R->data, chunk,
+                        x_est+c0*n, y_est+c0*q, P_est+c0*n*n, K, &converged, &done);
+            done += c0;
+        }
+        m_free(K);
+    }
+    m_free(yv);
+    m_free(uv);
+    kf_workspace_free(ws);
+    // the estimates from the failing sample on were not written
+    if (g != 0) {
+        m_free(x_est);
+        m_free(y_est);
+        m_free(P_est);
+        if (g == 2)
+            return PyErr_NoMemory();
+        if (g == 1)
+            PyErr_Format(PyExc_ValueError, "innovation covariance is singular at sample %d", done);
+        return NULL;
     }
 
     // create lists from matrixes
@@ -198,6 +368,50 @@ kf_process(PyObject *self, PyObject *args, PyObject *kws)
 
 
 
+/*
+ * dare(A, C, Q, R)
+ * return solution P of the discrete algebraic Riccati equation
+ * P = A*P*A' - A*P*C' * inverse(C*P*C' + R) * C*P*A' + Q, the a priori
+ * covariance of the steady state Kalman filter
+ */
+static PyObject *
+py_dare(PyObject *self, PyObject *args)
+{
+    MatrixObject *A, *C, *Q, *R, *P;
+    int g, n;
+
+    if (!PyArg_ParseTuple(args, "O!O!O!O!", &MatrixType, &A, &MatrixType, &C,
+                          &MatrixType, &Q, &MatrixType, &R))
+        return NULL;
+    if (require_f8((PyObject *)A) || require_f8((PyObject *)C) ||
+        require_f8((PyObject *)Q) || require_f8((PyObject *)R) ||
+        require_contiguous(A) || require_contiguous(C) ||
+        require_contiguous(Q) || require_contiguous(R))
+        return NULL;
+    n = A->rows;
+    if (A->cols != n || C->cols != n || Q->rows != n || Q->cols != n ||
+        R->rows != C->rows || R->cols != C->rows) {
+        PyErr_SetString(PyExc_ValueError, "A and Q must be NxN, C qxN and R qxq matrixes");
+        return NULL;
+    }
+
+    if ((P = matrix_new(n, n)) == NULL)
+        return NULL;
+    g = m_dare(A->data, C->data, Q->data, R->data, n, C->rows, P->data);
+    if (g != 0) {
+        Py_DECREF(P);
+        if (g == 2)
+            return PyErr_NoMemory();
+        PyErr_SetString(PyExc_ValueError, (g == 3)?
+            "Riccati equation did not converge, (A, C) must be detectable" :
+            "R must be positive definite");
+        return NULL;
+    }
+    return (PyObject *)P;
+}
+
+
+
 /*
  * FFT
  */
@@ -205,12 +419,20 @@ static PyObject *
 fft_process(PyObject *self, VectorObject *v)
 {
     VectorObject *out;
+    int length;
 
     if (v->ob_type == &VectorType) {
-        DEBUG("length %d\n", v->length);
-        out = vector_new(v->length);
-        m_copy(out->data, v->data, 1, v->length);
-        FFT(out->data, v->length);
+        if (require_f8((PyObject *)v))
+            return NULL;
+        length = vector_length(v);
+        DEBUG("length %d\n", length);
+        out = vector_new(length);
+        if (out == NULL)
+            return NULL;
+        // also a row of a (file mapped) matrix
+        stream((PyObject *)v);
+        vector_pack(v, out->data);
+        FFT(out->data, length);
         return (PyObject*)out;
     } else {
         PyErr_SetString(PyExc_ValueError, "argument must be pnumeric.Vector type");
@@ -298,13 +520,26 @@ py_rms(PyObject *self, VectorObject *v)
         PyErr_SetString(PyExc_ValueError, "argument must be pnumeric.Vector type");
         return NULL;
     }
+    if (require_f8((PyObject *)v))
+        return NULL;
 
-    data = vector_dataptr(v);
     length = vector_length(v);
     DEBUG("   length %d\n", length);
+    stream((PyObject *)v);
+
+    // row of a matrix view
+    data = vector_dataptr(v);
+    if (v->stride != 1) {
+        data = m_new(1, length);
+        if (data == NULL)
+            return PyErr_NoMemory();
+        vector_pack(v, data);
+    }
 
     res = rms(length, data);
     DEBUG("   res %g\n", res);
+    if (data != vector_dataptr(v))
+        m_free(data);
 
     out = Py_BuildValue("f", res);
     return out;
@@ -326,12 +561,15 @@ py_mean(PyObject *self, VectorObject *v)
         PyErr_SetString(PyExc_ValueError, "argument must be pnumeric.Vector type");
         return NULL;
     }
+    if (require_f8((PyObject *)v))
+        return NULL;
 
     data = vector_dataptr(v);
     length = vector_length(v);
+    stream((PyObject *)v);
 
     for(i=0; i<length; i++) {
-        res = res + *data++;
+        res = res + data[i*v->stride];
     }
 
     res = res / length;
@@ -407,17 +645,58 @@ py_hamming(PyObject *self, PyObject *args)
 
 
 
+/*
+ * set number of threads used for large matrix products
+ */
+static PyObject *
+py_set_num_threads(PyObject *self, PyObject *args)
+{
+    int n;
+
+    if (!PyArg_ParseTuple(args, "i", &n) || m_set_num_threads(n)) {
+        PyErr_SetString(PyExc_ValueError, "argument must be a positive Integer");
+        return NULL;
+    }
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+
+/*
+ * number of threads used for large matrix products
+ */
+static PyObject *
+py_get_num_threads(PyObject *self, PyObject *args)
+{
+    return PyInt_FromLong(m_get_num_threads());
+}
+
+
+
 static PyMethodDef pnumeric_methods[] = {
     /*
      * The cast of the function is necessary since PyCFunction values
      * only take two PyObject* parameters, and keywdarg_parrot() takes
      * three.
      */
-    {"zeros",   (PyCFunction)matrix_zeros, METH_VARARGS, "returns zeros matrix"},
-    {"ones",   (PyCFunction)matrix_ones, METH_VARARGS, "returns ones matrix"},
-    {"eye",   (PyCFunction)matrix_eye, METH_VARARGS, "returns eye matrix"},
+    {"zeros",   (PyCFunction)matrix_zeros, METH_VARARGS | METH_KEYWORDS, "returns zeros matrix"},
+    {"ones",   (PyCFunction)matrix_ones, METH_VARARGS | METH_KEYWORDS, "returns ones matrix"},
+    {"eye",   (PyCFunction)matrix_eye, METH_VARARGS | METH_KEYWORDS, "returns eye matrix"},
+    {"solve", (PyCFunction)matrix_solve_func, METH_VARARGS, "solve A * x = b"},
+    {"dot", (PyCFunction)matrix_dot, METH_VARARGS | METH_KEYWORDS, "product of A or A' and B or B'"},
+    {"gemm", (PyCFunction)matrix_gemm, METH_VARARGS | METH_KEYWORDS, "C = alpha A * B + beta C in place"},
+    {"lazy", (PyCFunction)expr_lazy, METH_O, "deferred elementwise expression, evaluate with eval()"},
+    {"vstack", (PyCFunction)matrix_vstack, METH_O, "matrices and vectors one below another"},
+    {"hstack", (PyCFunction)matrix_hstack, METH_O, "matrices and vectors side by side"},
+    {"dumps", (PyCFunction)serial_dumps, METH_O, "binary string of Matrix or Vector"},
+    {"loads", (PyCFunction)serial_loads, METH_VARARGS, "Matrix or Vector of a string from dumps()"},
+    {"save", (PyCFunction)serial_save, METH_VARARGS, "write Matrix or Vector to a file"},
+    {"load", (PyCFunction)serial_load, METH_VARARGS, "read Matrix or Vector from a file"},
     {"vrange", (PyCFunction)vector_range, METH_VARARGS | METH_KEYWORDS, "generate a range vector"},
     {"kf_process", (PyCFunction)kf_process, METH_VARARGS | METH_KEYWORDS, "Kalman filter"},
+    {"dare", (PyCFunction)py_dare, METH_VARARGS, "discrete algebraic Riccati equation of Kalman filter"},
     //{"resample", (PyCFunction)py_resample, METH_VARARGS, "Resample a vector decimation or interpolation"},
     {"fft", (PyCFunction)fft_process, METH_O, "Fast Fourier Transform"},
     //{"hpspectrum", (PyCFunction)py_hpspectrum, METH_VARARGS, "Harmonic product spectrum of a vector"},
@@ -427,6 +706,8 @@ static PyMethodDef pnumeric_methods[] = {
     {"hanning", (PyCFunction)py_hanning, METH_VARARGS, "Hanning window"},
     {"hann", (PyCFunction)py_hanning, METH_VARARGS, "Hanning window"},
     {"hamming", (PyCFunction)py_hamming, METH_VARARGS, "Hamming window"},
+    {"set_num_threads", (PyCFunction)py_set_num_threads, METH_VARARGS, "set number of threads for matrix multiply"},
+    {"get_num_threads", (PyCFunction)py_get_num_threads, METH_NOARGS, "number of threads for matrix multiply"},
     {NULL, NULL, 0, NULL}   /* sentinel */
 };
 
@@ -437,6 +718,10 @@ initpnumeric(void)
 {
     PyObject *m;
 
+    // pick the elementwise kernels for this CPU
+    m_simd_init();
+    mf_simd_init();
+
     //VectorType.ob_type = &PyType_Type;
     VectorType.tp_new = VectorObject_New;
     if (PyType_Ready(&VectorType) < 0)
@@ -446,12 +731,30 @@ initpnumeric(void)
     if (PyType_Ready(&MatrixType) < 0)
         return;
 
+    if (PyType_Ready(&ExprType) < 0)
+        return;
+
+    KalmanType.tp_new = kalman_new;
+    if (PyType_Ready(&KalmanType) < 0)
+        return;
+
+    BankType.tp_new = bank_new;
+    if (PyType_Ready(&BankType) < 0)
+        return;
+
     // Create the module and add the functions
     m = Py_InitModule("pnumeric", pnumeric_methods);
 
     Py_INCREF(&VectorType);
     Py_INCREF(&MatrixType);
+    Py_INCREF(&ExprType);
+    Py_INCREF(&KalmanType);
+    Py_INCREF(&BankType);
     PyModule_AddObject(m, "Vector", (PyObject *)&VectorType);
     PyModule_AddObject(m, "Matrix", (PyObject *)&MatrixType);
+    PyModule_AddObject(m, "Expr", (PyObject *)&ExprType);
+    PyModule_AddObject(m, "KalmanFilter", (PyObject *)&KalmanType);
+    PyModule_AddObject(m, "KalmanBank", (PyObject *)&BankType);
+    PyModule_AddStringConstant(m, "simd", (char *)m_simd.name);
 }
 
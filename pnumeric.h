@@ -4,11 +4,24 @@
 #define MAX(a,b) a>b? a:b
 #define MIN(a,b) a>b? b:a
 
+// element of Matrix or Vector data of given dtype, as double
+#define PN_GET(data, dtype, i) ((dtype) == PN_F4 ? (double)((float *)(data))[i] : ((double *)(data))[i])
+#define PN_SET(data, dtype, i, v) \
+    do { if ((dtype) == PN_F4) ((float *)(data))[i] = (float)(v); else ((double *)(data))[i] = (v); } while (0)
+// pointer to element i of data of given dtype
+#define PN_PTR(data, dtype, i) ((Float *)((char *)(data) + (size_t)(i)*dtype_size(dtype)))
+// single precision view of Float data
+#define FDATA(p) ((float *)(p))
+
 //#define DEBUG(...) printf(__VA_ARGS__)
 #define DEBUG(...)  // __VA_ARGS__
 
 #include "matrix.h"
 #include "vector.h"
+#include "expr.h"
+#include "buffer.h"
+#include "serial.h"
+#include "kalman.h"
 
 #include "cgensupport.h"  // for PyArg_GetDoubleArray
 
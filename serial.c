@@ -0,0 +1,520 @@
+/*
+  serial.c
+      Binary serialization of Matrix and Vector objects for pnumeric
+      Python module.
+
+      Matrix and Vector are stored as a header of SERIAL_HEADER bytes
+      and the raw row major data, so they are written and read back in
+      one fwrite()/fread() of the data and pickled as a single string:
+
+        0  "PNM" and the format version byte
+        4  'M' Matrix or 'V' Vector
+        5  'd' for dtype 'f8' or 'f' for 'f4'
+        6  '<' little or '>' big endian data
+        7  0
+        8  rows, 4 bytes little endian, 1 for Vector
+       12  cols, 4 bytes little endian, length of Vector
+
+      Data of the other byte order are swapped when loaded.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#include "Python.h"
+#include "m2/m2.h"
+#include "pnumeric.h"
+#include <limits.h>
+
+
+
+typedef struct {
+    int kind;    // 'M' or 'V'
+    int dtype;
+    int rows;
+    int cols;
+    int swap;    // byte order of the data differs from the host
+} Header;
+
+
+
+/*
+ * '<' on a little endian host, '>' on a big endian one
+ */
+static int
+host_order(void)
+{
+    const int one = 1;
+
+    return *(const char *)&one? '<' : '>';
+}
+
+
+
+static void
+put32(unsigned char *p, unsigned long v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+
+
+static unsigned long
+get32(const unsigned char *p)
+{
+    return p[0] | ((unsigned long)p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+
+
+/*
+ * kind, dtype, shape and data of Matrix or Vector x, data is NULL
+ * unless the items are one row major block
+ * return 0 - success, -1 and exception if x is not Matrix or Vector
+ */
+static int
+describe(PyObject *x, Header *h, Float **data)
+{
+    MatrixObject *m;
+    VectorObject *v;
+
+    if (Matrix_Check(x)) {
+        m = (MatrixObject *)x;
+        h->kind = 'M';
+        h->dtype = m->dtype;
+        h->rows = m->rows;
+        h->cols = m->cols;
+        *data = Matrix_IsContiguous(m)? m->data : NULL;
+    } else if (Vector_Check(x)) {
+        v = (VectorObject *)x;
+        h->kind = 'V';
+        h->dtype = v->dtype;
+        h->rows = 1;
+        h->cols = vector_length(v);
+        *data = (v->stride == 1)? vector_dataptr(v) : NULL;
+    } else {
+        PyErr_SetString(PyExc_TypeError, "Matrix or Vector required");
+        return -1;
+    }
+    h->swap = 0;
+    return 0;
+}
+
+
+
+/*
+ * bytes of the data of the header shape
+ */
+static Py_ssize_t
+data_size(Header *h)
+{
+    return (Py_ssize_t)h->rows*h->cols*dtype_size(h->dtype);
+}
+
+
+
+static void
+header_write(unsigned char *p, Header *h)
+{
+    memcpy(p, "PNM", 3);
+    p[3] = SERIAL_VERSION;
+    p[4] = h->kind;
+    p[5] = (h->dtype == PN_F4)? 'f' : 'd';
+    p[6] = host_order();
+    p[7] = 0;
+    put32(p + 8, h->rows);
+    put32(p + 12, h->cols);
+}
+
+
+
+/*
+ * return 0 - success, -1 and exception if p is not a valid header
+ */
+static int
+header_read(const unsigned char *p, Header *h)
+{
+    unsigned long rows = get32(p + 8), cols = get32(p + 12);
+
+    if (memcmp(p, "PNM", 3)) {
+        PyErr_SetString(PyExc_ValueError, "not a pnumeric Matrix or Vector");
+        return -1;
+    }
+    if (p[3] != SERIAL_VERSION) {
+        PyErr_Format(PyExc_ValueError, "unsupported format version %d", p[3]);
+        return -1;
+    }
+    if ((p[4] != 'M' && p[4] != 'V') || (p[5] != 'd' && p[5] != 'f')
+            || (p[6] != '<' && p[6] != '>') || rows > INT_MAX || cols > INT_MAX
+            || (p[4] == 'V' && rows != 1)) {
+        PyErr_SetString(PyExc_ValueError, "corrupted header");
+        return -1;
+    }
+    // items must be indexable by int and their bytes by Py_ssize_t
+    if (cols != 0 && (rows > INT_MAX/cols
+            || rows*cols > PY_SSIZE_T_MAX/dtype_size((p[5] == 'f')? PN_F4 : PN_F8))) {
+        PyErr_SetString(PyExc_ValueError, "corrupted header, shape is too large");
+        return -1;
+    }
+    h->kind = p[4];
+    h->dtype = (p[5] == 'f')? PN_F4 : PN_F8;
+    h->swap = (p[6] != host_order());
+    h->rows = rows;
+    h->cols = cols;
+    return 0;
+}
+
+
+
+/*
+ * new Matrix or Vector of the header, its data to data
+ */
+static PyObject *
+create(Header *h, Float **data)
+{
+    MatrixObject *m;
+    VectorObject *v;
+
+    if (h->kind == 'V') {
+        if ((v = vector_new_dtype(h->cols, h->dtype)) == NULL)
+            return NULL;
+        *data = v->data;
+        return (PyObject *)v;
+    }
+    if ((m = matrix_new_dtype(h->rows, h->cols, h->dtype)) == NULL)
+        return NULL;
+    *data = m->data;
+    return (PyObject *)m;
+}
+
+
+
+/*
+ * loaded data to the host byte order
+ */
+static void
+fix_order(Header *h, Float *data)
+{
+    size_t size = dtype_size(h->dtype), k;
+    Py_ssize_t i, n = (Py_ssize_t)h->rows*h->cols;
+    char *p = (char *)data, t;
+
+    if (!h->swap)
+        return;
+    for (i=0; i<n; i++, p+=size) {
+        for (k=0; k<size/2; k++) {
+            t = p[k];
+            p[k] = p[size - 1 - k];
+            p[size - 1 - k] = t;
+        }
+    }
+}
+
+
+
+/*
+ * row major copy of the items of x, free with PyMem_Free()
+ */
+static Float *
+pack(PyObject *x, Header *h)
+{
+    Float *p = (Float *)PyMem_Malloc(data_size(h) + 1);
+
+    if (p == NULL)
+        return (Float *)PyErr_NoMemory();
+    if (h->kind == 'M')
+        matrix_pack((MatrixObject *)x, p);
+    else
+        vector_pack((VectorObject *)x, p);
+    return p;
+}
+
+
+
+/*
+ * pnumeric.dumps(x)
+ * return string of the header and the data of Matrix or Vector x
+ */
+PyAPI_FUNC(PyObject *)
+serial_dumps(PyObject *self, PyObject *x)
+{
+    Header h;
+    Float *data, *tmp = NULL;
+    PyObject *s;
+
+    if (describe(x, &h, &data))
+        return NULL;
+    if (data == NULL && (data = tmp = pack(x, &h)) == NULL)
+        return NULL;
+
+    s = PyString_FromStringAndSize(NULL, SERIAL_HEADER + data_size(&h));
+    if (s != NULL) {
+        header_write((unsigned char *)PyString_AS_STRING(s), &h);
+        memcpy(PyString_AS_STRING(s) + SERIAL_HEADER, data, data_size(&h));
+    }
+    PyMem_Free(tmp);
+    return s;
+}
+
+
+
+/*
+ * pnumeric.loads(s)
+ * return Matrix or Vector of string (or buffer) s from dumps()
+ */
+PyAPI_FUNC(PyObject *)
+serial_loads(PyObject *self, PyObject *args)
+{
+    Py_buffer s;
+    Header h;
+    Float *data;
+    PyObject *y = NULL;
+
+    if (!PyArg_ParseTuple(args, "s*", &s))
+        return NULL;
+    if (s.len < SERIAL_HEADER) {
+        PyErr_SetString(PyExc_ValueError, "data are shorter than the header");
+    } else if (header_read((const unsigned char *)s.buf, &h) == 0) {
+        if (s.len != SERIAL_HEADER + data_size(&h)) {
+            PyErr_SetString(PyExc_ValueError, "data size differs from the header shape");
+        } else if ((y = create(&h, &data)) != NULL) {
+            memcpy(data, (char *)s.buf + SERIAL_HEADER, data_size(&h));
+            fix_order(&h, data);
+        }
+    }
+    PyBuffer_Release(&s);
+    return y;
+}
+
+
+
+/*
+ * stdio stream of a path or a file object, NULL for other file like
+ * objects; close with release()
+ */
+static FILE *
+acquire(PyObject *file, const char *mode)
+{
+    FILE *fp;
+
+    if (PyString_Check(file)) {
+        fp = fopen(PyString_AS_STRING(file), mode);
+        if (fp == NULL)
+            PyErr_SetFromErrnoWithFilename(PyExc_IOError, PyString_AS_STRING(file));
+        return fp;
+    }
+    if (PyFile_Check(file)) {
+        if ((fp = PyFile_AsFile(file)) == NULL) {
+            PyErr_SetString(PyExc_ValueError, "I/O operation on closed file");
+            return NULL;
+        }
+        PyFile_IncUseCount((PyFileObject *)file);
+        return fp;
+    }
+    return NULL;
+}
+
+
+
+static void
+release(PyObject *file, FILE *fp)
+{
+    if (PyString_Check(file))
+        fclose(fp);
+    else
+        PyFile_DecUseCount((PyFileObject *)file);
+}
+
+
+
+/*
+ * pnumeric.save(x, file)
+ * write Matrix or Vector x to a file object, a path or an object with
+ * write() method
+ */
+PyAPI_FUNC(PyObject *)
+serial_save(PyObject *self, PyObject *args)
+{
+    PyObject *x, *file, *s, *r;
+    unsigned char head[SERIAL_HEADER];
+    Header h;
+    Float *data, *tmp = NULL;
+    FILE *fp;
+    size_t n;
+    int ok;
+
+    if (!PyArg_ParseTuple(args, "OO", &x, &file))
+        return NULL;
+    if (describe(x, &h, &data))
+        return NULL;
+
+    if ((fp = acquire(file, "wb")) == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        if ((s = serial_dumps(NULL, x)) == NULL)
+            return NULL;
+        r = PyObject_CallMethod(file, "write", "O", s);
+        Py_DECREF(s);
+        if (r == NULL)
+            return NULL;
+        Py_DECREF(r);
+        Py_RETURN_NONE;
+    }
+
+    if (data == NULL && (data = tmp = pack(x, &h)) == NULL) {
+        release(file, fp);
+        return NULL;
+    }
+    header_write(head, &h);
+    n = data_size(&h);
+    Py_BEGIN_ALLOW_THREADS
+    ok = fwrite(head, 1, SERIAL_HEADER, fp) == SERIAL_HEADER
+         && (n == 0 || fwrite(data, n, 1, fp) == 1)
+         && (!PyString_Check(file) || fflush(fp) == 0);
+    Py_END_ALLOW_THREADS
+    PyMem_Free(tmp);
+    release(file, fp);
+
+    if (!ok)
+        return PyErr_SetFromErrno(PyExc_IOError);
+    Py_RETURN_NONE;
+}
+
+
+
+/*
+ * exactly n bytes of the read() method of file, NULL and exception if
+ * there are less
+ */
+static PyObject *
+read_string(PyObject *file, Py_ssize_t n)
+{
+    PyObject *s = PyObject_CallMethod(file, "read", "n", n);
+
+    if (s == NULL)
+        return NULL;
+    if (!PyString_Check(s)) {
+        PyErr_SetString(PyExc_TypeError, "read() of the file must return a string");
+        Py_DECREF(s);
+        return NULL;
+    }
+    if (PyString_GET_SIZE(s) != n) {
+        PyErr_SetString(PyExc_EOFError, PyString_GET_SIZE(s)? "data are truncated" : "no more data");
+        Py_DECREF(s);
+        return NULL;
+    }
+    return s;
+}
+
+
+
+/*
+ * pnumeric.load(file)
+ * return next Matrix or Vector of a file object, a path or an object
+ * with read() method
+ */
+PyAPI_FUNC(PyObject *)
+serial_load(PyObject *self, PyObject *args)
+{
+    PyObject *file, *s, *y;
+    unsigned char head[SERIAL_HEADER];
+    Header h;
+    Float *data;
+    FILE *fp;
+    size_t got, n;
+
+    if (!PyArg_ParseTuple(args, "O", &file))
+        return NULL;
+
+    if ((fp = acquire(file, "rb")) == NULL) {
+        if (PyErr_Occurred())
+            return NULL;
+        if ((s = read_string(file, SERIAL_HEADER)) == NULL)
+            return NULL;
+        memcpy(head, PyString_AS_STRING(s), SERIAL_HEADER);
+        Py_DECREF(s);
+        if (header_read(head, &h))
+            return NULL;
+        if ((s = read_string(file, data_size(&h))) == NULL)
+            return NULL;
+        if ((y = create(&h, &data)) != NULL) {
+            memcpy(data, PyString_AS_STRING(s), data_size(&h));
+            fix_order(&h, data);
+        }
+        Py_DECREF(s);
+        return y;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    got = fread(head, 1, SERIAL_HEADER, fp);
+    Py_END_ALLOW_THREADS
+    if (got != SERIAL_HEADER) {
+        if (ferror(fp))
+            PyErr_SetFromErrno(PyExc_IOError);
+        else
+            PyErr_SetString(PyExc_EOFError, got? "data are truncated" : "no more data");
+        release(file, fp);
+        return NULL;
+    }
+    if (header_read(head, &h) || (y = create(&h, &data)) == NULL) {
+        release(file, fp);
+        return NULL;
+    }
+
+    n = data_size(&h);
+    Py_BEGIN_ALLOW_THREADS
+    got = (n == 0)? 1 : fread(data, n, 1, fp);
+    Py_END_ALLOW_THREADS
+    if (got != 1) {
+        if (ferror(fp))
+            PyErr_SetFromErrno(PyExc_IOError);
+        else
+            PyErr_SetString(PyExc_EOFError, "data are truncated");
+        Py_DECREF(y);
+        y = NULL;
+    } else {
+        fix_order(&h, data);
+    }
+    release(file, fp);
+    return y;
+}
+
+
+
+/*
+ * __reduce__ of Matrix and Vector
+ * return (pnumeric.loads, (dumps(self),)), pickles carry the raw data
+ */
+PyAPI_FUNC(PyObject *)
+serial_reduce(PyObject *self)
+{
+    PyObject *module, *loads, *s;
+
+    if ((s = serial_dumps(NULL, self)) == NULL)
+        return NULL;
+    module = PyImport_ImportModule("pnumeric");
+    loads = (module != NULL)? PyObject_GetAttrString(module, "loads") : NULL;
+    Py_XDECREF(module);
+    if (loads == NULL) {
+        Py_DECREF(s);
+        return NULL;
+    }
+    return Py_BuildValue("(N(N))", loads, s);
+}
@@ -0,0 +1,46 @@
+/*
+  serial.h
+      Binary serialization of Matrix and Vector objects for pnumeric
+      Python module.
+
+  Copyright (c) 2007 Jiří Popek <jiri.popek@gmail.com>
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+ */
+
+#ifndef __SERIAL_H__
+#define __SERIAL_H__
+
+#include "Python.h"
+#include "m2/m2.h"
+
+// format version written to the header
+#define SERIAL_VERSION 1
+// header bytes before the data
+#define SERIAL_HEADER 16
+
+// pnumeric.dumps(x), header and raw data of Matrix or Vector x as a string
+PyAPI_FUNC(PyObject *) serial_dumps(PyObject *self, PyObject *x);
+// pnumeric.loads(s), Matrix or Vector of a string from dumps()
+PyAPI_FUNC(PyObject *) serial_loads(PyObject *self, PyObject *args);
+// pnumeric.save(x, file), file is a file object or a path
+PyAPI_FUNC(PyObject *) serial_save(PyObject *self, PyObject *args);
+// pnumeric.load(file), next Matrix or Vector of a file object or a path
+PyAPI_FUNC(PyObject *) serial_load(PyObject *self, PyObject *args);
+// __reduce__ of Matrix and Vector, pickles the raw data of dumps()
+PyAPI_FUNC(PyObject *) serial_reduce(PyObject *self);
+
+#endif /* serial.h */
@@ -3,10 +3,12 @@
 
 from distutils.core import setup, Extension
 
-module1 = Extension('pnumeric', sources = ['pnumeric.c', 'vector.c', 'matrix.c', 'cgensupport.c', 'm2/m2.c',
-                    'kf.c', 'fft.c', 'window.c'
+module1 = Extension('pnumeric', sources = ['pnumeric.c', 'vector.c', 'matrix.c', 'expr.c', 'buffer.c', 'serial.c', 'kalman.c', 'cgensupport.c', 'm2/m2.c', 'm2/m2_gemm.c', 'm2/m2_simd.c', 'm2/m2_thread.c', 'm2/m2_alloc.c',
+                    'm2/m2f.c', 'm2/m2f_gemm.c', 'm2/m2f_simd.c',
+                    'kf.c', 'kfud.c', 'kfudf.c', 'fft.c', 'window.c'
                     #, 'hpspectrum.c'
-                    ])
+                    ],
+                    libraries = ['pthread'])
 
 setup (name = 'pNumeric',
        version = '1.0',
@@ -26,6 +26,15 @@
 """
 
 import unittest
+import array
+import os
+import tempfile
+import pickle
+import cPickle
+import struct
+import ctypes
+import pnumeric
+from StringIO import StringIO
 from pnumeric import *
 from math import pi, sin
 
@@ -60,6 +69,82 @@ class TestSequenceFunctions(unittest.TestCase):
         tmp = Matrix([[1, -3, 1], [1, 2, 1], [2, -1, -3]])
         self.assertEqual(i_a3, tmp)
 
+    def test_inverse_blocked(self):
+        '''inversion and determinant of a matrix bigger than one LU panel'''
+        import random
+        rnd = random.Random(4)
+        n = 150
+        a = [[rnd.uniform(-1, 1) for j in range(n)] for i in range(n)]
+        x = Matrix(a).inv()
+        ax = Matrix(a)*x
+        err = max([abs(ax[i][j] - (i == j)) for i in range(n) for j in range(n)])
+        self.assert_(err < 1e-9)
+        self.assert_(abs(Matrix(a).det()*x.det() - 1) < 1e-9)
+
+    def test_solve(self):
+        '''solve linear system'''
+        a3 = Matrix([[.2, .4, .2], [-.2, .2, .0], [.2, .2, -.2]])
+        x = solve(a3, Vector([1, 1, 1]))
+        self.assertEqual(x, Vector([-1, 4, -2]))
+        b = Matrix([[1, 0], [1, 2], [1, 0]])
+        self.assertEqual(a3.solve(b), Matrix([[-1, -6], [4, 4], [-2, -2]]))
+        self.assertRaises(ValueError, solve, Matrix([[1, 2], [2, 4]]), Vector([1, 1]))
+        self.assertRaises(ValueError, solve, a3, Vector([1, 1]))
+
+    def test_solve_blocked(self):
+        '''solve with more rows and right hand sides than one block'''
+        import random
+        rnd = random.Random(5)
+        n, k = 140, 70
+        a = [[rnd.uniform(-1, 1) for j in range(n)] for i in range(n)]
+        x = [[rnd.uniform(-1, 1) for j in range(k)] for i in range(n)]
+        b = Matrix(a)*Matrix(x)
+        res = Matrix(a).solve(b)
+        err = max([abs(res[i][j] - x[i][j]) for i in range(n) for j in range(k)])
+        self.assert_(err < 1e-9)
+
+    def test_cholesky(self):
+        '''Cholesky factorization'''
+        a = Matrix([[4, 12, -16], [12, 37, -43], [-16, -43, 98]])
+        l = a.cholesky()
+        self.assertEqual(l, Matrix([[2, 0, 0], [6, 1, 0], [-8, 5, 3]]))
+        self.assertRaises(ValueError, Matrix([[1, 2], [2, 1]]).cholesky)
+
+    def test_cholesky_blocked(self):
+        '''Cholesky factorization bigger than one block'''
+        import random
+        rnd = random.Random(6)
+        n = 150
+        m = Matrix([[rnd.uniform(-1, 1) for j in range(n)] for i in range(n)])
+        mt = Matrix([[m[j][i] for j in range(n)] for i in range(n)])
+        a = m*mt + eye(n)*n
+        l = a.cholesky()
+        lt = Matrix([[l[j][i] for j in range(n)] for i in range(n)])
+        self.assertEqual(l*lt, a)
+        self.assertEqual(l[3][4], 0)
+
+    def test_lu_cache(self):
+        '''cached factorization is dropped when the matrix changes'''
+        a = Matrix([[2, 1], [1, 3]])
+        self.assert_(abs(a.det() - 5) < 1e-12)
+        self.assertEqual(a.inv(), Matrix([[.6, -.2], [-.2, .4]]))
+        self.assertEqual(a.solve(Vector([3, 4])), Vector([1, 1]))
+        a[0][0] = 4
+        self.assert_(abs(a.det() - 11) < 1e-12)
+        self.assertEqual(a.solve(Vector([5, 4])), Vector([1, 1]))
+        row = a[1]
+        row[1] = 1
+        self.assert_(abs(a.det() - 3) < 1e-12)
+
+    def test_det(self):
+        '''determinant'''
+        a3 = Matrix([[.2, .4, .2], [-.2, .2, .0], [.2, .2, -.2]])
+        self.assert_(abs(a3.det() - (-0.04)) < 1e-12)
+        # permuted diagonal, odd permutation
+        p = Matrix([[0, 2, 0], [3, 0, 0], [0, 0, 4]])
+        self.assert_(abs(p.det() - (-24)) < 1e-12)
+        self.assertEqual(Matrix([[1, 2], [2, 4]]).det(), 0)
+
     def test_shape(self):
         '''shape'''
         a3 = Matrix([[.2, .4, .2], [-.2, .2, .0], [.2, .2, -.2], [3., 4., 5.]])
@@ -94,6 +179,32 @@ class TestSequenceFunctions(unittest.TestCase):
         res = a*b
         self.assertEqual(ab, res)
 
+    def test_multiply_blocked(self):
+        '''test multiply of matrixes big enough for the blocked kernel'''
+        m, k, n = 103, 67, 131
+        a = [[(i*7 + j*3) % 11 - 5.0 for j in range(k)] for i in range(m)]
+        b = [[(i*5 + j*2) % 13 - 6.0 for j in range(n)] for i in range(k)]
+        ab = [[sum([a[i][p]*b[p][j] for p in range(k)]) for j in range(n)] for i in range(m)]
+        res = Matrix(a)*Matrix(b)
+        self.assertEqual(res.shape, (m, n))
+        self.assertEqual(res, Matrix(ab))
+
+    def test_multiply_threads(self):
+        '''test multiply split over several threads'''
+        n = 160
+        a = [[((i*3 + j) % 17) - 8.0 for j in range(n)] for i in range(n)]
+        b = [[((i + j*5) % 19) - 9.0 for j in range(n)] for i in range(n)]
+        saved = get_num_threads()
+        set_num_threads(1)
+        self.assertEqual(get_num_threads(), 1)
+        serial = Matrix(a)*Matrix(b)
+        for t in (2, 3, 8):
+            set_num_threads(t)
+            self.assertEqual(get_num_threads(), t)
+            self.assertEqual(Matrix(a)*Matrix(b), serial)
+        set_num_threads(saved)
+        self.assertRaises(ValueError, set_num_threads, 0)
+
     def test_add(self):
         '''test add'''
         a = Matrix([[1, 2], [3, 4]])
@@ -146,6 +257,509 @@ class TestSequenceFunctions(unittest.TestCase):
         self.assertEqual(Vector([1, 2, 3])*v, Vector([1.0, 4.0, 9.0]))
         self.assertRaises(ValueError, lambda: Vector([1, 2])*v)
 
+    def test_elementwise_long(self):
+        '''elementwise kernels on lengths not divisible by the vector width'''
+        for n in (1, 7, 33, 1001):
+            a = [i*0.5 - 3 for i in range(n)]
+            b = [(i % 7) - 2.5 for i in range(n)]
+            self.assertEqual(Vector(a)*Vector(b), Vector([x*y for x, y in zip(a, b)]))
+            ma, mb = Matrix([a, b]), Matrix([b, a])
+            self.assertEqual(ma+mb, Matrix([[x+y for x, y in zip(a, b)]]*2))
+            self.assertEqual(ma-mb, Matrix([[x-y for x, y in zip(a, b)], [y-x for x, y in zip(a, b)]]))
+            self.assertEqual(ma*3, Matrix([[3*x for x in a], [3*y for y in b]]))
+
+    def test_float32(self):
+        '''single precision Matrix and Vector'''
+        a = Matrix([[1, 2], [3, 4]], dtype='f4')
+        b = Matrix([[5, 6], [7, 8]], dtype='f4')
+        self.assertEqual(a.dtype, 'f4')
+        self.assertEqual(Matrix([[1, 2]]).dtype, 'f8')
+        self.assertEqual((a*b).dtype, 'f4')
+        self.assertEqual(a*b, Matrix([[19, 22], [43, 50]]))
+        self.assertEqual(a+b, Matrix([[6, 8], [10, 12]]))
+        self.assertEqual(b-a, Matrix([[4, 4], [4, 4]]))
+        self.assertEqual(2*a-1, Matrix([[1, 3], [5, 7]]))
+        self.assertEqual(-a, Matrix([[-1, -2], [-3, -4]]))
+        self.assertEqual(eye(2, dtype='f4').dtype, 'f4')
+        self.assertEqual(zeros(2, dtype='f4')+ones(2, dtype='f4'), ones(2))
+        self.assertRaises(TypeError, lambda: a*Matrix([[1], [2]]))
+        self.assertRaises(TypeError, Matrix, [[1]], dtype='i4')
+        d = a.astype('f8')
+        self.assertEqual(d.dtype, 'f8')
+        self.assertEqual(d*Matrix([[1], [2]]), Matrix([[5], [11]]))
+        self.assertEqual(Matrix(d, dtype='f4').dtype, 'f4')
+        r = a[1]
+        self.assertEqual(r.dtype, 'f4')
+        r[0] = 0.25
+        self.assertEqual(a, Matrix([[1, 2], [0.25, 4]]))
+        v = Vector([1, -2, 3.5], dtype='f4')
+        self.assertEqual(v.dtype, 'f4')
+        self.assertEqual(v*v, Vector([1, 4, 12.25]))
+        self.assertEqual(2*v, Vector([2, -4, 7]))
+        self.assertEqual(abs(v), Vector([1, 2, 3.5]))
+        self.assertEqual(v[1:3], Vector([-2, 3.5]))
+        self.assertEqual(v.astype('f8').dtype, 'f8')
+        self.assertRaises(TypeError, lambda: v*Vector([1, 2, 3]))
+        self.assertRaises(TypeError, fft, v)
+
+    def test_float32_linalg(self):
+        '''single precision products and factorizations'''
+        n = 100
+        a = [[((i*3 + j) % 17) - 8.0 for j in range(n)] for i in range(n)]
+        b = [[((i + j*5) % 19) - 9.0 for j in range(n)] for i in range(n)]
+        self.assertEqual(Matrix(a, dtype='f4')*Matrix(b, dtype='f4'), Matrix(a)*Matrix(b))
+        s = [[1.0/(i+j+1) + (i == j)*n for j in range(n)] for i in range(n)]
+        m = Matrix(s, dtype='f4')
+        x = m.solve(Matrix([[1.0]]*n, dtype='f4'))
+        self.assertEqual(x.dtype, 'f4')
+        close = lambda p, q: max([abs(p[i][j] - q[i][j]) for i in range(n) for j in range(len(p[0]))]) < 1e-4
+        self.assert_(close(m*x, Matrix([[1.0]]*n)))
+        self.assert_(close(m*m.inv(), eye(n)))
+        l = m.cholesky()
+        self.assert_(close(l*Matrix([[l[j][i] for j in range(n)] for i in range(n)], dtype='f4'), m))
+        self.assert_(abs(Matrix([[2, 1], [1, 3]], dtype='f4').det() - 5) < 1e-5)
+
+    def test_views(self):
+        '''transpose, submatrix and column views share the data'''
+        a = Matrix([[1, 2, 3], [4, 5, 6], [7, 8, 9], [10, 11, 12]])
+        t = a.T
+        self.assertEqual(t.shape, (3, 4))
+        self.assertEqual(t, Matrix([[1, 4, 7, 10], [2, 5, 8, 11], [3, 6, 9, 12]]))
+        self.assertEqual(t[2][1], 6)
+        self.assertEqual(a[1, 2], 6)
+        self.assertEqual(a[-1, -1], 12)
+        c = a[:, 1]
+        self.assertEqual(c, Matrix([[2], [5], [8], [11]]))
+        s = a[1:3, 0:2]
+        self.assertEqual(s, Matrix([[4, 5], [7, 8]]))
+        self.assertEqual(a[::2, ::-1], Matrix([[3, 2, 1], [9, 8, 7]]))
+        self.assertEqual(a[1:3], Matrix([[4, 5, 6], [7, 8, 9]]))
+        # writes go to the parent and back
+        s[0][1] = 50
+        self.assertEqual(a[1, 1], 50)
+        self.assertEqual(c[1, 0], 50)
+        a[0, 1] = 20
+        self.assertEqual(t[1][0], 20)
+        a[2:4, 1:3] = Matrix([[0, 0], [0, 0]])
+        self.assertEqual(a, Matrix([[1, 20, 3], [4, 50, 6], [7, 0, 0], [10, 0, 0]]))
+        a[:, 0] = 1
+        self.assertEqual(c.T, Matrix([[20, 50, 0, 0]]))
+        self.assertEqual(a.T[0], Vector([1, 1, 1, 1]))
+        # arithmetic reads views in place
+        self.assertEqual(a.T*a, a.copy().T.copy()*a.copy())
+        self.assertEqual(s+s.T, Matrix([[2, 51], [51, 0]]))
+        self.assertEqual(2*t-t, t.copy())
+        self.assertEqual(t[1]*2, Vector([40, 100, 0, 0]))
+        self.assertEqual(mean(t[0]), 1)
+        self.assertEqual(s.T.inv(), s.copy().T.copy().inv())
+        self.assertEqual(Matrix([[4, 2], [2, 3]]).T.cholesky(), Matrix([[4, 2], [2, 3]]).cholesky())
+        self.assertEqual(a.T.astype('f4').dtype, 'f4')
+        m = Matrix([[2, 1], [1, 3]])
+        mt = m.T
+        self.assert_(abs(mt.det() - 5) < 1e-12)
+        m[0, 0] = 4
+        self.assert_(abs(mt.det() - 11) < 1e-12)
+        self.assertRaises(IndexError, lambda: a[4, 0])
+        def assign():
+            a[0:2, 0] = Matrix([[1, 2]])
+        self.assertRaises(ValueError, assign)
+
+    def test_views_blocked(self):
+        '''strided operands of the blocked multiply'''
+        n = 130
+        a = Matrix([[((i*3 + j) % 17) - 8.0 for j in range(n)] for i in range(n)])
+        b = Matrix([[((i + j*5) % 19) - 9.0 for j in range(n)] for i in range(n)])
+        self.assertEqual(a.T*b, a.T.copy()*b)
+        self.assertEqual(a*b.T, a*b.T.copy())
+        self.assertEqual(a[1::2, 3:]*b[3:, ::3], a[1::2, 3:].copy()*b[3:, ::3].copy())
+
+    def test_dot(self):
+        '''products with transposed operands'''
+        a = Matrix([[1, 2, 3], [4, 5, 6]])
+        b = Matrix([[1, 0], [2, 1], [0, 3]])
+        at = Matrix([[1, 4], [2, 5], [3, 6]])
+        self.assertEqual(dot(a, b), a*b)
+        self.assertEqual(dot(a, a, transA=True), at*a)
+        self.assertEqual(dot(a, a, transB=True), a*at)
+        self.assertEqual(dot(b, a, True, True), b.T.copy()*at)
+        self.assertEqual(dot(a.T, b, transA=1), a*b)
+        self.assertRaises(ValueError, dot, a, b, transB=True)
+        n = 120
+        c = Matrix([[((i*3 + j) % 17) - 8.0 for j in range(n)] for i in range(n)])
+        ct = Matrix([[c[j][i] for j in range(n)] for i in range(n)])
+        self.assertEqual(dot(c, c, transA=True), ct*c)
+        self.assertEqual(dot(c, c, transB=True), c*ct)
+
+    def test_gemm(self):
+        '''accumulating product in place'''
+        a = Matrix([[1, 2], [3, 4]])
+        b = Matrix([[0, 1], [1, 0]])
+        c = Matrix([[1, 1], [1, 1]])
+        r = gemm(2, a, b, 3, c)
+        self.assert_(r is c)
+        self.assertEqual(c, Matrix([[7, 5], [11, 9]]))
+        gemm(1, a, a, 0, c, transA=True)
+        self.assertEqual(c, Matrix([[10, 14], [14, 20]]))
+        gemm(-1, a, b, 1, c, transB=True)
+        self.assertEqual(c, Matrix([[8, 13], [10, 17]]))
+        # operand aliasing the output and a strided output view
+        gemm(1, c, eye(2), 1, c)
+        self.assertEqual(c, Matrix([[16, 26], [20, 34]]))
+        gemm(1, eye(2), a, 0, c.T)
+        self.assertEqual(c, Matrix([[1, 3], [2, 4]]))
+        self.assertRaises(ValueError, gemm, 1, a, Matrix([[1, 2]]), 0, c)
+
+    def test_sandwich(self):
+        '''symmetric product A * P * A' + Q'''
+        a = Matrix([[1, 2], [3, 4], [5, 6]])
+        p = Matrix([[2, 1], [1, 3]])
+        q = eye(3)
+        self.assertEqual(a.sandwich(p), a*p*a.T)
+        self.assertEqual(a.sandwich(p, q), a*p*a.T + q)
+        # Q need not be symmetric, nor contiguous
+        q = Matrix([[1, 2, 3], [4, 5, 6], [7, 8, 9]])
+        self.assertEqual(a.sandwich(p, q), a*p*a.T + q)
+        self.assertEqual(a.sandwich(p, q.T), a*p*a.T + q.T)
+        self.assertEqual(Matrix(a, dtype='f4').sandwich(Matrix(p, dtype='f4'), Matrix(q, dtype='f4')),
+                         a*p*a.T + q)
+        self.assertRaises(ValueError, a.sandwich, q)
+        n, k = 70, 50
+        a = Matrix([[((i*3 + j) % 17) - 8.0 for j in range(k)] for i in range(n)])
+        m = Matrix([[((i + j*5) % 19) - 9.0 for j in range(k)] for i in range(k)])
+        p = m*m.T
+        s = a.sandwich(p)
+        self.assertEqual(s, a*p*a.T)
+        self.assertEqual(s, s.T)
+        self.assertEqual(Matrix(a, dtype='f4').sandwich(Matrix(p, dtype='f4')).dtype, 'f4')
+
+    def test_lazy(self):
+        '''fused evaluation of elementwise expressions'''
+        a = Matrix([[1, 2], [3, 4]])
+        b = Matrix([[5, 6], [7, 8]])
+        c = Matrix([[1, 1], [2, 2]])
+        e = lazy(a)*2 + b - c
+        self.assertEqual(e.shape, (2, 2))
+        self.assertEqual(e.eval(), a*2 + b - c)
+        self.assertEqual((1 - lazy(a)/2 + 3*(b - lazy(c))).eval(), 1 - a*0.5 + (b - c)*3)
+        self.assertEqual((-lazy(a) + a.T).eval(), Matrix([[0, 1], [-1, 0]]))
+        # Matrix product is evaluated at once, the rest stays fused
+        self.assertEqual((lazy(a)*b + c).eval(), a*b + c)
+        v = Vector([1, 2, 3])
+        w = Vector([2, 0, 1])
+        self.assertEqual((lazy(v)*w + v - 1).eval(), Vector([2, 1, 5]))
+        self.assertEqual((lazy(a[1])*10).eval(), Vector([30, 40]))
+        # into an existing matrix, also one read by the expression
+        out = zeros(2)
+        r = (lazy(a) + b).eval(out)
+        self.assert_(r is out)
+        self.assertEqual(out, a + b)
+        (lazy(a) - a.T).eval(a)
+        self.assertEqual(a, Matrix([[0, -1], [1, 0]]))
+        n = 1000
+        x = Matrix([[i*0.5 - j for j in range(3)] for i in range(n)])
+        y = Matrix([[(i % 7) + j for j in range(3)] for i in range(n)])
+        self.assertEqual((lazy(x)*2 - y + x).eval(), x*2 - y + x)
+        xf, yf = x.astype('f4'), y.astype('f4')
+        self.assertEqual((lazy(xf) - yf).eval().dtype, 'f4')
+        self.assertEqual((lazy(xf) - yf).eval(), x - y)
+        self.assertRaises(TypeError, lambda: lazy(x) + yf)
+        self.assertRaises(ValueError, lambda: lazy(a) + x)
+        self.assertRaises(TypeError, lambda: lazy(a) + v)
+        self.assertRaises(TypeError, lazy, 3)
+        self.assertRaises(ZeroDivisionError, lambda: lazy(a)/0.0)
+        self.assertRaises(ZeroDivisionError, lambda: lazy(v)/0)
+
+    def test_inplace(self):
+        '''in-place operators write into the existing data'''
+        a = Matrix([[1, 2], [3, 4]])
+        b = Matrix([[5, 6], [7, 8]])
+        r = a
+        a += b
+        a -= 1
+        a *= 2
+        a /= 4
+        self.assert_(a is r)
+        self.assertEqual(a, Matrix([[2.5, 3.5], [4.5, 5.5]]))
+        a += a
+        self.assertEqual(a, Matrix([[5, 7], [9, 11]]))
+        # views and rows write through into the matrix
+        a = Matrix([[1, 2, 3], [4, 5, 6], [7, 8, 9]])
+        d = a.det()
+        a[0] += 10
+        a[1] *= Vector([1, 0, 2])
+        a[2] -= a[0]
+        self.assertEqual(a, Matrix([[11, 12, 13], [4, 0, 12], [-4, -4, -4]]))
+        self.assertNotEqual(a.det(), d)
+        t = a.T
+        t += eye(3)
+        self.assertEqual(a, Matrix([[12, 12, 13], [4, 1, 12], [-4, -4, -3]]))
+        a[:, 1] += 1
+        a[0:2, 1:] *= 0
+        self.assertEqual(a, Matrix([[12, 0, 0], [4, 0, 0], [-4, -3, -3]]))
+        # overlapping operand in another layout
+        a = Matrix([[1, 2], [3, 4]])
+        a += a.T
+        self.assertEqual(a, Matrix([[2, 5], [5, 8]]))
+        a = Matrix([[1, 2], [3, 4], [5, 6]])
+        a[1:3] -= a[0:2]
+        self.assertEqual(a, Matrix([[1, 2], [2, 2], [2, 2]]))
+        v = Vector([1, 2, 3])
+        w = v
+        v += 1
+        v *= Vector([2, 1, 0])
+        v /= 2
+        self.assert_(v is w)
+        self.assertEqual(v, Vector([2, 1.5, 0]))
+        f = Matrix([[1, 2], [3, 4]]).astype('f4')
+        f += 0.5
+        f[1] *= 2
+        self.assertEqual(f, Matrix([[1.5, 2.5], [7, 9]]))
+        def iadd(x, y):
+            x += y
+        self.assertRaises(ValueError, iadd, Matrix([[1, 2]]), b)
+        self.assertRaises(ValueError, iadd, Vector([1, 2]), Vector([1, 2, 3]))
+        self.assertRaises(TypeError, iadd, f, b)
+        # Matrix * Matrix is still a product
+        a = Matrix([[1, 2], [3, 4]])
+        a *= b
+        self.assertEqual(a, Matrix([[19, 22], [43, 50]]))
+
+    def test_buffer(self):
+        '''buffer protocol and frombuffer'''
+        m = Matrix([[1, 2, 3], [4, 5, 6]])
+        b = memoryview(m)
+        self.assertEqual((b.format, b.shape, b.strides), ('d', (2, 3), (24, 8)))
+        self.assertEqual(array.array('d', b.tobytes()).tolist(), [1, 2, 3, 4, 5, 6])
+        t = memoryview(m.T)
+        self.assertEqual((t.shape, t.strides), ((3, 2), (8, 24)))
+        self.assertRaises(BufferError, lambda: str(buffer(m.T)))
+        self.assertEqual(len(str(buffer(m[1]))), 24)
+        # shape and strides are taken from the exporter, data are shared
+        x = Matrix.frombuffer(t)
+        self.assertEqual(x, m.T)
+        m[0, 1] = 20
+        self.assertEqual(x[1, 0], 20)
+        self.assertEqual(Vector.frombuffer(memoryview(m[1])), Vector([4, 5, 6]))
+        # raw memory of other objects
+        a = bytearray(array.array('d', range(6)).tostring())
+        x = Matrix.frombuffer(a, (2, 3))
+        x[1] += 10
+        self.assertEqual(array.array('d', str(a)).tolist(), [0, 1, 2, 13, 14, 15])
+        self.assertEqual(Matrix.frombuffer(a, (-1, 2), offset=16), Matrix([[2, 13], [14, 15]]))
+        v = Vector.frombuffer(a)
+        v *= 2
+        self.assertEqual(array.array('d', str(a))[5], 30)
+        # the old buffer protocol pins nothing, array.array is copied
+        r = array.array('d', range(4))
+        x = Matrix.frombuffer(r, (2, 2))
+        v = Vector.frombuffer(r)
+        r.extend([0.0]*100000)
+        x[0, 0] = v[1] = 9
+        self.assertEqual((x, v, r[0], r[1]), (Matrix([[9, 1], [2, 3]]), Vector([0, 9, 2, 3]), 0, 1))
+        f = Vector.frombuffer(bytearray(16), dtype='f4')
+        self.assertEqual((len(f), f.dtype), (4, 'f4'))
+        s = array.array('d', [1, 2, 3, 4]).tostring()
+        x = Matrix.frombuffer(s, (2, 2))   # read only, copied
+        x[0, 0] = 9
+        self.assertEqual(Matrix.frombuffer(s, (2, 2)), Matrix([[1, 2], [3, 4]]))
+        # the LU cache must not survive writes through a buffer
+        x = Matrix.frombuffer(a, (2, 2))
+        d = x.det()
+        a[0:8] = array.array('d', [7]).tostring()
+        self.assertNotEqual(x.det(), d)
+        x = Matrix([[4, 1], [1, 3]])
+        d = x.det()
+        b = memoryview(x[0])
+        b[0:2] = memoryview(Vector([1, 0]))
+        self.assertEqual(x.det(), 3)
+        del b
+        self.assertRaises(ValueError, Matrix.frombuffer, a)
+        self.assertRaises(ValueError, Matrix.frombuffer, a, (4, 2))
+        self.assertRaises(ValueError, Vector.frombuffer, bytearray(12))
+        # items must be aligned to their size, the kernels store whole items
+        self.assertRaises(ValueError, Matrix.frombuffer, bytearray(8*4 + 1), (4, 1), offset=1)
+        self.assertRaises(ValueError, Vector.frombuffer, bytearray(8*4 + 1), 4, offset=1)
+        self.assertRaises(ValueError, Matrix.frombuffer, memoryview(bytearray(8*4 + 1))[1:], (4, 1))
+        self.assertRaises(ValueError, Matrix.fromstring, '\0'*9, (1, 1), offset=1)
+        self.assertRaises(TypeError, Matrix.frombuffer, memoryview(m), None, 'f4')
+        self.assertRaises(TypeError, Vector.frombuffer, 3)
+
+    def test_bulk(self):
+        '''fromiter, fromstring, vstack and hstack'''
+        a = Matrix([[1, 2, 3], [4, 5, 6]])
+        self.assertEqual(Matrix((range(1, 4), (4, 5L, 6.0))), a)
+        self.assertEqual(Vector((1, 2L, 3.0)), Vector([1, 2, 3]))
+        self.assertRaises(TypeError, Matrix, [[1, 2], [3]])
+        self.assertRaises(TypeError, Matrix, [[1, 'x']])
+        self.assertEqual(Matrix.fromiter(range(1, 7), (2, 3)), a)
+        self.assertEqual(Matrix.fromiter((i + 1 for i in range(6)), (-1, 2)), Matrix([[1, 2], [3, 4], [5, 6]]))
+        n = 1000
+        b = Matrix.fromiter((i*0.5 for i in xrange(3*n)), (-1, 3), dtype='f4')
+        self.assertEqual((b.shape, b.dtype, b[n - 1, 2]), ((n, 3), 'f4', (3*n - 1)*0.5))
+        self.assertRaises(ValueError, Matrix.fromiter, range(5), (2, 3))
+        self.assertRaises(ValueError, Matrix.fromiter, range(7), (2, 3))
+        self.assertRaises(ValueError, Matrix.fromiter, range(5), (-1, 3))
+        # shapes beyond int would be truncated by the allocation
+        self.assertRaises(OverflowError, Matrix.fromiter, iter([float(i) for i in range(20)]), (2**32 + 1, 1))
+        self.assertRaises(OverflowError, Matrix.fromiter, range(4), (2, 2**31))
+        self.assertRaises(OverflowError, Matrix.fromiter, range(4), (-1, 2**32))
+        s = array.array('d', range(1, 7)).tostring()
+        self.assertEqual(Matrix.fromstring(s, (2, 3)), a)
+        self.assertEqual(Matrix.fromstring(array.array('f', range(1, 7)).tostring(), (3, -1), 'f4'),
+                         Matrix([[1, 2], [3, 4], [5, 6]]))
+        # a writable buffer is copied too
+        c = bytearray(s)
+        x = Matrix.fromstring(c, (2, 3))
+        x[0, 0] = 9
+        self.assertEqual(Matrix.fromstring(c, (2, 3)), a)
+        self.assertEqual(vstack([a, Vector([7, 8, 9]), a[0:1]]),
+                         Matrix([[1, 2, 3], [4, 5, 6], [7, 8, 9], [1, 2, 3]]))
+        self.assertEqual(hstack((a.T, Vector([0, 1, 2]), a.T[:, 1])),
+                         Matrix([[1, 4, 0, 4], [2, 5, 1, 5], [3, 6, 2, 6]]))
+        self.assertRaises(ValueError, vstack, [a, Vector([1, 2])])
+        self.assertRaises(ValueError, hstack, [a, Vector([1, 2, 3])])
+        self.assertRaises(TypeError, vstack, [a, a.astype('f4')])
+        self.assertRaises(TypeError, vstack, [a, 1])
+        self.assertRaises(ValueError, vstack, [])
+
+    def test_allocator(self):
+        '''m_set_allocator() hooks behind the Matrix data'''
+        lib = ctypes.CDLL(pnumeric.__file__)
+        ALLOC = ctypes.CFUNCTYPE(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p)
+        FREE = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p)
+        class Allocator(ctypes.Structure):
+            _fields_ = [('alloc', ALLOC), ('free', FREE), ('ctx', ctypes.c_void_p)]
+        live, nested = {}, []
+        # blocks of the hook are deliberately 8 bytes off any alignment,
+        # the first call allocates through m2 itself
+        def alloc(size, ctx):
+            if not nested:
+                nested.append(None)
+                nested[0] = zeros(2)
+            b = ctypes.create_string_buffer(size + 72)
+            p = ctypes.addressof(b) + 8 + (-ctypes.addressof(b) % 64)
+            live[p] = (b, size)
+            return p
+        def free(p, size, ctx):
+            self.assertEqual(live.pop(p)[1], size)
+        hooks = Allocator(ALLOC(alloc), FREE(free), None)
+        lib.m_set_allocator(ctypes.byref(hooks))
+        try:
+            ms = [zeros(n) for n in (1, 7, 300)]
+            ms.append(eye(5).copy())
+        finally:
+            lib.m_set_allocator(None)
+        self.assertEqual((len(live), nested[0].shape), (5, (2, 2)))
+        del nested[:]
+        for m in ms:
+            self.assertEqual(ctypes.addressof((ctypes.c_char*8).from_buffer(m)) % 64, 0)
+            m += 1
+            n = m.shape[1]
+            self.assertEqual((m[0, 0], m[n - 1, n - 1], m[n - 1, 0]), (2, 2, 1) if n == 5 else (1, 1, 1))
+        # released by the hook that made them, also after it is removed
+        del m, ms
+        self.assertEqual(live, {})
+        # pooled blocks of the default allocator go back to the system
+        ms = [zeros(4) for i in range(10)]
+        del ms
+        lib.m_alloc_trim()
+        self.assertEqual(zeros(4) + eye(4), eye(4))
+
+    def test_mmap(self):
+        '''Matrix backed by a memory mapped file'''
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            m = Matrix.mmap(path, 3, 2, 'w+')
+            m[:, :] = Matrix([[1, 2], [3, 4], [5, 6]])
+            del m
+            self.assertEqual(os.path.getsize(path), 48)
+            m = Matrix.mmap(path, cols=2)
+            self.assertEqual(m, Matrix([[1, 2], [3, 4], [5, 6]]))
+            # 'r' keeps the file, 'r+' writes it
+            m[0, 0] = 9
+            self.assertEqual(Matrix.mmap(path, 3, 2)[0, 0], 1)
+            m = Matrix.mmap(path, -1, 2, 'r+')
+            m[0, 0] = 9
+            del m
+            self.assertEqual(Matrix.fromstring(open(path, 'rb').read(), (3, 2))[0, 0], 9)
+            self.assertEqual(Matrix.mmap(path, 2, 1, offset=16), Matrix([[3], [4]]))
+            self.assertEqual(rms(Matrix.mmap(path, 1, 6)[0]), rms(Vector([9, 2, 3, 4, 5, 6])))
+            self.assertRaises(ValueError, Matrix.mmap, path, 4, 2)
+            self.assertRaises(ValueError, Matrix.mmap, path, -1, 4)
+            self.assertRaises(ValueError, Matrix.mmap, path, 3, 2, 'w')
+            self.assertRaises(IOError, Matrix.mmap, path + '.none')
+            # unaligned offset, shape beyond int
+            self.assertRaises(ValueError, Matrix.mmap, path, 2, 1, offset=3)
+            self.assertRaises(OverflowError, Matrix.mmap, path, 65536, 65536)
+            self.assertEqual(os.path.getsize(path), 48)
+
+            # a log longer than the filter chunk streams from the file
+            n = 2500
+            y = Matrix.mmap(path, 2, n, 'w+')[0:1]
+            y[0] = Vector([0.1*(i % 50) + (i % 3 - 1)*0.2 for i in range(n)])
+            args = [Matrix([[1.0, 0.1], [0.0, 1.0]]), Matrix([[0.0], [0.0]]), Matrix([[1.0, 0.0]]),
+                    Matrix([[0.0]]), y, Matrix.mmap(path, 1, n, offset=8*n), Matrix([[0.0], [0.0]]),
+                    eye(2), Matrix([[1e-3, 0.0], [0.0, 1e-2]]), Matrix([[0.5]])]
+            x_est = kf_process(*args)[0]
+            args[4] = y.copy()
+            x_cb = kf_process(*args, **{'mupdate_callback': lambda *a: None})[0]
+            self.assertEqual(len(x_est), n)
+            for k in (0, 1023, 1024, 2047, 2048, n - 1):
+                self.assert_(abs(x_est[k][0] - x_cb[k][0]) < 1e-12 and abs(x_est[k][1] - x_cb[k][1]) < 1e-12)
+            del y, args
+        finally:
+            os.remove(path)
+
+    def test_serial(self):
+        '''binary save, load and pickling'''
+        a = Matrix([[1, 2, 3], [4, 5, 6]])
+        v = Vector([0.5, -1, 2e10])
+        for x in (a, a.T, a.astype('f4'), a[:, 1], v, a[1], v.astype('f4')):
+            y = loads(dumps(x))
+            self.assertEqual((type(y), y.dtype, y), (type(x), x.dtype, x))
+            for p in (pickle, cPickle):
+                for proto in (0, 2):
+                    y = p.loads(p.dumps(x, proto))
+                    self.assertEqual((type(y), y.dtype, y), (type(x), x.dtype, x))
+        self.assertEqual(len(dumps(a)), 16 + 6*8)
+        self.assertEqual(len(cPickle.dumps(a, 2)) < 100, True)
+        # other byte order
+        s = dumps(v)
+        s = s[:6] + ('>' if s[6] == '<' else '<') + s[7:16] + ''.join([s[i:i + 8][::-1] for i in range(16, len(s), 8)])
+        self.assertEqual(loads(s), v)
+        self.assertRaises(ValueError, loads, s[:-1])
+        self.assertRaises(ValueError, loads, 'XYZ' + s[3:])
+        self.assertRaises(ValueError, loads, s[:3] + '\x09' + s[4:])
+        # rows*cols beyond int, the data size would wrap
+        self.assertRaises(ValueError, loads, s[:8] + struct.pack('<II', 1518500250, 1518500250) + '\0'*64)
+        self.assertRaises(ValueError, loads, s[:8] + struct.pack('<II', 65536, 65536))
+        self.assertRaises(TypeError, dumps, [1, 2])
+
+        fd, path = tempfile.mkstemp()
+        os.close(fd)
+        try:
+            f = open(path, 'wb')
+            save(a, f)
+            save(v.astype('f4'), f)
+            f.close()
+            f = open(path, 'rb')
+            self.assertEqual(load(f), a)
+            self.assertEqual(load(f).dtype, 'f4')
+            self.assertRaises(EOFError, load, f)
+            f.close()
+            save(a.T, path)
+            self.assertEqual(load(path), a.T)
+            self.assertEqual(os.path.getsize(path), 16 + 6*8)
+        finally:
+            os.remove(path)
+        f = StringIO()
+        save(a, f)
+        save(v, f)
+        f.seek(0)
+        self.assertEqual((load(f), load(f)), (a, v))
+        self.assertRaises(EOFError, load, f)
+
     def test_vector_abs(self):
         v = abs(Vector([.2, -3333, 41, -89.444444]))
         self.assertEqual(v, Vector([.2, 3333, 41, 89.444444]))
@@ -170,6 +784,78 @@ class TestSequenceFunctions(unittest.TestCase):
         v2 = Vector([0.5, 0.6, 0.7, 0.8, 0.9, 1.0, 1.1])
         self.assertEqual(v, v2)
 
+    def test_kf_process(self):
+        '''Kalman filter against a plain Python implementation'''
+        A = [[1.0, 0.1], [0.0, 1.0]]
+        C = [[1.0, 0.0]]
+        Q = [[1e-3, 0.0], [0.0, 1e-2]]
+        R = 0.5
+        y = [0.1*i + (i % 3 - 1)*0.2 for i in range(20)]
+        x_est, y_est, P_est = kf_process(Matrix(A), Matrix([[0.0], [0.0]]), Matrix(C), Matrix([[0.0]]),
+                Matrix([y]), Matrix([[0.0]*len(y)]), Matrix([[0.0], [0.0]]), eye(2), Matrix(Q), Matrix([[R]]))
+        x, P = [0.0, 0.0], [[1.0, 0.0], [0.0, 1.0]]
+        for k in range(len(y)):
+            xh = [A[0][0]*x[0] + A[0][1]*x[1], A[1][0]*x[0] + A[1][1]*x[1]]
+            AP = [[sum([A[i][s]*P[s][j] for s in range(2)]) for j in range(2)] for i in range(2)]
+            Ph = [[sum([AP[i][s]*A[j][s] for s in range(2)]) + Q[i][j] for j in range(2)] for i in range(2)]
+            S = Ph[0][0] + R
+            K = [Ph[0][0]/S, Ph[1][0]/S]
+            e = y[k] - xh[0]
+            x = [xh[0] + K[0]*e, xh[1] + K[1]*e]
+            P = [[Ph[i][j] - K[i]*Ph[0][j] for j in range(2)] for i in range(2)]
+            self.assert_(abs(x_est[k][0] - x[0]) < 1e-9 and abs(x_est[k][1] - x[1]) < 1e-9)
+        # a singular innovation covariance stops the filter
+        z = Matrix([[0.0]])
+        args = (Matrix([[1.0]]), z, z, z, Matrix([[1.0]*3]), Matrix([[0.0]*3]), z, z, z, z)
+        for kws in ({}, {'sequential': False}, {'steady': 'auto'}):
+            try:
+                kf_process(*args, **kws)
+                self.fail('ValueError not raised')
+            except ValueError, e:
+                self.assertEqual(str(e), 'innovation covariance is singular at sample 0')
+        # also when the callback makes it singular, exceptions of the callback pass
+        Cm, Rm = Matrix([[1.0]]), Matrix([[1.0]])
+        def singular(i, *a):
+            if i == 4:
+                Cm[0, 0] = Rm[0, 0] = 0.0
+        def fails(i, *a):
+            raise KeyError(i)
+        args = (Matrix([[1.0]]), z, Cm, z, Matrix([[1.0]*9]), Matrix([[0.0]*9]), z, Matrix([[1.0]]), z, Rm)
+        try:
+            kf_process(*args, **{'mupdate_callback': singular})
+            self.fail('ValueError not raised')
+        except ValueError, e:
+            self.assertEqual(str(e), 'innovation covariance is singular at sample 5')
+        Cm[0, 0] = Rm[0, 0] = 1.0
+        self.assertRaises(KeyError, kf_process, *args, **{'mupdate_callback': fails})
+
+    def test_kf_process_outputs(self):
+        '''Kalman filter with two outputs, with and without model update callback'''
+        A = [[1.0, 0.1], [0.0, 1.0]]
+        Q = [[1e-3, 0.0], [0.0, 1e-2]]
+        R = [[0.5, 0.1], [0.1, 0.3]]
+        y = [[0.1*i + (i % 3 - 1)*0.2 for i in range(20)], [0.1 + (i % 2)*0.05 for i in range(20)]]
+        args = (Matrix(A), Matrix([[0.0], [0.0]]), eye(2), Matrix([[0.0, 0.0]]),
+                Matrix(y), Matrix([[0.0]*20]), Matrix([[0.0], [0.0]]), eye(2), Matrix(Q), Matrix(R))
+        x_est = kf_process(*args)[0]
+        x_cb = kf_process(*args, **{'mupdate_callback': lambda *a: None})[0]
+        mul = lambda X, Y: [[sum([X[i][s]*Y[s][j] for s in range(2)]) for j in range(2)] for i in range(2)]
+        x, P = [0.0, 0.0], [[1.0, 0.0], [0.0, 1.0]]
+        for k in range(20):
+            xh = [A[0][0]*x[0] + A[0][1]*x[1], A[1][0]*x[0] + A[1][1]*x[1]]
+            Ph = mul(mul(A, P), [[A[0][0], A[1][0]], [A[0][1], A[1][1]]])
+            Ph = [[Ph[i][j] + Q[i][j] for j in range(2)] for i in range(2)]
+            S = [[Ph[i][j] + R[i][j] for j in range(2)] for i in range(2)]
+            d = S[0][0]*S[1][1] - S[0][1]*S[1][0]
+            K = mul(Ph, [[S[1][1]/d, -S[0][1]/d], [-S[1][0]/d, S[0][0]/d]])
+            e = [y[0][k] - xh[0], y[1][k] - xh[1]]
+            x = [xh[i] + K[i][0]*e[0] + K[i][1]*e[1] for i in range(2)]
+            KPh = mul(K, Ph)
+            P = [[Ph[i][j] - KPh[i][j] for j in range(2)] for i in range(2)]
+            for i in range(2):
+                self.assert_(abs(x_est[k][i] - x[i]) < 1e-9)
+                self.assert_(abs(x_cb[k][i] - x[i]) < 1e-9)
+
     def x_test_fft(self):
         v = Vector([0, 1, 0, -1, 0, 1, 0, -1])
         out = fft(v)
@@ -184,6 +870,205 @@ class TestSequenceFunctions(unittest.TestCase):
         #pylab.plot(pylab.fft(v))
         pylab.show()
 
+    def test_kf_steady(self):
+        '''Riccati equation and steady state Kalman filter'''
+        A = Matrix([[1.0, 0.1], [0.0, 1.0]])
+        B = Matrix([[0.0], [0.1]])
+        C = Matrix([[1.0, 0.0]])
+        Q = Matrix([[1e-3, 0.0], [0.0, 1e-2]])
+        R = Matrix([[0.5]])
+        X = dare(A, C, Q, R)
+        E = A*X*A.T - A*X*C.T*(C*X*C.T + R).inv()*C*X*A.T + Q - X
+        self.assert_(max([abs(E[i, j]) for i in range(2) for j in range(2)]) < 1e-12)
+        # KalmanFilter converges to it
+        f = KalmanFilter(A, B, C, Matrix([[0.0]]), Q, R)
+        for k in range(500):
+            f.step(0.0)
+        K = X*C.T*(C*X*C.T + R).inv()
+        P = X - K*C*X
+        self.assert_(max([abs(f.P[i, j] - P[i, j]) for i in range(2) for j in range(2)]) < 1e-12)
+
+        n = 2500
+        y = Matrix([[0.1*(i % 50) + (i % 3 - 1)*0.2 for i in range(n)]])
+        u = Matrix([[(i % 7)*0.1 for i in range(n)]])
+        args = (A, B, C, Matrix([[0.0]]), y, u, Matrix([[0.0], [0.0]]), eye(2), Q, R)
+        x_track = kf_process(*args)[0]
+        x_auto = kf_process(*args, **{'steady': 'auto'})[0]
+        x_dare = kf_process(*args, **{'steady': True})[0]
+        self.assertEqual(kf_process(*args, **{'steady': False})[0], x_track)
+        for k in range(n):
+            self.assert_(abs(x_auto[k][0] - x_track[k][0]) < 1e-9 and abs(x_auto[k][1] - x_track[k][1]) < 1e-9)
+        for k in range(1000, n):
+            self.assert_(abs(x_dare[k][0] - x_track[k][0]) < 1e-9 and abs(x_dare[k][1] - x_track[k][1]) < 1e-9)
+        self.assert_(abs(x_dare[0][0] - x_track[0][0]) > 1e-6)
+        self.assertRaises(ValueError, kf_process, *args, **{'steady': 'x'})
+        self.assertRaises(ValueError, kf_process, *args, **{'steady': True, 'mupdate_callback': lambda *a: None})
+        self.assertRaises(ValueError, dare, A, C, Q, Matrix([[-1.0]]))
+        self.assertRaises(ValueError, dare, A, Matrix([[0.0, 0.0]]), Q, R)
+
+    def test_kf_sequential(self):
+        '''sequential measurement update for diagonal R'''
+        A = Matrix([[1.0, 0.1, 0.0], [0.0, 1.0, 0.1], [0.0, 0.0, 0.9]])
+        B = Matrix([[0.0], [0.0], [0.1]])
+        C = Matrix([[1.0, 0.0, 0.0], [0.5, 1.0, 0.0], [0.0, 0.2, 1.0]])
+        D = Matrix([[0.0, 0.1, 0.0]])
+        Q = Matrix([[1e-3, 0.0, 0.0], [0.0, 1e-2, 0.0], [0.0, 0.0, 1e-2]])
+        R = Matrix([[0.5, 0.0, 0.0], [0.0, 0.3, 0.0], [0.0, 0.0, 0.1]])
+        n = 200
+        y = Matrix([[0.1*(i % 20) + (i % 3 - 1)*0.2 for i in range(n)],
+                    [0.2 + (i % 2)*0.05 for i in range(n)],
+                    [(i % 7)*0.03 for i in range(n)]])
+        u = Matrix([[(i % 5)*0.1 for i in range(n)]])
+        args = (A, B, C, D, y, u, Matrix([[0.0]]*3), eye(3), Q, R)
+        x_seq, y_seq = kf_process(*args)[:2]
+        x_batch, y_batch = kf_process(*args, **{'sequential': False})[:2]
+        for k in range(n):
+            self.assert_(max([abs(x_seq[k][i] - x_batch[k][i]) for i in range(3)]) < 1e-12)
+            self.assert_(abs(y_seq[k] - y_batch[k]) < 1e-12)
+        # the filter object picks it up from R too
+        f = KalmanFilter(A, B, C, D, Q, R, Matrix([[0.0]]*3), eye(3))
+        X = f.step_many(y, u)
+        for k in range(n):
+            self.assert_(max([abs(X[i, k] - x_batch[k][i]) for i in range(3)]) < 1e-12)
+        # steady='auto' tracks the covariance with the same update
+        x_auto = kf_process(*args, **{'steady': 'auto'})[0]
+        for k in range(n):
+            self.assert_(max([abs(x_auto[k][i] - x_seq[k][i]) for i in range(3)]) < 1e-9)
+        # a full R takes the joint update
+        R[0, 1] = R[1, 0] = 0.05
+        self.assertEqual(kf_process(*args)[0], kf_process(*args, **{'sequential': False})[0])
+
+    def test_kalman_filter(self):
+        '''KalmanFilter object filtering sample by sample'''
+        A = Matrix([[1.0, 0.1], [0.0, 1.0]])
+        B = Matrix([[0.0], [0.1]])
+        C = eye(2)
+        D = Matrix([[0.0, 0.0]])
+        Q = Matrix([[1e-3, 0.0], [0.0, 1e-2]])
+        R = Matrix([[0.5, 0.1], [0.1, 0.3]])
+        y = Matrix([[0.1*i + (i % 3 - 1)*0.2 for i in range(30)], [0.1 + (i % 2)*0.05 for i in range(30)]])
+        u = Matrix([[(i % 5)*0.1 for i in range(30)]])
+        x_est = kf_process(A, B, C, D, y, u, Matrix([[0.0], [0.0]]), eye(2), Q, R)[0]
+        f = KalmanFilter(A, B, C, D, Q, R, Matrix([[0.0], [0.0]]), eye(2))
+        self.assertEqual(f.shape, (2, 1, 2))
+        for k in range(10):
+            x = f.step(y[:, k], Vector([u[0, k]]))
+            self.assertEqual(x.shape, (2, 1))
+            self.assert_(abs(x[0, 0] - x_est[k][0]) < 1e-12 and abs(x[1, 0] - x_est[k][1]) < 1e-12)
+        X = f.step_many(y[:, 10:], u[:, 10:])
+        self.assertEqual((X.shape, f.steps), ((2, 20), 30))
+        for k in range(10, 30):
+            self.assert_(abs(X[0, k - 10] - x_est[k][0]) < 1e-12 and abs(X[1, k - 10] - x_est[k][1]) < 1e-12)
+        self.assertEqual(f.x, X[:, 19])
+        # the model is a copy, changing it in place changes the filter
+        A[0, 1] = 0.2
+        self.assertEqual(f.A[0, 1], 0.1)
+        f.A[0, 1] = 0.2
+        self.assertEqual(f.A[0, 1], 0.2)
+        # scalar output, default x0 and P0
+        g = KalmanFilter(Matrix([[1.0]]), Matrix([[0.0]]), Matrix([[1.0]]), Matrix([[0.0]]),
+                         Matrix([[1e-4]]), Matrix([[0.25]]))
+        for v in (1.0, 1.2, 0.8, 1.1):
+            g.step(v)
+        self.assertEqual(g.step_many(Matrix([[1.0, 0.9]])).shape, (1, 2))
+        self.assert_(abs(g.x[0, 0] - 1.0) < 0.1)
+        self.assertRaises(ValueError, f.step, Vector([1, 2, 3]))
+        self.assertRaises(ValueError, f.step_many, Matrix([[1.0, 2.0]]))
+        self.assertRaises(ValueError, KalmanFilter, A, B, C, D, Q, Matrix([[1.0]]))
+        self.assertRaises(TypeError, KalmanFilter, A, B, C, D, Q, 1.0)
+        # a failing step leaves the filter as it was
+        x, P, steps = f.x.copy(), f.P.copy(), f.steps
+        f.C[0, 0] = f.C[1, 1] = 0.0
+        f.R[0, 0] = f.R[1, 1] = f.R[0, 1] = f.R[1, 0] = 0.0
+        self.assertRaises(ValueError, f.step, Vector([1, 2]))
+        self.assertEqual((f.x, f.P, f.steps), (x, P, steps))
+        f.R[0, 0] = f.R[1, 1] = f.R[0, 1] = f.R[1, 0] = 1.0
+        self.assertRaises(ValueError, f.step_many, Matrix([[1.0, 2.0], [2.0, 1.0]]))
+        self.assertEqual((f.x, f.P, f.steps), (x, P, steps))
+
+    def test_kalman_bank(self):
+        '''KalmanBank against independent KalmanFilter objects'''
+        A = Matrix([[1.0, 0.1], [0.0, 1.0]])
+        B = Matrix([[0.0], [0.1]])
+        C = eye(2)
+        D = Matrix([[0.0, 0.0]])
+        Q = Matrix([[1e-3, 0.0], [0.0, 1e-2]])
+        R = Matrix([[0.5, 0.1], [0.1, 0.3]])
+        N = 150
+        x0 = Matrix([[0.01*f for f in range(N)], [1.0]*N])
+        bank = KalmanBank(N, A, B, C, D, Q, R, x0, eye(2)*2)
+        self.assertEqual((bank.count, bank.shape, bank.x.shape, bank.P.shape), (N, (2, 1, 2), (2, N), (4, N)))
+        fs = [KalmanFilter(A, B, C, D, Q, R, x0[:, f].copy(), eye(2)*2) for f in (0, 63, 64, N - 1)]
+        for k in range(10):
+            Y = Matrix([[0.1*k + (f % 3)*0.01 for f in range(N)], [0.2*(k % 2) for f in range(N)]])
+            U = Matrix([[(k + f) % 4*0.1 for f in range(N)]])
+            self.assertEqual(bank.step(Y, U), 0)
+            for g, f in zip(fs, (0, 63, 64, N - 1)):
+                x = g.step(Y[:, f], U[:, f])
+                self.assert_(abs(bank.x[0, f] - x[0, 0]) < 1e-12 and abs(bank.x[1, f] - x[1, 0]) < 1e-12)
+                P = bank.covariance(f)
+                self.assert_(max([abs(P[i, j] - g.P[i, j]) for i in range(2) for j in range(2)]) < 1e-12)
+        # a transposed view and float32 samples are read too
+        bank.reset(5, Matrix([[1.0], [2.0]]), eye(2))
+        self.assertEqual((bank.x[0, 5], bank.x[1, 5], bank.covariance(5)), (1.0, 2.0, eye(2)))
+        self.assertEqual(bank.step(Matrix([[1.0, 0.5]]*N).T), 0)
+        self.assertEqual(bank.step(Matrix([[1.0]*N, [0.5]*N]).astype('f4')), 0)
+        # the same initial state for all filters
+        b1 = KalmanBank(3, A, B, C, D, Q, R, Matrix([[1.0], [2.0]]))
+        self.assertEqual(b1.x, Matrix([[1.0]*3, [2.0]*3]))
+        self.assertEqual(b1.covariance(2), eye(2))
+        self.assertRaises(ValueError, bank.step, Matrix([[1.0]*N]))
+        self.assertRaises(ValueError, bank.step, Matrix([[1.0]*N]*2), Matrix([[1.0]*3]))
+        self.assertRaises(IndexError, bank.covariance, N)
+        self.assertRaises(ValueError, KalmanBank, 0, A, B, C, D, Q, R)
+
+    def test_kalman_bank_ud(self):
+        '''KalmanBank in the square root (UD) form, also in single precision'''
+        A = Matrix([[1.0, 0.1], [0.0, 1.0]])
+        B = Matrix([[0.0], [0.1]])
+        C = Matrix([[1.0, 0.0], [0.3, 1.0]])
+        D = Matrix([[0.0, 0.0]])
+        Q = Matrix([[1e-3, 2e-4], [2e-4, 1e-2]])
+        R = Matrix([[0.5, 0.1], [0.1, 0.3]])
+        P0 = Matrix([[2.0, 0.3], [0.3, 1.0]])
+        N = 70
+        bank = KalmanBank(N, A, B, C, D, Q, R, None, P0)
+        ud = KalmanBank(N, A, B, C, D, Q, R, None, P0, ud=True)
+        udf = KalmanBank(N, A, B, C, D, Q, R, None, P0, dtype='f4')
+        self.assertEqual((bank.ud, ud.ud, udf.ud), (False, True, True))
+        self.assertEqual((ud.dtype, udf.dtype, udf.x.dtype, udf.U.shape, udf.d.shape), ('f8', 'f4', 'f4', (4, N), (2, N)))
+        self.assertEqual(ud.covariance(3), P0)
+        self.assertRaises(AttributeError, getattr, ud, 'P')
+        for k in range(40):
+            Y = Matrix([[0.1*k + 0.01*f for f in range(N)], [0.2 - 0.001*f for f in range(N)]])
+            U = Matrix([[0.1*(k % 5)]*N])
+            self.assertEqual((bank.step(Y, U), ud.step(Y, U), udf.step(Y, U)), (0, 0, 0))
+        for f in (0, 33, N - 1):
+            P, P8, P4 = bank.covariance(f), ud.covariance(f), udf.covariance(f)
+            for i in range(2):
+                self.assert_(abs(ud.x[i, f] - bank.x[i, f]) < 1e-12 and abs(udf.x[i, f] - bank.x[i, f]) < 1e-4)
+                self.assert_(abs(ud.y[i, f] - bank.y[i, f]) < 1e-12)
+                for j in range(2):
+                    self.assert_(abs(P8[i, j] - P[i, j]) < 1e-12 and abs(P4[i, j] - P[i, j]) < 1e-6*abs(P[i, j]) + 1e-9)
+        # P0 and R spanning many orders of magnitude
+        A = Matrix([[1.0, 1.0], [0.0, 1.0]])
+        C = Matrix([[1.0, 0.0]])
+        Q = Matrix([[1e-8, 0.0], [0.0, 1e-8]])
+        P0 = Matrix([[1e6, 0.0], [0.0, 1e6]])
+        bank = KalmanBank(8, A, B, C, Matrix([[0.0]]), Q, Matrix([[1e-6]]), None, P0)
+        udf = KalmanBank(8, A, B, C, Matrix([[0.0]]), Q, Matrix([[1e-6]]), None, P0, dtype='f4')
+        for k in range(1000):
+            Y = Matrix([[0.5*k + 0.001*(k % 3)]*8])
+            bank.step(Y)
+            udf.step(Y.astype('f4'))
+        P, P4 = bank.covariance(5), udf.covariance(5)
+        self.assert_(max([abs(P4[i, j] - P[i, j])/abs(P[i, j]) for i in range(2) for j in range(2)]) < 1e-4)
+        self.assert_(min([udf.d[i, f] for i in range(2) for f in range(8)]) > 0)
+        self.assertRaises(ValueError, KalmanBank, 8, A, B, C, Matrix([[0.0]]), Q, Matrix([[1.0]]), None, None, 'f4', False)
+        self.assertRaises(ValueError, udf.reset, 0, None, Matrix([[1.0, 2.0], [2.0, 1.0]]))
+        udf = KalmanBank(8, A, B, C, Matrix([[0.0]]), Q, Matrix([[0.0]]), dtype='f4')
+        self.assertRaises(ValueError, udf.step, Matrix([[1.0]*8]))
+
     def test_rms(self):
         v = [sin(2*pi*y/1023.) for y in range(1024)]
         v = Vector(v)
@@ -56,6 +56,9 @@ matrixrow2vector(PyObject *object, Float *p_data)
     y->data = NULL;
     y->p_data = p_data;
     y->length = -1;
+    y->dtype = Matrix_Check(object)? ((MatrixObject *)object)->dtype : PN_F8;
+    y->stride = Matrix_Check(object)? ((MatrixObject *)object)->cs : 1;
+    y->buffer = NULL;
     Py_INCREF(object);
     
     return y;
@@ -68,6 +71,17 @@ matrixrow2vector(PyObject *object, Float *p_data)
  */
 PyAPI_FUNC(VectorObject *)
 vector_new(int length)
+{
+    return vector_new_dtype(length, PN_F8);
+}
+
+
+
+/*
+ * create new empty vector with given dtype
+ */
+PyAPI_FUNC(VectorObject *)
+vector_new_dtype(int length, int dtype)
 {
     DEBUG("vector_new(%d)", length);
     VectorObject *y = NULL;
@@ -80,7 +94,11 @@ vector_new(int length)
     
     PyObject_Init((PyObject *)y, &VectorType);
     y->object = NULL;
-    y->data = m_new(1, length);
+    y->dtype = dtype;
+    if (dtype == PN_F4)
+        y->data = (Float *)mf_new(1, length);
+    else
+        y->data = m_new(1, length);
     if (y->data == NULL) {
         Py_DECREF(y);
         PyErr_SetString(PyExc_MemoryError, "Can't allocate memory for vector data");
@@ -88,6 +106,8 @@ vector_new(int length)
     }
     y->p_data = NULL;
     y->length = length;
+    y->stride = 1;
+    y->buffer = NULL;
     
     return y;
 }
@@ -132,6 +152,43 @@ vector_dataptr(VectorObject *v)
 
 
 
+/*
+ * item i of vector v with data, as double
+ */
+#define VAT(v, data, i) PN_GET(data, (v)->dtype, (i)*(v)->stride)
+
+
+
+/*
+ * copy n items from start into array dst of the vector dtype
+ */
+static void
+gather(VectorObject *v, int start, int n, Float *dst)
+{
+    Float *data = vector_dataptr(v);
+    int i;
+
+    if (v->stride == 1) {
+        memcpy(dst, PN_PTR(data, v->dtype, start), n*dtype_size(v->dtype));
+        return;
+    }
+    for (i=0; i<n; i++)
+        PN_SET(dst, v->dtype, i, VAT(v, data, start + i));
+}
+
+
+
+/*
+ * copy items into array dst of the vector dtype
+ */
+PyAPI_FUNC(void)
+vector_pack(VectorObject *v, Float *dst)
+{
+    gather(v, 0, vector_length(v), dst);
+}
+
+
+
 /*
  * deallocating vector object form memory
  */
@@ -141,6 +198,8 @@ vector_dealloc(VectorObject *v)
     if (v->object != NULL) {
         Py_DECREF(v->object); // decrement the matrix pointer if exists
     }
+    if (v->buffer != NULL)
+        buffer_free(v->buffer);
     
     PyObject_Del(v);
 }
@@ -175,7 +234,7 @@ vector_repr(VectorObject *a)
         if (i > 0)
             PyString_Concat(&result, comma);
         
-        sprintf(fstr, "%g", data[i]);
+        sprintf(fstr, "%g", VAT(a, data, i));
         PyString_ConcatAndDel(&result, PyString_FromString(fstr));
     }
     
@@ -194,7 +253,7 @@ PyAPI_FUNC(PyObject *)
 vector_add(VectorObject *v, PyObject *val)
 {
     VectorObject *out;
-    Float x, *data;
+    Float x;
     int len=0;
     
     DEBUG("vector_add\n");
@@ -209,11 +268,16 @@ vector_add(VectorObject *v, PyObject *val)
         return NULL;
     }
     
-    data = vector_dataptr(v);
     len = vector_length(v);
     
-    out = vector_new(len);
-    m_add_scalar(x, data, vector_dataptr(out), 1, len);
+    out = vector_new_dtype(len, v->dtype);
+    if (out == NULL)
+        return NULL;
+    vector_pack(v, out->data);
+    if (v->dtype == PN_F4)
+        mf_add_scalar((float)x, FDATA(out->data), FDATA(out->data), 1, len);
+    else
+        m_add_scalar(x, out->data, out->data, 1, len);
     Py_INCREF(out);
     
     return (PyObject*)out;
@@ -228,7 +292,7 @@ PyAPI_FUNC(PyObject *)
 vector_sub(VectorObject *v, PyObject *val)
 {
     VectorObject *out;
-    Float x, *data;
+    Float x;
     int len=0;
     
     DEBUG("vector_sub\n");
@@ -243,11 +307,16 @@ vector_sub(VectorObject *v, PyObject *val)
         return NULL;
     }
     
-    data = vector_dataptr(v);
     len = vector_length(v);
     
-    out = vector_new(len);
-    m_add_scalar(-x, data, vector_dataptr(out), 1, len);
+    out = vector_new_dtype(len, v->dtype);
+    if (out == NULL)
+        return NULL;
+    vector_pack(v, out->data);
+    if (v->dtype == PN_F4)
+        mf_add_scalar(-(float)x, FDATA(out->data), FDATA(out->data), 1, len);
+    else
+        m_add_scalar(-x, out->data, out->data, 1, len);
     Py_INCREF(out);
     
     return (PyObject*)out;
@@ -262,8 +331,8 @@ PyAPI_FUNC(VectorObject *)
 vector_mul(VectorObject *self, VectorObject *other)
 {
     VectorObject *out;
-    Float *data_self, *data_other;
-    int len_self = 0, len_other = 0, i;
+    Float *data_self, *data_other, *b, a;
+    int len_self = 0, len_other = 0;
     
     DEBUG("vector_mul\n");
     
@@ -273,22 +342,48 @@ vector_mul(VectorObject *self, VectorObject *other)
     data_other = vector_dataptr(other);
     len_other = vector_length(other);
     
-    if (len_self == 1) { // first vector is scalar
-        DEBUG("  first vector is scalar\n");
-        out = vector_new(len_other);
-        m_copy(out->data, data_other, len_other, 1);
-        m_scale(*(data_self), out->data, len_other, 1);
-    } else if (len_other == 1) { // second vector is scalar
-        DEBUG("  second vector is scalar\n");
-        out = vector_new(len_self);
-        m_copy(out->data, data_self, len_self, 1);
-        m_scale(*(data_other), out->data, len_self, 1);
+    if (len_self == 1 || len_other == 1) { // one of vectors is scalar
+        DEBUG("  scalar times vector\n");
+        if (len_self == 1) {
+            a = VAT(self, data_self, 0);
+            self = other;
+            len_self = len_other;
+        } else {
+            a = VAT(other, data_other, 0);
+        }
+        out = vector_new_dtype(len_self, self->dtype);
+        if (out == NULL)
+            return NULL;
+        vector_pack(self, out->data);
+        if (self->dtype == PN_F4)
+            mf_scale((float)a, FDATA(out->data), len_self, 1);
+        else
+            m_scale(a, out->data, len_self, 1);
     } else if (len_self == len_other) {
-        out = vector_new(len_self);
+        if (self->dtype != other->dtype) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            return NULL;
+        }
+        out = vector_new_dtype(len_self, self->dtype);
+        if (out == NULL)
+            return NULL;
         DEBUG("  same length vectors\n");
-        for (i=0; i<len_self; i++) {
-            *(out->data + i) = *(data_self + i) * *(data_other + i);
+        b = data_other;
+        if (other->stride != 1) {
+            b = (self->dtype == PN_F4)? (Float *)mf_new(1, len_other) : m_new(1, len_other);
+            if (b == NULL) {
+                Py_DECREF(out);
+                return (VectorObject *)PyErr_NoMemory();
+            }
+            vector_pack(other, b);
         }
+        vector_pack(self, out->data);
+        if (self->dtype == PN_F4)
+            mf_emul(FDATA(out->data), FDATA(b), FDATA(out->data), len_self, 1);
+        else
+            m_emul(out->data, b, out->data, len_self, 1);
+        if (b != data_other)
+            m_free(b);
     } else {
         PyErr_SetObject(PyExc_ValueError, PyString_FromString("Vectors must be the same length"));
         return NULL;
@@ -300,6 +395,136 @@ vector_mul(VectorObject *self, VectorObject *other)
 
 
 
+/*
+ * memory of a and b intersects but the items are not the same
+ */
+static int
+overlaps(VectorObject *a, VectorObject *b)
+{
+    char *pa = (char *)vector_dataptr(a), *pb = (char *)vector_dataptr(b);
+    char *ea, *eb;
+
+    if (pa == pb && a->stride == b->stride && a->dtype == b->dtype)
+        return 0;
+    ea = (char *)PN_PTR(pa, a->dtype, (vector_length(a) - 1)*a->stride);
+    eb = (char *)PN_PTR(pb, b->dtype, (vector_length(b) - 1)*b->stride);
+    return (pa <= eb) && (pb <= ea);
+}
+
+
+
+/*
+ * self op= other written into the data of self (also a matrix row),
+ * other is a number or a Vector of the same length
+ * return NotImplemented for anything else
+ */
+static PyObject *
+inplace(VectorObject *self, PyObject *other, int op)
+{
+    VectorObject *v;
+    Float x = 0, *b = NULL;
+    int len = vector_length(self);
+
+    if (PyInt_Check(other) || PyLong_Check(other) || PyFloat_Check(other)) {
+        x = PyFloat_AsDouble(other);
+        if (x == -1 && PyErr_Occurred())
+            return NULL;
+    } else if (Vector_Check(other)) {
+        v = (VectorObject *)other;
+        if (vector_length(v) != len) {
+            PyErr_SetString(PyExc_ValueError, "Vectors must be the same length");
+            return NULL;
+        }
+        if (v->dtype != self->dtype) {
+            PyErr_SetString(PyExc_TypeError, "dtypes differ, convert with astype()");
+            return NULL;
+        }
+        b = vector_dataptr(v);
+        if (v->stride != 1 || overlaps(self, v)) {
+            b = (v->dtype == PN_F4)? (Float *)mf_new(1, len) : m_new(1, len);
+            if (b == NULL)
+                return PyErr_NoMemory();
+            vector_pack(v, b);
+        }
+    } else {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+
+    dtype_update(vector_dataptr(self), self->stride, op, b, x, len, self->dtype);
+    if (b != NULL && b != vector_dataptr((VectorObject *)other))
+        m_free(b);
+    if (self->object != NULL && Matrix_Check(self->object))
+        matrix_modified((MatrixObject *)self->object);
+
+    Py_INCREF(self);
+    return (PyObject *)self;
+}
+
+
+
+/*
+ * self += other
+ */
+PyAPI_FUNC(PyObject *)
+vector_inplace_add(VectorObject *self, PyObject *other)
+{
+    return inplace(self, other, PN_IADD);
+}
+
+
+
+/*
+ * self -= other
+ */
+PyAPI_FUNC(PyObject *)
+vector_inplace_sub(VectorObject *self, PyObject *other)
+{
+    return inplace(self, other, PN_ISUB);
+}
+
+
+
+/*
+ * self *= other, elementwise for a Vector
+ */
+PyAPI_FUNC(PyObject *)
+vector_inplace_mul(VectorObject *self, PyObject *other)
+{
+    return inplace(self, other, PN_IMUL);
+}
+
+
+
+/*
+ * self /= number
+ */
+PyAPI_FUNC(PyObject *)
+vector_inplace_div(VectorObject *self, PyObject *other)
+{
+    Float x;
+
+    if (!PyInt_Check(other) && !PyLong_Check(other) && !PyFloat_Check(other)) {
+        Py_INCREF(Py_NotImplemented);
+        return Py_NotImplemented;
+    }
+    x = PyFloat_AsDouble(other);
+    if (x == -1 && PyErr_Occurred())
+        return NULL;
+    if (x == 0) {
+        PyErr_SetString(PyExc_ZeroDivisionError, "Vector division by zero");
+        return NULL;
+    }
+    other = PyFloat_FromDouble(1/x);
+    if (other == NULL)
+        return NULL;
+    self = (VectorObject *)inplace(self, other, PN_IMUL);
+    Py_DECREF(other);
+    return (PyObject *)self;
+}
+
+
+
 /*
  * return absolute values of vector items
  */
@@ -315,12 +540,13 @@ vector_absolute(VectorObject *self)
     data = vector_dataptr(self);
     len = vector_length(self);
     
-    out = vector_new(len);
+    out = vector_new_dtype(len, self->dtype);
+    if (out == NULL)
+        return NULL;
     
     dst = vector_dataptr(out);
-    i = 0;
-    while(dst < vector_dataptr(out) + len) {
-        *(dst++) = Fabs(*(data++));
+    for (i=0; i<len; i++) {
+        PN_SET(dst, self->dtype, i, Fabs(VAT(self, data, i)));
     }
     
     Py_INCREF(out);
@@ -348,7 +574,7 @@ vector_item(VectorObject *a, int i)
         return NULL;
     }
     
-    out = (PyObject*)PyFloat_FromDouble(*(data + i));
+    out = (PyObject*)PyFloat_FromDouble(VAT(a, data, i));
     return out;
 }
 
@@ -385,7 +611,9 @@ vector_ass_item(VectorObject *self, int idx, PyObject *val)
     }
     
     p_data = vector_dataptr(self);
-    *(p_data + idx) = x;
+    PN_SET(p_data, self->dtype, idx*self->stride, x);
+    if (self->object != NULL && Matrix_Check(self->object))
+        matrix_modified((MatrixObject *)self->object);
     
     return 0;
 }
@@ -399,7 +627,7 @@ vector_ass_item(VectorObject *self, int idx, PyObject *val)
 PyAPI_FUNC(int)
 vector_cmp(VectorObject *self, VectorObject *other)
 {
-    Float *s, *o, sub, max;
+    Float *s, *o, sub, max, a, b;
     Float eps = 1e-8; // TODO: hope this will be enough
     long i, length, result = 0;
     DEBUG("vector_cmp\n");
@@ -413,19 +641,20 @@ vector_cmp(VectorObject *self, VectorObject *other)
         s = vector_dataptr(self);
         o = vector_dataptr(other);
         DEBUG(" self length: %d\n", length);
+        if (self->dtype == PN_F4 || other->dtype == PN_F4)
+            eps = 1e-6;
         
         for (i=0; i<length; i++) {
-            DEBUG(" compare step %d: %g - %g = %g\n", i, *s, *o, *s-*o);
-            sub = *s - *o;
-            max = MAX(*s, *o);
+            a = VAT(self, s, i);
+            b = VAT(other, o, i);
+            DEBUG(" compare step %d: %g - %g = %g\n", i, a, b, a-b);
+            sub = a - b;
+            max = MAX(a, b);
             
             if (max != 0) {
                 sub = sub / max;
             }
             
-            s++;
-            o++;
-            
             if (Fabs(sub) > eps) {
                 DEBUG("  FABS");
                 if (sub > 0) {
@@ -503,7 +732,6 @@ PyAPI_FUNC(PyObject *)
 vector_slice(VectorObject *self, int ilow, int ihigh)
 {
     VectorObject *np;
-    Float *data;
     int len;
     
     if (ilow < 0)
@@ -520,13 +748,11 @@ vector_slice(VectorObject *self, int ilow, int ihigh)
     DEBUG("   len: %d\n", len);
     DEBUG("   ilow: %d\n", ilow);
     
-    data = vector_dataptr(self);
     //np = vector_new((PyObject*)self, data + ilow);
-    np = vector_new(len);
-    m_copy(vector_dataptr(np), data + ilow, 1, len);
-    
+    np = vector_new_dtype(len, self->dtype);
     if (np == NULL)
         return NULL;
+    gather(self, ilow, len, vector_dataptr(np));
     
     Py_INCREF(np);
     return (PyObject*)np;
@@ -534,27 +760,206 @@ vector_slice(VectorObject *self, int ilow, int ihigh)
 
 
 
+/*
+ * copy of the vector in dtype
+ */
+static PyObject *
+convert(VectorObject *self, int dtype)
+{
+    VectorObject *out;
+    Float *data = vector_dataptr(self);
+    int i, len = vector_length(self);
+
+    out = vector_new_dtype(len, dtype);
+    if (out == NULL)
+        return NULL;
+    if (dtype == self->dtype)
+        vector_pack(self, out->data);
+    else if (self->stride == 1)
+        dtype_convert(out->data, dtype, data, self->dtype, len);
+    else
+        for (i=0; i<len; i++)
+            PN_SET(out->data, dtype, i, VAT(self, data, i));
+
+    return (PyObject *)out;
+}
+
+
+
+/*
+ * copy of the vector converted to dtype
+ */
+PyAPI_FUNC(PyObject *)
+vector_astype(VectorObject *self, PyObject *args)
+{
+    PyObject *o;
+    int dtype;
+
+    if (!PyArg_ParseTuple(args, "O", &o))
+        return NULL;
+    if ((dtype = dtype_parse(o)) < 0)
+        return NULL;
+
+    return convert(self, dtype);
+}
+
+
+
+/*
+ * new buffer protocol, 1-D data with the stride of the vector
+ */
+static int
+vector_getbuffer(VectorObject *self, Py_buffer *view, int flags)
+{
+    int len = vector_length(self);
+
+    if (buffer_export((PyObject *)self, view, flags, vector_dataptr(self), self->dtype, 1,
+                      &len, &self->stride, self->layout))
+        return -1;
+    if (self->object != NULL && Matrix_Check(self->object))
+        matrix_exports((MatrixObject *)self->object, 1);
+    return 0;
+}
+
+static void
+vector_releasebuffer(VectorObject *self, Py_buffer *view)
+{
+    if (self->object != NULL && Matrix_Check(self->object))
+        matrix_exports((MatrixObject *)self->object, -1);
+}
+
+
+
+/*
+ * old buffer protocol, contiguous data only
+ */
+static Py_ssize_t
+vector_getreadbuffer(VectorObject *self, Py_ssize_t seg, void **ptr)
+{
+    return buffer_segment(vector_dataptr(self), vector_length(self)*dtype_size(self->dtype),
+                          self->stride == 1 || vector_length(self) <= 1, seg, ptr);
+}
+
+static Py_ssize_t
+vector_getwritebuffer(VectorObject *self, Py_ssize_t seg, void **ptr)
+{
+    if (self->object != NULL && Matrix_Check(self->object))
+        matrix_modified((MatrixObject *)self->object);
+    return vector_getreadbuffer(self, seg, ptr);
+}
+
+static Py_ssize_t
+vector_getsegcount(VectorObject *self, Py_ssize_t *len)
+{
+    if (len != NULL)
+        *len = vector_length(self)*dtype_size(self->dtype);
+    return 1;
+}
+
+
+
+/*
+ * Vector.frombuffer(buffer, length=-1, dtype=None, offset=0)
+ * Vector sharing the memory of buffer, length and dtype are taken from
+ * the buffer if they are not given, a read only buffer is copied
+ */
+PyAPI_FUNC(PyObject *)
+vector_frombuffer(PyObject *cls, PyObject *args, PyObject *kws)
+{
+    static char *kwlist[] = {"buffer", "length", "dtype", "offset", NULL};
+    PyObject *obj, *dtype_o = Py_None;
+    Py_ssize_t offset = 0, len = -1, stride, i;
+    Py_buffer *view;
+    VectorObject *y;
+    Float *data;
+    int dtype = -1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|nOn", kwlist, &obj, &len, &dtype_o, &offset))
+        return NULL;
+    if (dtype_o != Py_None && (dtype = dtype_parse(dtype_o)) < 0)
+        return NULL;
+
+    if ((view = buffer_acquire(obj)) == NULL)
+        return NULL;
+    data = buffer_layout(view, &dtype, offset, 1, &len, &stride);
+    if (data == NULL) {
+        buffer_free(view);
+        return NULL;
+    }
+
+    if (view->readonly) {
+        y = vector_new_dtype(len, dtype);
+        if (y != NULL)
+            for (i=0; i<len; i++)
+                PN_SET(y->data, dtype, i, PN_GET(data, dtype, i*stride));
+        buffer_free(view);
+        return (PyObject *)y;
+    }
+
+    if (buffer_aligned(data, dtype) || (y = vector_new_dtype(1, dtype)) == NULL) {
+        buffer_free(view);
+        return NULL;
+    }
+    m_free(y->data); // the data are in the buffer
+    y->data = data;
+    y->length = len;
+    y->stride = stride;
+    y->buffer = view;
+
+    return (PyObject *)y;
+}
+
+
+
+PyMethodDef VectorObject_methods[] = {
+    {"astype", (PyCFunction)vector_astype, METH_VARARGS, "copy converted to dtype 'f8' or 'f4'"},
+    {"frombuffer", (PyCFunction)vector_frombuffer, METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+        "Vector sharing the memory of a buffer object"},
+    {"__reduce__", (PyCFunction)serial_reduce, METH_NOARGS, "pickle support, raw data of dumps()"},
+    {NULL}  /* Sentinel */
+};
+
+
+
+/*
+ * return attribute value
+ */
+PyAPI_FUNC(PyObject *)
+vector_getattr(VectorObject *self, char *name)
+{
+    if (!strcmp(name, "dtype"))
+        return PyString_FromString(dtype_name(self->dtype));
+
+    return Py_FindMethod(VectorObject_methods, (PyObject *)self, name);
+}
+
+
+
 /*
  * create new VectorObject from list (tuple)
  */
 PyAPI_FUNC(PyObject *)
-VectorObject_New(PyTypeObject *type, PyObject *args)
+VectorObject_New(PyTypeObject *type, PyObject *args, PyObject *kws)
 {
     VectorObject *self;
     Py_ssize_t length=0;
-    PyObject *listObject;
+    PyObject *listObject, *o_dtype = NULL;
+    int dtype;
+    static char *kwlist[] = {"data", "dtype", NULL};
     
-    if (!PyArg_ParseTuple(args, "O", &listObject)) {
+    if (!PyArg_ParseTupleAndKeywords(args, kws, "O|O", kwlist, &listObject, &o_dtype)) {
         PyErr_BadArgument();
         return NULL;
     }
+    if ((dtype = dtype_parse(o_dtype)) < 0)
+        return NULL;
     
     // [0]
-    if (PyList_Check(listObject)) {
-        length = PyList_Size(listObject);
-    } else if (PyTuple_Check(listObject)) {
-        length = PyTuple_Size(listObject);
+    if (PyList_Check(listObject) || PyTuple_Check(listObject)) {
+        length = PySequence_Fast_GET_SIZE(listObject);
     } else if (listObject->ob_type == &VectorType) {
+        if (o_dtype != NULL && dtype != ((VectorObject *)listObject)->dtype)
+            return convert((VectorObject *)listObject, dtype);
         Py_INCREF(listObject);
         return listObject;
     } else {
@@ -566,14 +971,14 @@ VectorObject_New(PyTypeObject *type, PyObject *args)
         return Py_None;
     }
     
-    self = vector_new(length);
+    self = vector_new_dtype(length, dtype);
     if (self == NULL) {
         PyErr_NoMemory();
         return NULL;
     }
     
-    if (!PyArg_GetDoubleArray(listObject, 1, 0, length, vector_dataptr(self))) {
-        PyErr_BadArgument();
+    if (dtype_fill(vector_dataptr(self), dtype, listObject)) {
+        Py_DECREF(self);
         return NULL;
     }
     
@@ -660,6 +1065,26 @@ PyAPI_DATA(PyNumberMethods) vector_as_number = {
     0,//proxy_or,               /* nb_or */
     // more on coercing: http://www.ragestorm.net/tutorials/25/pyextnum.html
     (coercion)vector_coerce,               /* nb_coerce */
+    0,                               /*nb_int*/
+    0,                               /*nb_long*/
+    0,                               /*nb_float*/
+    0,                               /*nb_oct*/
+    0,                               /*nb_hex*/
+    (binaryfunc)vector_inplace_add,  /*inplace_add*/
+    (binaryfunc)vector_inplace_sub,  /*inplace_subtract*/
+    (binaryfunc)vector_inplace_mul,  /*inplace_multiply*/
+    (binaryfunc)vector_inplace_div,  /*inplace_divide*/
+    0,                               /*inplace_remainder*/
+    0,                               /*inplace_power*/
+    0,                               /*inplace_lshift*/
+    0,                               /*inplace_rshift*/
+    0,                               /*inplace_and*/
+    0,                               /*inplace_xor*/
+    0,                               /*inplace_or*/
+    0,                               /*nb_floor_divide*/
+    0,                               /*nb_true_divide*/
+    0,                               /*nb_inplace_floor_divide*/
+    (binaryfunc)vector_inplace_div,  /*nb_inplace_true_divide*/
 };
 
 
@@ -676,6 +1101,17 @@ PyAPI_DATA(PySequenceMethods) vector_as_sequence = {
 
 
 
+static PyBufferProcs vector_as_buffer = {
+    (readbufferproc)vector_getreadbuffer,   /* bf_getreadbuffer */
+    (writebufferproc)vector_getwritebuffer, /* bf_getwritebuffer */
+    (segcountproc)vector_getsegcount,       /* bf_getsegcount */
+    (charbufferproc)vector_getreadbuffer,   /* bf_getcharbuffer */
+    (getbufferproc)vector_getbuffer,        /* bf_getbuffer */
+    (releasebufferproc)vector_releasebuffer,/* bf_releasebuffer */
+};
+
+
+
 PyAPI_DATA(PyTypeObject) VectorType = {
     PyObject_HEAD_INIT(NULL)
     0,                      /*ob_size*/
@@ -684,7 +1120,7 @@ PyAPI_DATA(PyTypeObject) VectorType = {
     0,                      /*tp_itemsize*/
     (destructor)vector_dealloc,     /* tp_dealloc */
     0,//(printfunc)row_print,            /* tp_print */
-    0,//(getattrfunc)row_getattr,        /* tp_getattr */
+    (getattrfunc)vector_getattr,     /* tp_getattr */
     0,                  /* tp_setattr */
     (cmpfunc)vector_cmp,  /* tp_compare */
     //http://docs.python.org/extending/newtypes.html#object-presentation
@@ -697,11 +1133,15 @@ PyAPI_DATA(PyTypeObject) VectorType = {
     0,                  /* tp_str */
     (getattrofunc)0,                  /* tp_getattro */
     (setattrofunc)0,                  /* tp_setattro */
-    0,//&row_as_buffer,          /* tp_as_buffer*/
-    Py_TPFLAGS_DEFAULT, /* tp_flags */
+    &vector_as_buffer,  /* tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, /* tp_flags */
     0,//rowtype_doc,             /* tp_doc */
     0,                  /* tp_traverse */
     0,                  /* tp_clear */
     0,//(richcmpfunc)vector_cmp//row_richcompare,         /* tp_richcompare */
+    0,                  /* tp_weaklistoffset */
+    0,                  /* tp_iter */
+    0,                  /* tp_iternext */
+    VectorObject_methods, /* tp_methods */
 };
 
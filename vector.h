@@ -39,6 +39,11 @@ typedef struct {
     // this is useless if vector is matrix row
     int length;
     Float *data;
+    int dtype; // PN_F8 or PN_F4, same as the matrix for matrix rows
+    int stride; // item i is at p_data[i*stride], column stride of the matrix, 1 for own data
+                // (or data[i*stride] for a buffer)
+    Py_buffer *buffer; // memory of another object wrapped by frombuffer(), data point into it
+    Py_ssize_t layout[2]; // shape and stride in bytes of exported buffers
 } VectorObject;
 
 PyAPI_DATA(PyTypeObject) VectorType;
@@ -49,10 +54,18 @@ PyAPI_DATA(PyTypeObject) VectorType;
 PyAPI_FUNC(VectorObject *) matrixrow2vector(PyObject *object, Float *p_data);
 // create new vector object
 PyAPI_FUNC(VectorObject *) vector_new(int length);
+// create new vector object with given dtype
+PyAPI_FUNC(VectorObject *) vector_new_dtype(int length, int dtype);
+// copy of the vector converted to dtype
+PyAPI_FUNC(PyObject *) vector_astype(VectorObject *self, PyObject *args);
+// return attribute value
+PyAPI_FUNC(PyObject *) vector_getattr(VectorObject *self, char *name);
 // return vector length
 PyAPI_FUNC(Py_ssize_t) vector_length(VectorObject *v);
 // return vector data pointer
 Float * vector_dataptr(VectorObject *v);
+// copy items into array dst of the vector dtype
+PyAPI_FUNC(void) vector_pack(VectorObject *v, Float *dst);
 // deallocating vector object form memory
 PyAPI_FUNC(void) vector_dealloc(VectorObject *v);
 // repr, printing of vector or vector row
@@ -61,6 +74,14 @@ PyAPI_FUNC(PyObject *) vector_repr(VectorObject *a);
 PyAPI_FUNC(PyObject *) vector_add(VectorObject *v, PyObject *val);
 // return vector - number
 PyAPI_FUNC(PyObject *) vector_sub(VectorObject *v, PyObject *val);
+// self += other, other is a number or Vector
+PyAPI_FUNC(PyObject *) vector_inplace_add(VectorObject *self, PyObject *other);
+// self -= other, other is a number or Vector
+PyAPI_FUNC(PyObject *) vector_inplace_sub(VectorObject *self, PyObject *other);
+// self *= other, elementwise for a Vector
+PyAPI_FUNC(PyObject *) vector_inplace_mul(VectorObject *self, PyObject *other);
+// self /= number
+PyAPI_FUNC(PyObject *) vector_inplace_div(VectorObject *self, PyObject *other);
 // return vector item
 PyAPI_FUNC(PyObject *) vector_item(VectorObject *a, int i);
 // set value to vector row item
@@ -68,11 +89,13 @@ PyAPI_FUNC(int) vector_ass_item(VectorObject *self, int idx, PyObject *val);
 // comparison of two vectors
 PyAPI_FUNC(int) vector_cmp(VectorObject *self, VectorObject *other);
 // create new VectorObject from list (tuple)
-PyAPI_FUNC(PyObject *) VectorObject_New(PyTypeObject *type, PyObject *args);
+PyAPI_FUNC(PyObject *) VectorObject_New(PyTypeObject *type, PyObject *args, PyObject *kws);
 // to decide, if we can make arithmetic operation on current datatypes
 int vector_coerce(PyObject **v, PyObject **w);
 // returns ref (not copy) to current vector object
 PyAPI_FUNC(PyObject *) vector_slice(VectorObject *self, int ilow, int ihigh);
+// Vector.frombuffer(buffer, length, dtype, offset), no data are copied
+PyAPI_FUNC(PyObject *) vector_frombuffer(PyObject *cls, PyObject *args, PyObject *kws);
 // returns a range vector
 PyAPI_FUNC(VectorObject *) vector_range(PyObject *self, PyObject *args, PyObject *kws);
 